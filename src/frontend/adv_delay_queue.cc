@@ -1,19 +1,15 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <netinet/in.h>
-#include <netinet/ip.h>
-#include <netinet/tcp.h>
-#include <netinet/udp.h>
-#include <sstream>
 #include <string>
 
 #include "adv_delay_queue.hh"
-#include "delay_rule.hh"
-#include "pktinfo.hh"
 #include "timestamp.hh"
 
 using namespace std;
@@ -30,6 +26,15 @@ void AdvDelayQueue::save_byte_counters(void)
     f.close();
 }
 
+// "address:port" for a rule, or "[address]:port" for IPv6.
+static string rule_endpoint(const DelayRule& rule)
+{
+    if (rule.prefix().family == AF_INET6) {
+        return "[" + rule.prefix().str() + "]:" + to_string(rule.port());
+    }
+    return rule.prefix().str() + ":" + to_string(rule.port());
+}
+
 void AdvDelayQueue::save_byte_per_conn_counters(void)
 {
     ofstream g;
@@ -39,17 +44,14 @@ void AdvDelayQueue::save_byte_per_conn_counters(void)
         g.open(path_prefix_ + ".bytes_per_conn_downlink");
     }
 
-    // FIXME: Add support for IPv6.
-    char ipv4[INET_ADDRSTRLEN];
-    for (auto const &per_conn : byte_counters_) {
-        for (auto const &per_port : per_conn.second) {
-            if (inet_ntop(AF_INET, &per_conn.first, ipv4,
-                          INET_ADDRSTRLEN) == NULL) {
-                throw runtime_error("Invalid IP address encountered!");
-            }
-            g << ipv4 << ":" << per_port.first
-              << " " << per_port.second << endl;
-        }
+    // Rules for different protocols share an endpoint.
+    map<string, uint64_t> per_conn;
+    for (size_t i = 0; i < rules_.size(); i++) {
+        per_conn[rule_endpoint(rules_.rule(i))] += rule_bytes_[i];
+    }
+
+    for (auto const &conn : per_conn) {
+        g << conn.first << " " << conn.second << endl;
     }
     g.close();
 }
@@ -63,227 +65,148 @@ void AdvDelayQueue::save_pkt_per_conn_counters(void)
         h.open(path_prefix_ + ".pkts_per_conn_downlink");
     }
 
-    // FIXME: Add support for IPv6.
-    char ipv4[INET_ADDRSTRLEN];
-    for (auto const &per_conn : pkt_counters_) {
-        for (auto const &per_port : per_conn.second) {
-            if (inet_ntop(AF_INET, &per_conn.first, ipv4,
-                          INET_ADDRSTRLEN) == NULL) {
-                throw runtime_error("Invalid IP address encountered!");
-            }
-            h << ipv4 << ":" << per_port.first
-              << " " << per_port.second << endl;
+    map<string, uint64_t> per_conn;
+    for (size_t i = 0; i < rules_.size(); i++) {
+        if (rule_pkts_[i] > 0) {
+            per_conn[rule_endpoint(rules_.rule(i))] += rule_pkts_[i];
         }
     }
+
+    for (auto const &conn : per_conn) {
+        h << conn.first << " " << conn.second << endl;
+    }
     h.close();
 }
 
-AdvDelayQueue::~AdvDelayQueue()
+void AdvDelayQueue::open_flow_log(void)
 {
-    save_byte_counters();
-    save_byte_per_conn_counters();
-    save_pkt_per_conn_counters();
-}
-
-uint64_t AdvDelayQueue::get_delay_for_tcp(const PortRules_t& port_rules,
-                                          const struct tcphdr *h,
-                                          const std::string::size_type& sz)
-{    
-    PortRules_t::const_iterator port_rules_iter =
-        port_rules.find(uplink_ ? ntohs(h->th_dport) :
-                        ntohs(h->th_sport));
-
-    if (port_rules_iter == port_rules.end()) {
-        // No matching rule.
-        return delay_ms_;
+    const string filename = path_prefix_ + (uplink_ ? ".flows_uplink" : ".flows_downlink");
+    flow_log_.reset(new ofstream(filename));
+    if (not flow_log_->good()) {
+        throw runtime_error(filename + ": error opening for writing");
     }
 
-    const DelayRule& rule = (*port_rules_iter).second;
-
-    // Bytes transferred on the link so far.
-    const uint64_t bytes_sent = byte_counters_[rule.ip()][rule.port()];
-
-    // Update byte counter with the size of the current packet.
-    byte_counters_[rule.ip()][rule.port()] += sz;
-
-    // Update packet counter
-    pkt_counters_[rule.ip()][rule.port()] += 1;
+    *flow_log_ << "# init timestamp: " << initial_timestamp() << endl;
+    *flow_log_ << "# timestamp proto src:sport dst:dport bytes packets last-seen" << endl;
+}
 
-    if (uplink_) {
-        // Uplink
+void AdvDelayQueue::save_flow_snapshot(const uint64_t& now)
+{
+    const uint64_t now_ms = now / NS_PER_MS;
 
-        if (bytes_sent < rule.fwd_lim()) {
-            return rule.fwd_delay();
-        } else {
-            return rule.fwd_alt_delay();
-        }
-    }
+    flows_.sweep([&](const FlowTable::Flow& flow) {
+            *flow_log_ << now_ms << " " << flow.key.str() << " " << flow.bytes
+                       << " " << flow.packets << " " << flow.last_seen << "\n";
+        });
+    flow_log_->flush();
 
-    // Downlink
-    if (bytes_sent < rule.rev_lim()) {
-        return rule.rev_delay();
-    } else {
-        return rule.rev_alt_delay();
-    }
+    next_snapshot_ = now + SNAPSHOT_INTERVAL_MS * NS_PER_MS;
 }
 
-uint64_t AdvDelayQueue::get_delay_for_udp(const PortRules_t& port_rules,
-                                          const struct udphdr *h)
+AdvDelayQueue::~AdvDelayQueue()
 {
-    PortRules_t::const_iterator port_rules_iter =
-        port_rules.find(uplink_ ? ntohs(h->uh_dport) :
-                        ntohs(h->uh_sport));
-
-    if (port_rules_iter == port_rules.end()) {
-        // No matching rule.
-        return delay_ms_;
+    if (flow_log_) {
+        save_flow_snapshot(timestamp_ns());
     }
-    
-    return uplink_ ? (*port_rules_iter).second.fwd_delay() :
-        (*port_rules_iter).second.rev_delay();
+    save_byte_counters();
+    save_byte_per_conn_counters();
+    save_pkt_per_conn_counters();
 }
 
-uint64_t AdvDelayQueue::get_delay_for_ipv4(const struct iphdr *h,
-                                           const std::string::size_type& sz)
+uint64_t AdvDelayQueue::get_delay_for(const char *pkt, const std::string::size_type& sz,
+                                      const uint64_t& now)
 {
-    ProtoRules_t::const_iterator proto_rules_iter = rules_.find(h->protocol);
-    if (proto_rules_iter == rules_.end()) {
+    FlowKey key;
+    if (not FlowKey::parse(pkt, sz, key)) {
+        // Neither IPv4 nor IPv6.
         return delay_ms_;
     }
 
-    const IPRules_t ip_rules = (*proto_rules_iter).second;
-    IPRules_t::const_iterator ip_rules_iter =
-        ip_rules.find(uplink_ ? h->daddr : h->saddr);
-    
-    if (ip_rules_iter == ip_rules.end()) {
-        // No matching rule in the forward or reverse directions.
+    flows_.add(key, sz, now / NS_PER_MS);
+
+    // The far end: the destination on the uplink, the source on the downlink.
+    // (Without ports, both are zero, and only port-0 rules match.)
+    const int family = key.family == 4 ? AF_INET : AF_INET6;
+    const int index = uplink_ ? rules_.lookup(family, key.proto, key.dst, true, key.dport)
+                              : rules_.lookup(family, key.proto, key.src, true, key.sport);
+    if (index == DelayRuleTable::NO_RULE) {
         return delay_ms_;
     }
+    const DelayRule& rule = rules_.rule(index);
 
-    const PortRules_t port_rules = (*ip_rules_iter).second;
-    // Check for wild card rule.
-    PortRules_t::const_iterator port_rules_iter = port_rules.find(0);
-    if (port_rules_iter != port_rules.end()) {
-        return uplink_ ? (*port_rules_iter).second.fwd_delay() :
-            (*port_rules_iter).second.rev_delay();
-    }
+    // Bytes transferred under the rule so far.
+    const uint64_t bytes_sent = rule_bytes_[index];
 
-    const char *pkt = (const char *) h;
-
-    switch (h->protocol) {
-    case IPPROTO_IP:
-        // Protocol not supported.
-        break;
-    case IPPROTO_ICMP:
-        // For ICMP, ports don't matter.
-        return uplink_ ? port_rules.at(DelayRule::WILDCARD_PORT).fwd_delay() :
-            port_rules.at(DelayRule::WILDCARD_PORT).rev_delay();
-    case IPPROTO_IGMP:
-    case IPPROTO_IPIP:
-        // Protocol not supported.
-        break;
-    case IPPROTO_TCP: {
-        const struct tcphdr *tcph = (struct tcphdr*) (pkt + h->ihl*4);
-        const uint64_t delay = get_delay_for_tcp(port_rules, tcph, sz);
-        // print_tcp_endpoints(h, delay);
-        return delay;
-    }
-    case IPPROTO_EGP:
-        // Protocol not supported.
-        break;
-    case IPPROTO_PUP:
-        // Protocol not supported.
-        break;
-    case IPPROTO_UDP: {
-        const struct udphdr *udph = (struct udphdr*) (pkt + h->ihl*4);
-        const uint64_t delay = get_delay_for_udp(port_rules, udph);
-        // print_udp_endpoints(h, delay);
-        return delay;
+    rule_bytes_[index] += sz;
+    rule_pkts_[index] += 1;
+
+    // Wildcard (port-0) rules, and rules for protocols other than TCP,
+    // always give the plain delay: the limits apply only to a TCP port.
+    if (key.proto != IPPROTO_TCP || rule.port() == DelayRule::WILDCARD_PORT) {
+        return uplink_ ? rule.fwd_delay() : rule.rev_delay();
     }
-    case IPPROTO_IDP:
-    case IPPROTO_TP:
-    case IPPROTO_DCCP:
-    case IPPROTO_IPV6:
-    case IPPROTO_RSVP:
-    case IPPROTO_GRE:
-    case IPPROTO_ESP:
-    case IPPROTO_AH:
-    case IPPROTO_MTP:
-    case IPPROTO_BEETPH:
-    case IPPROTO_ENCAP:
-    case IPPROTO_PIM:
-    case IPPROTO_COMP:
-    case IPPROTO_SCTP:
-    case IPPROTO_UDPLITE:
-    case IPPROTO_RAW:
-default:
-        // Protocol not supported.
-        break;
+
+    // A TCP connection switches to the alternate delay after its limit.
+    if (uplink_) {
+        return bytes_sent < rule.fwd_lim() ? rule.fwd_delay() : rule.fwd_alt_delay();
     }
-    
-    return delay_ms_;
+    return bytes_sent < rule.rev_lim() ? rule.rev_delay() : rule.rev_alt_delay();
 }
 
-uint64_t AdvDelayQueue::get_delay_for_ipv6(const struct iphdr *h,
-                                           const std::string::size_type& sz)
+void AdvDelayQueue::read_packets(vector<PacketBuffer>& batch)
 {
-    if (h->protocol != 6) {
-        ostringstream err;
-        err << "Data (sz: " << sz << ") is not an IPv6 packet!";
-        throw runtime_error(err.str());
+    const uint64_t now = timestamp_ns();
+
+    // Bring the wheel up to date, so the packets go in near its current tick.
+    packet_queue_.advance(now);
+
+    for (auto& contents : batch) {
+        num_bytes_ += contents.size();
+        // Perform deep packet inspection to identify which delay rule to apply.
+        uint64_t pkt_delay = get_delay_for(contents.data(), contents.size(), now);
+        packet_queue_.insert(now + pkt_delay * NS_PER_MS, move(contents));
     }
-    // TODO: Add support for IPv6 addresses as well.
-    return delay_ms_;
-}
 
-uint64_t AdvDelayQueue::get_delay_for(const char *pkt, const std::string::size_type& sz)
-{
-    // NOTE: IFF_NO_PI is unset, and hence, ignore first four bytes.
-    //  If IFF_NO_PI is unset, first four bytes contain two flag bytes and two
-    //   protocol bytes.
-    // printf("#- bytes[0:4]- flag[%02x, %02x]  protocol[%02x, %02x]\n",
-    //        *(pkt + 0), *(pkt + 1), *(pkt + 2), *(pkt + 3));
-
-    const struct iphdr *h = (struct iphdr *)(pkt + 4);
-    
-    if (h->version != 4) {
-        return get_delay_for_ipv6(h, sz);
-    } else {
-        return get_delay_for_ipv4(h, sz);
+    batch.clear();
+
+    if (now >= next_snapshot_) {
+        save_flow_snapshot(now);
     }
 }
 
-void AdvDelayQueue::read_packet(const string& contents)
+void AdvDelayQueue::write_packets(FileDescriptor& fd)
 {
-    num_bytes_ += contents.size();
-    if (contents.size() < sizeof(struct iphdr)) {
-        throw new runtime_error("Packet too small!");
+    // One clock read for the whole batch.
+    packet_queue_.advance(timestamp_ns());
+
+    while (packet_queue_.has_ready()) {
+        const PacketBuffer& packet = packet_queue_.next_ready();
+        fd.write(packet.data(), packet.size());
+        packet_queue_.pop_ready();
     }
-    // Perform deep packet inspection to identify which delay rule to apply.
-    uint64_t pkt_delay = get_delay_for(contents.data(), contents.size());
-    packet_queue_.emplace(timestamp() + pkt_delay, contents);
 }
 
-void AdvDelayQueue::write_packets(FileDescriptor& fd)
+void AdvDelayQueue::take_output(vector<PacketBuffer>& batch)
 {
-    while ((!packet_queue_.empty())
-           && (packet_queue_.top().first <= timestamp())) {
-        fd.write(packet_queue_.top().second);
-        packet_queue_.pop();
+    packet_queue_.advance(timestamp_ns());
+
+    while (packet_queue_.has_ready()) {
+        batch.push_back(packet_queue_.take_ready());
     }
 }
 
-unsigned int AdvDelayQueue::wait_time( void ) const
+uint64_t AdvDelayQueue::wait_time( void ) const
 {
     if (packet_queue_.empty()) {
-        return numeric_limits<uint16_t>::max();
+        return numeric_limits<uint16_t>::max() * NS_PER_MS;
     }
 
-    const auto now = timestamp();
+    const uint64_t next_release = packet_queue_.next_release_time();
+    const auto now = timestamp_ns();
 
-    if (packet_queue_.top().first <= now) {
+    if (next_release <= now) {
         return 0;
     } else {
-        return packet_queue_.top().first - now;
+        return min(next_release - now, numeric_limits<uint16_t>::max() * NS_PER_MS);
     }
 }
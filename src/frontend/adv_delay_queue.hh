@@ -4,12 +4,16 @@
 #define ADV_DELAY_QUEUE_HH
 
 #include <cstdint>
-#include <queue>
+#include <fstream>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include "delay_rule.hh"
+#include "delay_rule_table.hh"
 #include "file_descriptor.hh"
+#include "flow_table.hh"
+#include "packet_buffer.hh"
+#include "timing_wheel.hh"
 
 class AdvDelayQueue
 {
@@ -17,35 +21,24 @@ class AdvDelayQueue
 private:
     uint64_t delay_ms_;
 
-    typedef std::pair<uint64_t, std::string> DelayPktPair_t;
-
-    class DelayPktPairCmp final
-    {
-    public:
-        bool operator() (const DelayPktPair_t& lhs, const DelayPktPair_t& rhs)
-        {
-            // NOTE: Packets are in **ascending order** of release times.
-            return lhs.first > rhs.first;
-        }
-    };
-
-    // Release timestamp, contents.
-    std::priority_queue<DelayPktPair_t,
-                        std::vector<DelayPktPair_t>,
-                        DelayPktPairCmp> packet_queue_;
+    // Packets by release timestamp (ns), released in ascending order.
+    TimingWheel packet_queue_;
 
     // Packet delay rules.
-    const DelayRules_t rules_;
+    const DelayRuleTable rules_;
+
+    // Bytes and packets that matched each rule (uplink or downlink).
+    std::vector<uint64_t> rule_bytes_;
+    std::vector<uint64_t> rule_pkts_;
 
-    typedef std::map<uint16_t, uint64_t> PerPortBytes_t;
-    typedef std::map<uint32_t, PerPortBytes_t> PerConnBytes_t;
-    // Bytes transferred per TCP connection (uplink or downlink).
-    PerConnBytes_t byte_counters_;
+    // Bytes and packets per flow since the last snapshot.
+    FlowTable flows_;
 
-    typedef std::map<uint16_t, uint64_t> PerPortPkts_t;
-    typedef std::map<uint32_t, PerPortPkts_t> PerConnPkts_t;
-    // Packets transferred per TCP connection (uplink or downlink).
-    PerConnBytes_t pkt_counters_;
+    // Snapshots of flows_, written every SNAPSHOT_INTERVAL_MS while
+    // packets arrive and at exit.
+    static const uint64_t SNAPSHOT_INTERVAL_MS = 1000;
+    std::unique_ptr<std::ofstream> flow_log_;
+    uint64_t next_snapshot_;
 
     // True, if queue is used for uplink; false, otherwise.
     const bool uplink_;
@@ -59,44 +52,43 @@ private:
     void save_byte_counters(void);
     void save_byte_per_conn_counters(void);
     void save_pkt_per_conn_counters(void);
+    void open_flow_log(void);
+    void save_flow_snapshot(const uint64_t& now);
 
 protected:
-    uint64_t get_delay_for_tcp(const PortRules_t& port_rules,
-                               const struct tcphdr *h,
-                               const std::string::size_type& sz);
-    uint64_t get_delay_for_udp(const PortRules_t& port_rules,
-                               const struct udphdr *h);
-    uint64_t get_delay_for_ipv4(const struct iphdr *h,
-                                const std::string::size_type& sz);
-    uint64_t get_delay_for_ipv6(const struct iphdr *h,
-                                const std::string::size_type& sz);
-    uint64_t get_delay_for(const char *h,
-                           const std::string::size_type& sz);
+    // Delay (ms) for a packet as read from the tun device at now (ns),
+    // counting it for its flow.
+    uint64_t get_delay_for(const char *pkt, const std::string::size_type& sz,
+                           const uint64_t& now);
 
 public:
-    AdvDelayQueue(const uint64_t& delay_ms, const DelayRules_t& rules,
+    AdvDelayQueue(const uint64_t& delay_ms, const DelayRuleTable& rules,
                   const bool& uplink, const std::string& path_prefix)
         : delay_ms_(delay_ms), packet_queue_(),
-          rules_(rules), byte_counters_(), pkt_counters_(),
+          rules_(rules), rule_bytes_(rules.size(), 0), rule_pkts_(rules.size(), 0),
+          flows_(), flow_log_(), next_snapshot_(0),
           uplink_(uplink), num_bytes_(0),
           path_prefix_(path_prefix)
     {
-        for (auto const &proto_rules : rules_) {
-            for (auto const &ip_rules : proto_rules.second) {
-                for (auto const &port_rules : ip_rules.second) {
-                    byte_counters_[ip_rules.first][port_rules.first] = 0;
-                }
-            }
-        }
+        open_flow_log();
     }
 
     ~AdvDelayQueue();
 
-    void read_packet(const std::string & contents);
+    // Queued packets can be moved but not copied.
+    AdvDelayQueue(AdvDelayQueue&& other) = default;
+
+    // Take every packet read in one wakeup (leaves batch empty).
+    void read_packets(std::vector<PacketBuffer> & batch);
 
     void write_packets(FileDescriptor & fd);
 
-    unsigned int wait_time(void) const;
+    // Hand over the packets that are ready to leave, appending them to
+    // batch (when this queue is one stage of a chain).
+    void take_output(std::vector<PacketBuffer> & batch);
+
+    // Nanoseconds until the next packet is due.
+    uint64_t wait_time(void) const;
 
     bool pending_output(void) const { return wait_time() <= 0; }
 
@@ -3,7 +3,7 @@
 #include <vector>
 #include <string>
 
-#include "delay_rule.hh"
+#include "delay_rule_table.hh"
 #include "adv_delay_queue.hh"
 #include "util.hh"
 #include "ezio.hh"
@@ -31,7 +31,7 @@ int main(int argc, char *argv[])
 
         const uint64_t delay_ms = myatoi(argv[1]);
         string rules_file = argv[2];
-        DelayRules_t rules = parse_rules(rules_file);
+        const DelayRuleTable rules(parse_rules(rules_file));
         string path_prefix = argv[3];
 
         vector<string> command;
@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "recording_archive.hh"
+#include "temp_file.hh"
+#include "util.hh"
+#include "exception.hh"
+
+#include "http_record.pb.h"
+
+using namespace std;
+
+/* convert between a recording directory (one file per request/response) and a recording archive */
+
+void pack( const string & directory, const string & archive_filename )
+{
+    ArchiveWriter archive( archive_filename );
+
+    load_recording( directory, [&] ( const MahimahiProtobufs::RequestResponse & record ) {
+            archive.append( record );
+        } );
+
+    archive.finish();
+}
+
+void unpack( const string & archive_filename, string directory )
+{
+    if ( directory.back() != '/' ) {
+        directory.append( "/" );
+    }
+
+    make_directory( directory );
+
+    const ArchiveReader archive( archive_filename );
+
+    for ( size_t i = 0; i < archive.size(); i++ ) {
+        UniqueFile file( directory + "save" );
+        if ( not archive.record( i ).SerializeToFileDescriptor( file.fd().fd_num() ) ) {
+            throw runtime_error( file.name() + ": failure to serialize HTTP request/response pair" );
+        }
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const string usage = "Usage: " + string( argv[ 0 ] ) + " pack DIRECTORY ARCHIVE | unpack ARCHIVE DIRECTORY";
+
+        if ( argc != 4 or string( argv[ 2 ] ).empty() or string( argv[ 3 ] ).empty() ) {
+            throw runtime_error( usage );
+        }
+
+        const string mode = argv[ 1 ];
+
+        if ( mode == "pack" ) {
+            pack( argv[ 2 ], argv[ 3 ] );
+        } else if ( mode == "unpack" ) {
+            unpack( argv[ 2 ], argv[ 3 ] );
+        } else {
+            throw runtime_error( usage );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
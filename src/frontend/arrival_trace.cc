@@ -0,0 +1,163 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+
+#include "arrival_trace.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const size_t PCAP_HEADER_SIZE = 24, PCAP_RECORD_HEADER_SIZE = 16;
+
+/* the packet information header on each TUN datagram */
+static const size_t TUN_HEADER_SIZE = 4;
+
+static uint32_t native_field( const char * data )
+{
+    uint32_t ret;
+    memcpy( &ret, data, sizeof( ret ) );
+    return ret;
+}
+
+/* bytes in front of the IP packet for each pcap link type */
+static size_t link_header_size( const uint32_t link_type, const string & filename )
+{
+    switch ( link_type ) {
+    case 1:   /* Ethernet */
+        return 14;
+    case 12:  /* raw IP */
+    case 101: /* raw IP */
+    case 228: /* raw IPv4 */
+    case 229: /* raw IPv6 */
+        return 0;
+    case 113: /* Linux cooked capture */
+        return 16;
+    case 276: /* Linux cooked capture v2 */
+        return 20;
+    default:
+        throw runtime_error( filename + ": unsupported pcap link type " + to_string( link_type ) );
+    }
+}
+
+ArrivalTrace::ArrivalTrace( const string & filename )
+    : filename_( filename ),
+      file_( filename ),
+      pos_( file_.data() ),
+      pcap_( false ),
+      swapped_( false ),
+      nanosecond_( false ),
+      link_header_size_( 0 ),
+      have_first_time_( false ),
+      first_time_( 0 )
+{
+    if ( file_.size() < 4 ) {
+        return;
+    }
+
+    const uint32_t magic = native_field( file_.data() );
+
+    if ( magic == 0xa1b2c3d4 or magic == 0xa1b23c4d ) {
+        pcap_ = true;
+    } else if ( magic == 0xd4c3b2a1 or magic == 0x4d3cb2a1 ) {
+        pcap_ = swapped_ = true;
+    }
+
+    if ( pcap_ ) {
+        if ( file_.size() < PCAP_HEADER_SIZE ) {
+            throw runtime_error( filename + ": truncated pcap header" );
+        }
+
+        nanosecond_ = ( pcap_field( file_.data() ) == 0xa1b23c4d );
+        link_header_size_ = link_header_size( pcap_field( file_.data() + 20 ), filename );
+        pos_ += PCAP_HEADER_SIZE;
+    }
+}
+
+uint32_t ArrivalTrace::pcap_field( const char * data ) const
+{
+    const uint32_t value = native_field( data );
+    return swapped_ ? __builtin_bswap32( value ) : value;
+}
+
+bool ArrivalTrace::next_text( Arrival & arrival )
+{
+    const char * const end = file_.data() + file_.size();
+
+    while ( pos_ < end ) {
+        const char * eol = static_cast<const char *>( memchr( pos_, '\n', end - pos_ ) );
+        if ( not eol ) {
+            eol = end;
+        }
+
+        const string line( pos_, eol );
+        pos_ = eol + 1;
+
+        if ( line.empty() or line.front() == '#' ) {
+            continue;
+        }
+
+        const size_t space = line.find( ' ' );
+        if ( space == string::npos ) {
+            throw runtime_error( filename_ + ": expected \"TIME_MS SIZE\", not \"" + line + "\"" );
+        }
+
+        arrival.time = myatoms_ns( line.substr( 0, space ) );
+        const long int size = myatoi( line.substr( space + 1 ) );
+        if ( size <= 0 ) {
+            throw runtime_error( filename_ + ": invalid packet size in \"" + line + "\"" );
+        }
+        arrival.size = size;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool ArrivalTrace::next_pcap( Arrival & arrival )
+{
+    const char * const end = file_.data() + file_.size();
+
+    if ( pos_ == end ) {
+        return false;
+    }
+
+    if ( size_t( end - pos_ ) < PCAP_RECORD_HEADER_SIZE ) {
+        throw runtime_error( filename_ + ": truncated pcap record" );
+    }
+
+    const uint64_t seconds = pcap_field( pos_ );
+    const uint64_t fraction = pcap_field( pos_ + 4 );
+    const uint32_t captured_length = pcap_field( pos_ + 8 );
+    const uint32_t original_length = pcap_field( pos_ + 12 );
+
+    pos_ += PCAP_RECORD_HEADER_SIZE;
+
+    if ( size_t( end - pos_ ) < captured_length ) {
+        throw runtime_error( filename_ + ": truncated pcap record" );
+    }
+
+    pos_ += captured_length;
+
+    if ( original_length <= link_header_size_ ) {
+        throw runtime_error( filename_ + ": pcap record too short for its link-layer header" );
+    }
+
+    const uint64_t time = seconds * NS_PER_SECOND + fraction * ( nanosecond_ ? 1 : 1000 );
+
+    if ( not have_first_time_ ) {
+        first_time_ = time;
+        have_first_time_ = true;
+    }
+
+    if ( time < first_time_ ) {
+        throw runtime_error( filename_ + ": pcap records must be in time order" );
+    }
+
+    arrival.time = time - first_time_;
+    arrival.size = original_length - link_header_size_ + TUN_HEADER_SIZE;
+
+    return true;
+}
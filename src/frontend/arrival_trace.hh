@@ -0,0 +1,53 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef ARRIVAL_TRACE_HH
+#define ARRIVAL_TRACE_HH
+
+#include <string>
+#include <cstdint>
+
+#include "mapped_file.hh"
+
+/* Packets arriving at a simulated link, read in order from either a
+   text file with one "TIME_MS SIZE" line per packet (time with up to
+   six decimals; lines starting with # are comments) or a pcap capture.
+   Sizes are of the datagrams mm-link would see: a captured IP packet
+   plus the 4-byte TUN header. Capture times count from the first packet. */
+class ArrivalTrace
+{
+public:
+    struct Arrival
+    {
+        uint64_t time; /* ns */
+        size_t size;   /* bytes */
+    };
+
+private:
+    std::string filename_;
+    MappedFile file_;
+    const char * pos_;
+
+    bool pcap_;
+    bool swapped_;            /* pcap written with the other byte order */
+    bool nanosecond_;         /* pcap timestamps in ns rather than us */
+    size_t link_header_size_; /* bytes in front of each captured IP packet */
+    bool have_first_time_;
+    uint64_t first_time_;
+
+    uint32_t pcap_field( const char * data ) const;
+
+    bool next_text( Arrival & arrival );
+    bool next_pcap( Arrival & arrival );
+
+public:
+    ArrivalTrace( const std::string & filename );
+
+    /* the next arrival, or false at the end of the file */
+    bool next( Arrival & arrival ) { return pcap_ ? next_pcap( arrival ) : next_text( arrival ); }
+
+    /* ban copying */
+    ArrivalTrace( const ArrivalTrace & other ) = delete;
+    ArrivalTrace & operator=( const ArrivalTrace & other ) = delete;
+};
+
+#endif /* ARRIVAL_TRACE_HH */
@@ -0,0 +1,268 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <endian.h>
+
+#include <cstring>
+#include <limits>
+
+#include "compiled_trace.hh"
+#include "rate_trace.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const string TRACE_MAGIC = "MMTRACE1";
+
+/* magic, opportunities, runs, duration */
+static const size_t HEADER_SIZE = 8 + 3 * sizeof( uint64_t );
+
+static void append_le64( string & out, const uint64_t value )
+{
+    const uint64_t encoded = htole64( value );
+    out.append( reinterpret_cast<const char *>( &encoded ), sizeof( encoded ) );
+}
+
+static uint64_t read_le64( const char * data )
+{
+    uint64_t encoded;
+    memcpy( &encoded, data, sizeof( encoded ) );
+    return le64toh( encoded );
+}
+
+static void append_varint( string & out, uint64_t value )
+{
+    while ( value >= 0x80 ) {
+        out.push_back( char( ( value & 0x7f ) | 0x80 ) );
+        value >>= 7;
+    }
+    out.push_back( char( value ) );
+}
+
+/* no bounds checks: the whole trace was validated when loaded */
+static uint64_t read_varint( const char * & pos )
+{
+    uint64_t value = 0;
+    unsigned int shift = 0;
+
+    while ( true ) {
+        const uint8_t byte = *pos++;
+        value |= uint64_t( byte & 0x7f ) << shift;
+        if ( not ( byte & 0x80 ) ) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+/* returns false if the varint runs past end or doesn't fit in 64 bits */
+static bool read_varint_checked( const char * & pos, const char * const end, uint64_t & value )
+{
+    value = 0;
+
+    for ( unsigned int shift = 0; shift < 64; shift += 7 ) {
+        if ( pos == end ) {
+            return false;
+        }
+
+        const uint8_t byte = *pos++;
+        const uint64_t bits = byte & 0x7f;
+
+        if ( shift == 63 and bits > 1 ) {
+            return false;
+        }
+
+        value |= bits << shift;
+
+        if ( not ( byte & 0x80 ) ) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool CompiledTrace::is_compiled( const char * data, const size_t length )
+{
+    return length >= TRACE_MAGIC.size()
+        and TRACE_MAGIC.compare( 0, string::npos, data, TRACE_MAGIC.size() ) == 0;
+}
+
+string CompiledTrace::compile( const char * text, const size_t length, const string & filename )
+{
+    string runs;
+    uint64_t opportunities = 0, run_count = 0;
+    uint64_t run_time = 0, run_length = 0;
+
+    auto add_opportunity = [&] ( const uint64_t ns ) {
+        if ( run_length > 0 and ns == run_time ) {
+            run_length++;
+        } else {
+            if ( run_length > 0 ) {
+                if ( ns < run_time ) {
+                    throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
+                }
+
+                append_varint( runs, run_length );
+                append_varint( runs, ns - run_time );
+            } else {
+                append_varint( runs, ns );
+            }
+
+            run_time = ns;
+            run_length = 1;
+            run_count++;
+        }
+
+        opportunities++;
+    };
+
+    if ( RateTrace::is_rate_trace( text, length ) ) {
+        /* list every opportunity the rates add up to */
+        const RateTrace rates( text, length, filename );
+        RateTrace::Cursor cursor( rates );
+
+        do {
+            add_opportunity( cursor.time() );
+        } while ( cursor.advance() );
+    } else {
+        const char * pos = text;
+        const char * const end = text + length;
+
+        while ( pos < end ) {
+            const char * eol = static_cast<const char *>( memchr( pos, '\n', end - pos ) );
+            if ( not eol ) {
+                eol = end;
+            }
+
+            const string line( pos, eol );
+            pos = eol + 1;
+
+            if ( line.empty() ) {
+                throw runtime_error( filename + ": invalid empty line" );
+            }
+
+            /* milliseconds, optionally with a fraction for sub-millisecond delivery times */
+            add_opportunity( myatoms_ns( line ) );
+        }
+    }
+
+    if ( opportunities == 0 ) {
+        throw runtime_error( filename + ": no valid timestamps found" );
+    }
+
+    append_varint( runs, run_length );
+
+    if ( run_time == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+
+    string ret = TRACE_MAGIC;
+    append_le64( ret, opportunities );
+    append_le64( ret, run_count );
+    append_le64( ret, run_time );
+
+    return ret + runs;
+}
+
+CompiledTrace::CompiledTrace( const string & filename )
+    : file_( new MappedFile( filename ) ),
+      compiled_(),
+      data_( file_->data() ),
+      size_( file_->size() ),
+      opportunities_( 0 ),
+      runs_( 0 ),
+      duration_( 0 )
+{
+    if ( not is_compiled( data_, size_ ) ) {
+        /* text trace: compile it and let go of the text */
+        compiled_ = compile( data_, size_, filename );
+        file_.reset();
+        data_ = compiled_.data();
+        size_ = compiled_.size();
+    }
+
+    validate( filename );
+}
+
+/* check the whole compiled trace once so cursors can decode it unchecked */
+void CompiledTrace::validate( const string & filename )
+{
+    if ( size_ < HEADER_SIZE ) {
+        throw runtime_error( filename + ": truncated compiled trace" );
+    }
+
+    opportunities_ = read_le64( data_ + 8 );
+    runs_ = read_le64( data_ + 16 );
+    duration_ = read_le64( data_ + 24 );
+
+    const char * pos = data_ + HEADER_SIZE;
+    const char * const end = data_ + size_;
+
+    uint64_t time = 0, opportunities = 0;
+
+    for ( uint64_t run = 0; run < runs_; run++ ) {
+        uint64_t delta, count;
+        if ( not read_varint_checked( pos, end, delta )
+             or not read_varint_checked( pos, end, count )
+             or count == 0
+             or delta > numeric_limits<uint64_t>::max() - time
+             or count > numeric_limits<uint64_t>::max() - opportunities ) {
+            throw runtime_error( filename + ": corrupt compiled trace" );
+        }
+
+        time += delta;
+        opportunities += count;
+    }
+
+    if ( runs_ == 0 or pos != end or opportunities != opportunities_ or time != duration_ ) {
+        throw runtime_error( filename + ": corrupt compiled trace" );
+    }
+
+    if ( duration_ == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+}
+
+CompiledTrace::Cursor::Cursor( const CompiledTrace & trace )
+    : trace_( &trace ),
+      next_run_( nullptr ),
+      time_( 0 ),
+      left_in_run_( 0 )
+{
+    rewind();
+}
+
+void CompiledTrace::Cursor::rewind( void )
+{
+    next_run_ = trace_->data_ + HEADER_SIZE;
+    time_ = 0;
+    read_run();
+}
+
+uint64_t CompiledTrace::Cursor::skip_through( const uint64_t t, bool & wrapped )
+{
+    uint64_t skipped = 0;
+    wrapped = false;
+
+    /* whole runs at a time */
+    while ( time_ <= t ) {
+        skipped += left_in_run_;
+
+        if ( next_run_ == trace_->data_ + trace_->size_ ) {
+            rewind();
+            wrapped = true;
+            break;
+        }
+
+        read_run();
+    }
+
+    return skipped;
+}
+
+void CompiledTrace::Cursor::read_run( void )
+{
+    time_ += read_varint( next_run_ );
+    left_in_run_ = read_varint( next_run_ );
+}
@@ -0,0 +1,101 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef COMPILED_TRACE_HH
+#define COMPILED_TRACE_HH
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+#include "mapped_file.hh"
+
+/* A packet-delivery trace as runs of opportunities that share a
+   timestamp. The compiled form is "MMTRACE1", then the number of
+   opportunities, the number of runs and the time of the last
+   opportunity (ns), each LE64, then each run as two LEB128 varints:
+   the time since the previous run (ns) and the number of opportunities.
+
+   A compiled trace file (from mm-trace-compile) is mapped read-only and
+   shared with every other process using it; a text trace is compiled
+   into memory when loaded. */
+class CompiledTrace
+{
+private:
+    std::unique_ptr<MappedFile> file_;
+    std::string compiled_;
+
+    const char * data_;
+    size_t size_;
+
+    uint64_t opportunities_;
+    uint64_t runs_;
+    uint64_t duration_;
+
+    void validate( const std::string & filename );
+
+public:
+    CompiledTrace( const std::string & filename );
+
+    /* the compiled form of a text trace (one timestamp in ms per line),
+       or of the opportunities a rate trace adds up to */
+    static std::string compile( const char * text, const size_t length, const std::string & filename );
+
+    static bool is_compiled( const char * data, const size_t length );
+
+    /* the compiled form, e.g. to save to a file */
+    std::string serialized( void ) const { return std::string( data_, size_ ); }
+
+    uint64_t opportunities( void ) const { return opportunities_; }
+    uint64_t runs( void ) const { return runs_; }
+
+    /* time of the last opportunity (ns); the trace repeats with this period */
+    uint64_t duration( void ) const { return duration_; }
+
+    /* walks the opportunities in order, decoding runs as it reaches them */
+    class Cursor
+    {
+    private:
+        const CompiledTrace * trace_;
+        const char * next_run_;
+        uint64_t time_;
+        uint64_t left_in_run_;
+
+        void read_run( void );
+
+    public:
+        Cursor( const CompiledTrace & trace );
+
+        /* time of the current opportunity (ns from start of trace) */
+        uint64_t time( void ) const { return time_; }
+
+        /* move to the next opportunity; returns false on wrapping
+           around to the first */
+        bool advance( void )
+        {
+            if ( --left_in_run_ ) {
+                return true;
+            }
+
+            if ( next_run_ == trace_->data_ + trace_->size_ ) {
+                rewind();
+                return false;
+            }
+
+            read_run();
+            return true;
+        }
+
+        /* move past every opportunity at or before time t, stopping
+           early at the end of the trace (setting wrapped and rewinding);
+           returns the number of opportunities passed */
+        uint64_t skip_through( const uint64_t t, bool & wrapped );
+
+        void rewind( void );
+    };
+
+    /* ban copying (cursors point into the compiled form) */
+    CompiledTrace( const CompiledTrace & other ) = delete;
+    CompiledTrace & operator=( const CompiledTrace & other ) = delete;
+};
+
+#endif /* COMPILED_TRACE_HH */
@@ -1,37 +1,94 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <limits>
+#include <algorithm>
 
 #include "delay_queue.hh"
 #include "timestamp.hh"
 
 using namespace std;
 
-void DelayQueue::read_packet( const string & contents )
+DelayQueue::DelayQueue( const uint64_t & s_delay_ns )
+    : delay_ns_( s_delay_ns ),
+      jitter_(),
+      reorder_( false ),
+      prng_(),
+      last_release_time_( 0 ),
+      packet_queue_()
+{}
+
+DelayQueue::DelayQueue( const uint64_t & s_delay_ns, const string & jitter_filename, const bool reorder )
+    : delay_ns_( s_delay_ns ),
+      jitter_( new JitterDistribution( jitter_filename ) ),
+      reorder_( reorder ),
+      prng_( random_device()() ),
+      last_release_time_( 0 ),
+      packet_queue_()
+{}
+
+uint64_t DelayQueue::release_time( const uint64_t now )
+{
+    if ( not jitter_ ) {
+        return now + delay_ns_;
+    }
+
+    uint64_t ret = now + delay_ns_ + jitter_->sample( prng_ );
+
+    if ( not reorder_ ) {
+        /* not before the packets ahead of this one */
+        ret = max( ret, last_release_time_ );
+        last_release_time_ = ret;
+    }
+
+    return ret;
+}
+
+void DelayQueue::read_packets( vector<PacketBuffer> & batch )
 {
-    packet_queue_.emplace( timestamp() + delay_ms_, contents );
+    const uint64_t now = timestamp_ns();
+
+    /* bring the wheel up to date, so the packets go in near its current tick */
+    packet_queue_.advance( now );
+
+    for ( auto & contents : batch ) {
+        packet_queue_.insert( release_time( now ), move( contents ) );
+    }
+
+    batch.clear();
 }
 
 void DelayQueue::write_packets( FileDescriptor & fd )
 {
-    while ( (!packet_queue_.empty())
-            && (packet_queue_.front().first <= timestamp()) ) {
-        fd.write( packet_queue_.front().second );
-        packet_queue_.pop();
+    packet_queue_.advance( timestamp_ns() );
+
+    while ( packet_queue_.has_ready() ) {
+        const PacketBuffer & packet = packet_queue_.next_ready();
+        fd.write( packet.data(), packet.size() );
+        packet_queue_.pop_ready();
+    }
+}
+
+void DelayQueue::take_output( vector<PacketBuffer> & batch )
+{
+    packet_queue_.advance( timestamp_ns() );
+
+    while ( packet_queue_.has_ready() ) {
+        batch.push_back( packet_queue_.take_ready() );
     }
 }
 
-unsigned int DelayQueue::wait_time( void ) const
+uint64_t DelayQueue::wait_time( void ) const
 {
     if ( packet_queue_.empty() ) {
-        return numeric_limits<uint16_t>::max();
+        return numeric_limits<uint16_t>::max() * NS_PER_MS;
     }
 
-    const auto now = timestamp();
+    const uint64_t next_release = packet_queue_.next_release_time();
+    const auto now = timestamp_ns();
 
-    if ( packet_queue_.front().first <= now ) {
+    if ( next_release <= now ) {
         return 0;
     } else {
-        return packet_queue_.front().first - now;
+        return min( next_release - now, numeric_limits<uint16_t>::max() * NS_PER_MS );
     }
 }
@@ -3,27 +3,53 @@
 #ifndef DELAY_QUEUE_HH
 #define DELAY_QUEUE_HH
 
-#include <queue>
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <memory>
+#include <random>
 
 #include "file_descriptor.hh"
-
+#include "packet_buffer.hh"
+#include "timing_wheel.hh"
+#include "jitter_distribution.hh"
+
+/* Delays every packet by a fixed amount, plus (optionally) jitter drawn
+   per packet. Unless reordering is allowed, a packet is held until the
+   packets ahead of it have left, as on a FIFO path; otherwise a packet
+   with less jitter overtakes those ahead of it. The timing wheel keeps
+   packets in order of release time either way. */
 class DelayQueue
 {
 private:
-    uint64_t delay_ms_;
-    std::queue< std::pair<uint64_t, std::string> > packet_queue_;
-    /* release timestamp, contents */
+    uint64_t delay_ns_;
+    std::unique_ptr<JitterDistribution> jitter_;
+    bool reorder_;
+
+    std::default_random_engine prng_;
+    uint64_t last_release_time_; /* ns */
+
+    TimingWheel packet_queue_;
+
+    uint64_t release_time( const uint64_t now );
 
 public:
-    DelayQueue( const uint64_t & s_delay_ms ) : delay_ms_( s_delay_ms ), packet_queue_() {}
+    DelayQueue( const uint64_t & s_delay_ns );
+
+    /* with jitter from a CDF file (see JitterDistribution) */
+    DelayQueue( const uint64_t & s_delay_ns, const std::string & jitter_filename, const bool reorder );
 
-    void read_packet( const std::string & contents );
+    /* take every packet read in one wakeup (leaves batch empty) */
+    void read_packets( std::vector<PacketBuffer> & batch );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void ) const;
+    /* hand over the packets that are ready to leave, appending them to
+       batch (when this queue is one stage of mm-net's chain) */
+    void take_output( std::vector<PacketBuffer> & batch );
+
+    /* nanoseconds until the next packet is due */
+    uint64_t wait_time( void ) const;
 
     bool pending_output( void ) const { return wait_time() <= 0; }
 
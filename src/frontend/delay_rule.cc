@@ -2,6 +2,8 @@
 
 #include<algorithm>
 #include<arpa/inet.h>
+#include<cstdlib>
+#include<cstring>
 #include<fstream>
 #include<iomanip>
 #include<iostream>
@@ -18,14 +20,69 @@ bool DelayRule::isPortReqd()
     return _port == DelayRule::WILDCARD_PORT;
 }
 
-ProtoRules_t parse_rules(const string & rules_file)
+string IPPrefix::str() const
+{
+    char text[INET6_ADDRSTRLEN];
+    if (inet_ntop(family, addr, text, sizeof(text)) == NULL) {
+        throw runtime_error("Invalid IP address encountered!");
+    }
+
+    if (is_address()) {
+        return text;
+    }
+    return string(text) + "/" + to_string(len);
+}
+
+IPPrefix IPPrefix::parse(const string & text)
+{
+    IPPrefix ret;
+    memset(&ret, 0, sizeof(ret));
+
+    const string::size_type slash = text.find('/');
+    const string addr = text.substr(0, slash);
+
+    ret.family = addr.find(':') == string::npos ? AF_INET : AF_INET6;
+    int e;
+    if ((e = inet_pton(ret.family, addr.c_str(), ret.addr)) <= 0) {
+        ostringstream err;
+        if (e == 0) {
+            err << "IP address '"
+                << addr
+                << "' not in presentation format!";
+        } else {
+            err << "'"
+                << addr
+                << "' is not a valid IP address!";
+        }
+        throw runtime_error(err.str());
+    }
+
+    ret.len = ret.max_len();
+    if (slash != string::npos) {
+        const string len = text.substr(slash + 1);
+        if (len.empty() || len.find_first_not_of("0123456789") != string::npos
+            || std::atoi(len.c_str()) > int(ret.max_len())) {
+            throw runtime_error("Invalid prefix length in '" + text + "'!");
+        }
+        ret.len = std::atoi(len.c_str());
+
+        // Clear the host bits, so equal prefixes compare equal.
+        for (unsigned int bit = ret.len; bit < ret.max_len(); bit++) {
+            ret.addr[bit / 8] &= ~(0x80 >> (bit % 8));
+        }
+    }
+
+    return ret;
+}
+
+DelayRules_t parse_rules(const string & rules_file)
 {
   ifstream fd(rules_file.c_str());
   if (!fd.good()) {
     throw runtime_error("Rules file '" + rules_file + "' does not exist!");
   }
 
-  ProtoRules_t rules;
+  DelayRules_t rules;
 
   string line;
   uint32_t rule_num = 0;
@@ -52,23 +109,7 @@ ProtoRules_t parse_rules(const string & rules_file)
           throw runtime_error(err.str());
       }
 
-      string addr = cols.at(1);
-      // TODO: Add support for ipv6
-      uint32_t ipv4;
-      int e;
-      if ((e = inet_pton(AF_INET, addr.c_str(), &ipv4)) <= 0) {
-          ostringstream err;
-          if (e == 0) {
-              err << "IPv4 address '"
-                  << addr
-                  << "' not in presentation format!";
-          } else {
-              err << "'"
-                  << addr
-                  << "' is not a valid IPv4 address!";
-          }
-          throw runtime_error(err.str());
-      }
+      const IPPrefix prefix = IPPrefix::parse(cols.at(1));
 
       uint32_t port = std::atoi(cols.at(2).c_str());
       if (port > 65535) {
@@ -90,21 +131,18 @@ ProtoRules_t parse_rules(const string & rules_file)
           if (num_cols == 9) {
               // Threshold after which reverse path delay should be switched to
               //  a different value.
-              uint64_t rev_lim = std::atol(cols.at(5).c_str());
-              uint64_t rev_alt_delay = std::atol(cols.at(6).c_str());
+              uint64_t rev_lim = std::atol(cols.at(7).c_str());
+              uint64_t rev_alt_delay = std::atol(cols.at(8).c_str());
 
-              rules[proto][ipv4][port] =
-                  DelayRule(proto, ipv4, port, fwd_delay, rev_delay,
-                            fwd_lim, fwd_alt_delay,
-                            rev_lim, rev_alt_delay);
+              rules.emplace_back(proto, prefix, port, fwd_delay, rev_delay,
+                                 fwd_lim, fwd_alt_delay,
+                                 rev_lim, rev_alt_delay);
           } else {
-              rules[proto][ipv4][port] =
-                  DelayRule(proto, ipv4, port, fwd_delay, rev_delay,
-                            fwd_lim, fwd_alt_delay);
+              rules.emplace_back(proto, prefix, port, fwd_delay, rev_delay,
+                                 fwd_lim, fwd_alt_delay);
           }
       } else {
-          rules[proto][ipv4][port] =
-              DelayRule(proto, ipv4, port, fwd_delay, rev_delay);
+          rules.emplace_back(proto, prefix, port, fwd_delay, rev_delay);
       }
 
   }
@@ -113,43 +151,31 @@ ProtoRules_t parse_rules(const string & rules_file)
 
 void show_rules(const DelayRules_t & rules)
 {
-    char ipv4[INET_ADDRSTRLEN];
-
     uint32_t rule_num = 0;
-    for (auto const &proto_rules : rules) {
-        for (auto const &ip_rules : proto_rules.second) {
-            for (auto const &port_rules : ip_rules.second) {
-                rule_num++;
-                if (inet_ntop(AF_INET, &ip_rules.first, ipv4,
-                              INET_ADDRSTRLEN) == NULL) {
-                    throw runtime_error("Invalid rule encountered!");
-                }
-
-                const uint64_t MAX_LIM = std::numeric_limits<uint64_t>::max();
-
-                const DelayRule& rule = port_rules.second;
-                cout << "#- Rule#"
-                     << setfill('0') << setw(3)
-                     << rule_num << "  "
-                     << setfill(' ') << setw(3)
-                     << unsigned(proto_rules.first) << " "
-                     << setw(15) << ipv4
-                     << "(" << setw(10) << ip_rules.first << ")" << " "
-                     << setw(5)
-                     << (port_rules.first == 0 ? "*" :
-                         to_string(port_rules.first)) << " "
-                     << setw(5) << rule.fwd_delay() << "ms "
-                     << setw(5) << rule.rev_delay() << "ms   "
-                     << "F@" << setw(10)
-                     << (rule.fwd_lim() == MAX_LIM ? "*" :
-                         to_string(rule.fwd_lim())) << " "
-                     << setw(5) << rule.fwd_alt_delay() << "ms   "
-                     << "B@" << setw(10)
-                     << (rule.rev_lim() == MAX_LIM ? "*" :
-                         to_string(rule.rev_lim())) << " "
-                     << setw(5) << rule.rev_alt_delay() << "ms "
-                     << endl;
-            }
-        }
+    for (auto const &rule : rules) {
+        rule_num++;
+
+        const uint64_t MAX_LIM = std::numeric_limits<uint64_t>::max();
+
+        cout << "#- Rule#"
+             << setfill('0') << setw(3)
+             << rule_num << "  "
+             << setfill(' ') << setw(3)
+             << unsigned(rule.proto()) << " "
+             << setw(18) << rule.prefix().str() << " "
+             << setw(5)
+             << (rule.port() == 0 ? "*" :
+                 to_string(rule.port())) << " "
+             << setw(5) << rule.fwd_delay() << "ms "
+             << setw(5) << rule.rev_delay() << "ms   "
+             << "F@" << setw(10)
+             << (rule.fwd_lim() == MAX_LIM ? "*" :
+                 to_string(rule.fwd_lim())) << " "
+             << setw(5) << rule.fwd_alt_delay() << "ms   "
+             << "B@" << setw(10)
+             << (rule.rev_lim() == MAX_LIM ? "*" :
+                 to_string(rule.rev_lim())) << " "
+             << setw(5) << rule.rev_alt_delay() << "ms "
+             << endl;
     }
 }
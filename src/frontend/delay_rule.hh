@@ -3,13 +3,36 @@
 #ifndef DELAY_RULE_HH
 #define DELAY_RULE_HH
 
+#include<cstdint>
 #include<limits>
-#include<map>
+#include<string>
+#include<vector>
+
+#include <sys/socket.h>
+
+// An IPv4 or IPv6 address, or a CIDR prefix (address/length) of one.
+struct IPPrefix
+{
+    int family;       // AF_INET or AF_INET6.
+    uint8_t addr[16]; // Network byte order; IPv4 uses the first 4 bytes.
+    uint8_t len;      // Prefix length in bits.
+
+    unsigned int max_len() const { return family == AF_INET ? 32 : 128; }
+    unsigned int addr_len() const { return max_len() / 8; }
+
+    // True, if the prefix is a single address.
+    bool is_address() const { return len == max_len(); }
+
+    std::string str() const;
+
+    // Parse "address" or "address/length" (throws on error).
+    static IPPrefix parse(const std::string & text);
+};
 
 class DelayRule
 {
     uint8_t _proto;
-    uint32_t _ip;  // NOTE: Currently, only IPv4 addresses are supported!
+    IPPrefix _prefix;
     uint16_t _port;
     uint64_t _fwd_delay;
     uint64_t _rev_delay;
@@ -19,15 +42,9 @@ class DelayRule
     uint64_t _rev_alt_delay;
 
 public:
-    DelayRule()
-        :_proto(0), _ip(0), _port(0), _fwd_delay(0), _rev_delay(0),
-         _fwd_lim(std::numeric_limits<uint64_t>::max()), _fwd_alt_delay(0),
-         _rev_lim(std::numeric_limits<uint64_t>::max()), _rev_alt_delay(0)
-    { /* -- empty -- */ }
-
-    DelayRule(uint8_t proto, uint32_t ip, uint16_t port,
+    DelayRule(uint8_t proto, const IPPrefix& prefix, uint16_t port,
               uint64_t fwd_delay, uint64_t rev_delay)
-        :_proto(proto), _ip(ip), _port(port),
+        :_proto(proto), _prefix(prefix), _port(port),
          _fwd_delay(fwd_delay), _rev_delay(rev_delay),
          _fwd_lim(std::numeric_limits<uint64_t>::max()),
          _fwd_alt_delay(fwd_delay),
@@ -35,10 +52,10 @@ public:
          _rev_alt_delay(rev_delay)
     { /* -- empty -- */ }
 
-    DelayRule(uint8_t proto, uint32_t ip, uint16_t port,
+    DelayRule(uint8_t proto, const IPPrefix& prefix, uint16_t port,
               uint64_t fwd_delay, uint64_t rev_delay,
               uint64_t fwd_lim, uint64_t fwd_alt_delay)
-        :_proto(proto), _ip(ip), _port(port),
+        :_proto(proto), _prefix(prefix), _port(port),
          _fwd_delay(fwd_delay), _rev_delay(rev_delay),
          _fwd_lim(fwd_lim),
          _fwd_alt_delay(fwd_alt_delay),
@@ -46,11 +63,11 @@ public:
          _rev_alt_delay(rev_delay)
     { /* -- empty -- */ }
 
-    DelayRule(uint8_t proto, uint32_t ip, uint16_t port,
+    DelayRule(uint8_t proto, const IPPrefix& prefix, uint16_t port,
               uint64_t fwd_delay, uint64_t rev_delay,
               uint64_t fwd_lim, uint64_t fwd_alt_delay,
               uint64_t rev_lim, uint64_t rev_alt_delay)
-        :_proto(proto), _ip(ip), _port(port),
+        :_proto(proto), _prefix(prefix), _port(port),
          _fwd_delay(fwd_delay), _rev_delay(rev_delay),
          _fwd_lim(fwd_lim),
          _fwd_alt_delay(fwd_alt_delay),
@@ -60,8 +77,8 @@ public:
 
     static const uint16_t WILDCARD_PORT = 0;
 
-    uint8_t proto() const { return _port; };
-    uint32_t ip() const { return _ip; };
+    uint8_t proto() const { return _proto; };
+    const IPPrefix& prefix() const { return _prefix; };
     uint16_t port() const { return _port; };
     uint64_t fwd_delay() const { return _fwd_delay; };
     uint64_t rev_delay() const { return _rev_delay; };
@@ -84,7 +101,7 @@ public:
  *  <proto> <IP> <port> <to-delay> <from-delay>
  *  where,
  *       <proto>: Standard protocol numbers as defined in [1].
- *          <IP>: IPv4 or IPv6 address.
+ *          <IP>: IPv4 or IPv6 address, or a CIDR prefix (address/length).
  *        <port>: port number [0, 65535]
  *    <to-delay>: delay in milliseconds on the forward path.
  *  <from-delay>: delay in milliseconds on the reverse path.
@@ -93,13 +110,17 @@ public:
  *  concerned rule, viz., ICMP.
  * If a floating-point value is specified for delays, the number will be
  *  truncated to an integer.
+ * Optional further fields give a byte count on the forward path after which
+ *  a TCP connection gets an alternate forward delay, and likewise for the
+ *  reverse path:
+ *  ... [<to-limit> <to-alt-delay> [<from-limit> <from-alt-delay>]]
+ * A packet gets the rule for the longest prefix that matches its address
+ *  (a plain address being the longest) and has a rule for its protocol and
+ *  port; a port-0 rule for a prefix applies to every port.
  *
  * [1]: http://www.iana.org/assignments/protocol-numbers/protocol-numbers.xhtml
  */
-typedef std::map<uint16_t, DelayRule> PortRules_t;
-typedef std::map<uint32_t, PortRules_t> IPRules_t;
-typedef std::map<uint8_t, IPRules_t> ProtoRules_t;
-typedef ProtoRules_t DelayRules_t;
+typedef std::vector<DelayRule> DelayRules_t;
 DelayRules_t parse_rules(const std::string & rules_file);
 
 // Print the delay rules.
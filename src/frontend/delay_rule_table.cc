@@ -0,0 +1,192 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <arpa/inet.h>
+
+#include "delay_rule_table.hh"
+
+using namespace std;
+
+DelayRuleTable::DelayRuleTable(const DelayRules_t& rules)
+    : rules_(rules), slots_(), slot_mask_(0), trie_(), prefix_rules_()
+{
+    // At most half full, so probe sequences stay short.
+    size_t capacity = 16;
+    while (capacity < 2 * rules_.size()) {
+        capacity *= 2;
+    }
+
+    Slot empty;
+    memset(&empty, 0, sizeof(empty));
+    empty.rule = NO_RULE;
+    slots_.assign(capacity, empty);
+    slot_mask_ = capacity - 1;
+
+    for (auto& trie : trie_) {
+        trie.push_back({{-1, -1}, -1});
+    }
+
+    for (size_t i = 0; i < rules_.size(); i++) {
+        if (rules_[i].prefix().is_address()) {
+            insert_address_rule(i);
+        } else {
+            insert_prefix_rule(i);
+        }
+    }
+}
+
+DelayRuleTable::Key DelayRuleTable::make_key(int family, uint8_t proto,
+                                             const uint8_t *addr, uint16_t port)
+{
+    Key key;
+    memset(&key, 0, sizeof(key));
+
+    memcpy(key.addr, addr, family == AF_INET ? 4 : 16);
+    key.port = port;
+    key.proto = proto;
+    key.family = family == AF_INET ? 4 : 6;
+
+    return key;
+}
+
+uint64_t DelayRuleTable::hash(const Key& key)
+{
+    static_assert(sizeof(Key) == 20, "Key must have no padding");
+
+    uint64_t a, b;
+    uint32_t c;
+    memcpy(&a, key.addr, 8);
+    memcpy(&b, key.addr + 8, 8);
+    memcpy(&c, &key.port, 4); // port, proto and family
+
+    // Multiply-xorshift mixing (as in MurmurHash3's finalizer).
+    uint64_t h = a * 0x9e3779b97f4a7c15ULL;
+    h ^= (b + c) * 0xc2b2ae3d27d4eb4fULL + (h >> 31);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+void DelayRuleTable::insert_address_rule(int32_t index)
+{
+    const DelayRule& rule = rules_[index];
+    const Key key = make_key(rule.prefix().family, rule.proto(),
+                             rule.prefix().addr, rule.port());
+
+    for (uint64_t i = hash(key) & slot_mask_; ; i = (i + 1) & slot_mask_) {
+        Slot& slot = slots_[i];
+        if (slot.rule == NO_RULE || memcmp(&slot.key, &key, sizeof(key)) == 0) {
+            slot.key = key;
+            slot.rule = index;
+            return;
+        }
+    }
+}
+
+void DelayRuleTable::insert_prefix_rule(int32_t index)
+{
+    const DelayRule& rule = rules_[index];
+    const IPPrefix& prefix = rule.prefix();
+    vector<TrieNode>& trie = trie_[prefix.family == AF_INET ? 0 : 1];
+
+    // Walk (and extend) the trie along the prefix's bits.
+    int32_t node = 0;
+    for (unsigned int bit = 0; bit < prefix.len; bit++) {
+        const int branch = (prefix.addr[bit / 8] >> (7 - bit % 8)) & 1;
+        if (trie[node].child[branch] == -1) {
+            trie[node].child[branch] = trie.size();
+            trie.push_back({{-1, -1}, -1});
+        }
+        node = trie[node].child[branch];
+    }
+
+    for (int32_t i = trie[node].first_rule; i != -1; i = prefix_rules_[i].next) {
+        if (prefix_rules_[i].proto == rule.proto() && prefix_rules_[i].port == rule.port()) {
+            prefix_rules_[i].rule = index;
+            return;
+        }
+    }
+
+    prefix_rules_.push_back({rule.proto(), rule.port(), index, trie[node].first_rule});
+    trie[node].first_rule = prefix_rules_.size() - 1;
+}
+
+int32_t DelayRuleTable::find_address_rule(const Key& key) const
+{
+    for (uint64_t i = hash(key) & slot_mask_; ; i = (i + 1) & slot_mask_) {
+        const Slot& slot = slots_[i];
+        if (slot.rule == NO_RULE) {
+            return NO_RULE;
+        }
+        if (memcmp(&slot.key, &key, sizeof(key)) == 0) {
+            return slot.rule;
+        }
+    }
+}
+
+int DelayRuleTable::find_prefix_rule(int family, uint8_t proto, const uint8_t *addr,
+                                     bool has_port, uint16_t port) const
+{
+    const vector<TrieNode>& trie = trie_[family == AF_INET ? 0 : 1];
+    if (trie.size() == 1) {
+        return NO_RULE; // no prefix rules for this family
+    }
+
+    // The nodes with rules on the way down, shortest prefix first.
+    int32_t matches[129];
+    unsigned int num_matches = 0;
+
+    const unsigned int max_len = family == AF_INET ? 32 : 128;
+    int32_t node = 0;
+    for (unsigned int bit = 0; node != -1; bit++) {
+        if (trie[node].first_rule != -1) {
+            matches[num_matches++] = node;
+        }
+        if (bit == max_len) {
+            break;
+        }
+        node = trie[node].child[(addr[bit / 8] >> (7 - bit % 8)) & 1];
+    }
+
+    // Longest prefix first, and at each prefix a port-0 rule first.
+    while (num_matches > 0) {
+        const int32_t first = trie[matches[--num_matches]].first_rule;
+
+        for (int32_t i = first; i != -1; i = prefix_rules_[i].next) {
+            if (prefix_rules_[i].proto == proto && prefix_rules_[i].port == DelayRule::WILDCARD_PORT) {
+                return prefix_rules_[i].rule;
+            }
+        }
+
+        if (has_port) {
+            for (int32_t i = first; i != -1; i = prefix_rules_[i].next) {
+                if (prefix_rules_[i].proto == proto && prefix_rules_[i].port == port) {
+                    return prefix_rules_[i].rule;
+                }
+            }
+        }
+    }
+
+    return NO_RULE;
+}
+
+int DelayRuleTable::lookup(int family, uint8_t proto, const uint8_t *addr,
+                           bool has_port, uint16_t port) const
+{
+    // A rule for the address itself is the longest match.
+    Key key = make_key(family, proto, addr, DelayRule::WILDCARD_PORT);
+    int32_t rule = find_address_rule(key);
+
+    if (rule == NO_RULE && has_port && port != DelayRule::WILDCARD_PORT) {
+        key.port = port;
+        rule = find_address_rule(key);
+    }
+
+    if (rule == NO_RULE) {
+        rule = find_prefix_rule(family, proto, addr, has_port, port);
+    }
+
+    return rule;
+}
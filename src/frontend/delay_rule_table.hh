@@ -0,0 +1,84 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DELAY_RULE_TABLE_HH
+#define DELAY_RULE_TABLE_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "delay_rule.hh"
+
+// Delay rules compiled for classifying packets without allocating:
+// rules for single addresses go in an open-addressing hash table keyed
+// on (family, proto, address, port), and rules for shorter prefixes in
+// a binary trie per address family, searched for the longest match.
+class DelayRuleTable
+{
+public:
+    static const int NO_RULE = -1;
+
+private:
+    struct Key
+    {
+        uint8_t addr[16];
+        uint16_t port;
+        uint8_t proto;
+        uint8_t family; // 4 or 6
+    };
+
+    struct Slot
+    {
+        Key key;
+        int32_t rule; // NO_RULE if the slot is empty
+    };
+
+    // A rule at a trie node: proto and port, and the next at the same node.
+    struct PrefixRule
+    {
+        uint8_t proto;
+        uint16_t port;
+        int32_t rule;
+        int32_t next;
+    };
+
+    struct TrieNode
+    {
+        int32_t child[2];
+        int32_t first_rule; // index into prefix_rules_, or -1
+    };
+
+    std::vector<DelayRule> rules_;
+
+    std::vector<Slot> slots_;
+    uint64_t slot_mask_;
+
+    std::vector<TrieNode> trie_[2]; // IPv4, IPv6; node 0 is the root
+    std::vector<PrefixRule> prefix_rules_;
+
+    static Key make_key(int family, uint8_t proto, const uint8_t *addr, uint16_t port);
+    static uint64_t hash(const Key& key);
+
+    void insert_address_rule(int32_t index);
+    void insert_prefix_rule(int32_t index);
+
+    int32_t find_address_rule(const Key& key) const;
+    int find_prefix_rule(int family, uint8_t proto, const uint8_t *addr,
+                         bool has_port, uint16_t port) const;
+
+public:
+    // Where two rules are for the same prefix, protocol and port,
+    // the later one wins.
+    DelayRuleTable(const DelayRules_t& rules);
+
+    // Index of the rule for a packet, or NO_RULE. addr is the packet's
+    // address (4 or 16 bytes, network order) for the family (AF_INET or
+    // AF_INET6). Without a port (not TCP or UDP), only port-0 rules match.
+    int lookup(int family, uint8_t proto, const uint8_t *addr,
+               bool has_port, uint16_t port) const;
+
+    const DelayRule& rule(int index) const { return rules_.at(index); }
+
+    size_t size() const { return rules_.size(); }
+};
+
+#endif /* DELAY_RULE_TABLE_HH */
@@ -1,5 +1,7 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
+#include <getopt.h>
+
 #include <vector>
 #include <string>
 
@@ -10,6 +12,11 @@
 
 using namespace std;
 
+void usage_error( const string & program_name )
+{
+    throw runtime_error( "Usage: " + program_name + " [--jitter=CDF-FILE [--reorder]] delay-milliseconds [command...]" );
+}
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -19,28 +26,70 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " delay-milliseconds [command...]" );
+        const option command_line_options[] = {
+            { "jitter",  required_argument, nullptr, 'j' },
+            { "reorder",       no_argument, nullptr, 'r' },
+            { 0,                         0, nullptr, 0 }
+        };
+
+        string jitter_filename;
+        bool reorder = false;
+
+        while ( true ) {
+            /* (stop at the delay, so options to the command are left alone) */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'j':
+                jitter_filename = optarg;
+                break;
+            case 'r':
+                reorder = true;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind >= argc or ( reorder and jitter_filename.empty() ) ) {
+            usage_error( argv[ 0 ] );
         }
 
-        const uint64_t delay_ms = myatoi( argv[ 1 ] );
+        /* fractional milliseconds (down to a nanosecond) are allowed */
+        const string delay_ms = argv[ optind ];
+        const uint64_t delay_ns = myatoms_ns( delay_ms );
 
         vector< string > command;
 
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
         PacketShell<DelayQueue> delay_shell_app( "delay", user_environment );
 
-        delay_shell_app.start_uplink( "[delay " + to_string( delay_ms ) + " ms] ",
-                                      command,
-                                      delay_ms );
-        delay_shell_app.start_downlink( delay_ms );
+        if ( jitter_filename.empty() ) {
+            delay_shell_app.start_uplink( "[delay " + delay_ms + " ms] ",
+                                          command,
+                                          delay_ns );
+            delay_shell_app.start_downlink( delay_ns );
+        } else {
+            /* each direction draws its own jitter */
+            delay_shell_app.start_uplink( "[delay " + delay_ms + " ms + jitter"
+                                          + ( reorder ? ", reordering] " : "] " ),
+                                          command,
+                                          delay_ns, jitter_filename, reorder );
+            delay_shell_app.start_downlink( delay_ns, jitter_filename, reorder );
+        }
         return delay_shell_app.wait_for_exit();
     } catch ( const exception & e ) {
         print_exception( e );
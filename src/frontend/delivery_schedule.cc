@@ -0,0 +1,21 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "delivery_schedule.hh"
+#include "mapped_file.hh"
+
+using namespace std;
+
+unique_ptr<DeliverySchedule> DeliverySchedule::load( const string & filename )
+{
+    const MappedFile file( filename );
+
+    if ( not CompiledTrace::is_compiled( file.data(), file.size() )
+         and RateTrace::is_rate_trace( file.data(), file.size() ) ) {
+        /* opportunities are worked out from the rates as needed */
+        unique_ptr<RateTrace> trace( new RateTrace( file.data(), file.size(), filename ) );
+        return unique_ptr<DeliverySchedule>( new TraceSchedule<RateTrace>( move( trace ) ) );
+    }
+
+    unique_ptr<CompiledTrace> trace( new CompiledTrace( filename ) );
+    return unique_ptr<DeliverySchedule>( new TraceSchedule<CompiledTrace>( move( trace ) ) );
+}
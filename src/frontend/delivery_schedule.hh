@@ -0,0 +1,56 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef DELIVERY_SCHEDULE_HH
+#define DELIVERY_SCHEDULE_HH
+
+#include <memory>
+#include <string>
+#include <cstdint>
+
+#include "compiled_trace.hh"
+#include "rate_trace.hh"
+
+/* the delivery opportunities of a link, from either kind of trace */
+class DeliverySchedule
+{
+public:
+    /* time of the current opportunity (ns from start of trace) */
+    virtual uint64_t time( void ) const = 0;
+
+    /* move to the next opportunity; returns false on wrapping around to the first */
+    virtual bool advance( void ) = 0;
+
+    /* move past every opportunity at or before time t, stopping early
+       at the end of the trace (setting wrapped); returns the number of
+       opportunities passed */
+    virtual uint64_t skip_through( const uint64_t t, bool & wrapped ) = 0;
+
+    /* time of the last opportunity (ns); the trace repeats with this period */
+    virtual uint64_t duration( void ) const = 0;
+
+    virtual ~DeliverySchedule() {}
+
+    /* a rate trace, or a text or compiled list of opportunities */
+    static std::unique_ptr<DeliverySchedule> load( const std::string & filename );
+};
+
+template <class TraceType>
+class TraceSchedule : public DeliverySchedule
+{
+private:
+    std::unique_ptr<TraceType> trace_;
+    typename TraceType::Cursor cursor_;
+
+public:
+    TraceSchedule( std::unique_ptr<TraceType> && trace )
+        : trace_( std::move( trace ) ),
+          cursor_( *trace_ )
+    {}
+
+    uint64_t time( void ) const override { return cursor_.time(); }
+    bool advance( void ) override { return cursor_.advance(); }
+    uint64_t skip_through( const uint64_t t, bool & wrapped ) override { return cursor_.skip_through( t, wrapped ); }
+    uint64_t duration( void ) const override { return trace_->duration(); }
+};
+
+#endif /* DELIVERY_SCHEDULE_HH */
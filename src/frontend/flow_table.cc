@@ -0,0 +1,77 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <new>
+
+#include "flow_table.hh"
+
+using namespace std;
+
+static_assert(sizeof(FlowTable::Flow) == 64, "a Flow must fill one cache line");
+
+FlowTable::FlowTable()
+    : flows_(allocate(MIN_CAPACITY)), capacity_(MIN_CAPACITY), size_(0)
+{ /* -- empty -- */ }
+
+FlowTable::Flow *FlowTable::allocate(size_t capacity)
+{
+    void *p;
+    if (posix_memalign(&p, 64, capacity * sizeof(Flow)) != 0) {
+        throw bad_alloc();
+    }
+    memset(p, 0, capacity * sizeof(Flow));
+
+    return static_cast<Flow *>(p);
+}
+
+FlowTable::Flow& FlowTable::find_slot(const FlowKey& key)
+{
+    for (uint64_t i = key.hash() & (capacity_ - 1); ; i = (i + 1) & (capacity_ - 1)) {
+        Flow& flow = flows_[i];
+        if (flow.key.family == 0 || memcmp(&flow.key, &key, sizeof(key)) == 0) {
+            return flow;
+        }
+    }
+}
+
+void FlowTable::rebuild(size_t capacity, bool sweeping)
+{
+    unique_ptr<Flow[], FreeDeleter> old(allocate(capacity));
+    swap(old, flows_);
+    const size_t old_capacity = capacity_;
+    capacity_ = capacity;
+    size_ = 0;
+
+    for (size_t i = 0; i < old_capacity; i++) {
+        const Flow& flow = old[i];
+        if (flow.key.family == 0 || (sweeping && flow.packets == 0)) {
+            continue;
+        }
+
+        Flow& slot = find_slot(flow.key);
+        slot = flow;
+        if (sweeping) {
+            slot.bytes = slot.packets = 0;
+        }
+        size_++;
+    }
+}
+
+void FlowTable::add(const FlowKey& key, uint64_t bytes, uint64_t now)
+{
+    Flow *flow = &find_slot(key);
+
+    if (flow->key.family == 0) {
+        // At most half full, so probe sequences stay short.
+        if (2 * (size_ + 1) > capacity_) {
+            rebuild(2 * capacity_, false);
+            flow = &find_slot(key);
+        }
+        flow->key = key;
+        size_++;
+    }
+
+    flow->bytes += bytes;
+    flow->packets++;
+    flow->last_seen = now;
+}
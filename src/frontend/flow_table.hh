@@ -0,0 +1,80 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef FLOW_TABLE_HH
+#define FLOW_TABLE_HH
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "flow_key.hh"
+
+// Byte and packet counts per flow, in an open-addressing table with
+// linear probing. Each flow's key and counters fill one cache line.
+class FlowTable
+{
+public:
+    struct Flow
+    {
+        FlowKey key;  // family 0 marks an empty slot
+        uint64_t bytes;
+        uint64_t packets;
+        uint64_t last_seen;  // ms
+    };
+
+private:
+    static const size_t MIN_CAPACITY = 64;
+
+    struct FreeDeleter
+    {
+        void operator()(Flow *p) const { free(p); }
+    };
+
+    std::unique_ptr<Flow[], FreeDeleter> flows_;
+    size_t capacity_;  // a power of two
+    size_t size_;
+
+    // Fresh zeroed storage, aligned to cache lines.
+    static Flow *allocate(size_t capacity);
+
+    Flow& find_slot(const FlowKey& key);
+
+    // Move the flows to new storage; when sweeping, leave out the idle
+    // flows and zero the counters of the rest.
+    void rebuild(size_t capacity, bool sweeping);
+
+public:
+    FlowTable();
+
+    // Count a packet of the given size for its flow.
+    void add(const FlowKey& key, uint64_t bytes, uint64_t now);
+
+    size_t size() const { return size_; }
+
+    // Visit every flow, then drop the flows that counted nothing since
+    // the last sweep and zero the counters of the rest (so a visitor
+    // sees the counts for one interval, and flows that have ended do
+    // not take up space).
+    template <typename Visitor>
+    void sweep(Visitor visit)
+    {
+        size_t idle = 0;
+        for (size_t i = 0; i < capacity_; i++) {
+            if (flows_[i].key.family != 0) {
+                if (flows_[i].packets == 0) {
+                    idle++;
+                } else {
+                    visit(const_cast<const Flow&>(flows_[i]));
+                }
+            }
+        }
+
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < 2 * (size_ - idle)) {
+            capacity *= 2;
+        }
+        rebuild(capacity, true);
+    }
+};
+
+#endif /* FLOW_TABLE_HH */
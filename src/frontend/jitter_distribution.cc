@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+#include "jitter_distribution.hh"
+#include "exception.hh"
+#include "ezio.hh"
+#include "util.hh"
+
+using namespace std;
+
+JitterDistribution::JitterDistribution( const string & filename )
+{
+    assert_not_root();
+
+    ifstream file( filename );
+    if ( not file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    /* each piece's probability */
+    vector<double> probabilities;
+
+    uint64_t last_delay = 0;
+    double last_probability = 0;
+
+    string line;
+    while ( getline( file, line ) ) {
+        istringstream fields( line );
+        string delay, probability, extra;
+        if ( not ( fields >> delay ) or delay.front() == '#' ) {
+            continue;
+        }
+
+        if ( not ( fields >> probability ) or ( fields >> extra ) ) {
+            throw runtime_error( filename + ": expected \"DELAY-MS PROBABILITY\", not \"" + line + "\"" );
+        }
+
+        Piece piece;
+        piece.low = pieces_.empty() ? myatoms_ns( delay ) : last_delay;
+        piece.high = myatoms_ns( delay );
+
+        const double cumulative = myatof( probability );
+        if ( not ( cumulative >= last_probability and cumulative <= 1 ) ) {
+            throw runtime_error( filename + ": probabilities must be nondecreasing and at most 1: " + line );
+        }
+
+        if ( piece.high < last_delay ) {
+            throw runtime_error( filename + ": delays must be nondecreasing: " + line );
+        }
+
+        pieces_.push_back( piece );
+        probabilities.push_back( cumulative - last_probability );
+
+        last_delay = piece.high;
+        last_probability = cumulative;
+    }
+
+    if ( file.bad() ) {
+        throw runtime_error( filename + ": error reading" );
+    }
+
+    if ( pieces_.empty() or abs( last_probability - 1 ) > 1e-6 ) {
+        throw runtime_error( filename + ": CDF must end at probability 1" );
+    }
+
+    /* build the alias table (Vose's method): scale the probabilities so
+       they average 1, then let each piece below 1 take the rest of its
+       column from one above 1 */
+    const size_t n = pieces_.size();
+    vector<uint32_t> small, large;
+    for ( size_t i = 0; i < n; i++ ) {
+        probabilities[ i ] *= n / last_probability;
+        ( probabilities[ i ] < 1 ? small : large ).push_back( i );
+    }
+
+    while ( not small.empty() and not large.empty() ) {
+        const uint32_t s = small.back(), l = large.back();
+        small.pop_back();
+
+        pieces_[ s ].threshold = probabilities[ s ];
+        pieces_[ s ].alias = l;
+
+        probabilities[ l ] -= 1 - probabilities[ s ];
+        if ( probabilities[ l ] < 1 ) {
+            large.pop_back();
+            small.push_back( l );
+        }
+    }
+
+    /* whatever is left has probability 1, up to rounding */
+    for ( const uint32_t i : small ) {
+        pieces_[ i ].threshold = 1;
+    }
+    for ( const uint32_t i : large ) {
+        pieces_[ i ].threshold = 1;
+    }
+}
+
+uint64_t JitterDistribution::sample( default_random_engine & prng )
+{
+    const double column = uniform_( prng ) * pieces_.size();
+    const size_t index = min( size_t( column ), pieces_.size() - 1 );
+
+    const Piece & column_piece = pieces_[ index ];
+    const Piece & piece = column - index < column_piece.threshold ? column_piece : pieces_[ column_piece.alias ];
+
+    return piece.low + uint64_t( uniform_( prng ) * ( piece.high - piece.low ) );
+}
@@ -0,0 +1,43 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef JITTER_DISTRIBUTION_HH
+#define JITTER_DISTRIBUTION_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+
+/* An empirical distribution of extra delay, from a CDF file: lines of
+   "DELAY-MS PROBABILITY", the share of packets delayed by at most
+   DELAY-MS, with both columns nondecreasing and the last probability 1
+   ("#" lines are comments). The first point is a point mass at its
+   delay, and between points the delay is uniform. A sample picks one
+   of these pieces with Walker's alias method, then a delay within it,
+   in constant time however many points there are. */
+class JitterDistribution
+{
+private:
+    struct Piece
+    {
+        uint64_t low = 0, high = 0; /* ns */
+
+        /* alias method: this piece if a uniform draw in [0,1) is below
+           threshold, otherwise the piece at alias */
+        double threshold = 1;
+        uint32_t alias = 0;
+    };
+
+    std::vector<Piece> pieces_ {};
+
+    std::uniform_real_distribution<double> uniform_ { 0, 1 };
+
+public:
+    /* privileges must be dropped before this opens the file */
+    JitterDistribution( const std::string & filename );
+
+    /* extra delay for one packet (ns) */
+    uint64_t sample( std::default_random_engine & prng );
+};
+
+#endif /* JITTER_DISTRIBUTION_HH */
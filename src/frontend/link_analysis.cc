@@ -0,0 +1,287 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "link_analysis.hh"
+
+using namespace std;
+
+/* how far out of order send times may arrive (fq_codel and the like
+   can deliver an earlier send after a later one) */
+static const int64_t REORDER_WINDOW_MS = 10000;
+
+void DelayHistogram::add( const uint64_t delay, const uint64_t count )
+{
+    if ( delay >= counts_.size() ) {
+        counts_.resize( delay + 1 );
+    }
+
+    counts_[ delay ] += count;
+    total_ += count;
+}
+
+void DelayHistogram::remove( const uint64_t delay )
+{
+    if ( delay >= counts_.size() or counts_[ delay ] == 0 ) {
+        throw runtime_error( "DelayHistogram: removing a delay that was never added" );
+    }
+
+    counts_[ delay ]--;
+    total_--;
+}
+
+void DelayHistogram::add_range( const uint64_t first, const uint64_t last )
+{
+    if ( last < first ) {
+        return;
+    }
+
+    if ( last >= counts_.size() ) {
+        counts_.resize( last + 1 );
+    }
+
+    for ( uint64_t delay = first; delay <= last; delay++ ) {
+        counts_[ delay ]++;
+    }
+
+    total_ += last - first + 1;
+}
+
+void DelayHistogram::merge( const DelayHistogram & other )
+{
+    if ( other.counts_.size() > counts_.size() ) {
+        counts_.resize( other.counts_.size() );
+    }
+
+    for ( size_t delay = 0; delay < other.counts_.size(); delay++ ) {
+        counts_[ delay ] += other.counts_[ delay ];
+    }
+
+    total_ += other.total_;
+}
+
+uint64_t DelayHistogram::percentile( const double fraction ) const
+{
+    if ( total_ == 0 ) {
+        throw runtime_error( "DelayHistogram: no delays" );
+    }
+
+    const uint64_t index = min( uint64_t( fraction * total_ ), total_ - 1 );
+
+    uint64_t seen = 0;
+    for ( size_t delay = 0; delay < counts_.size(); delay++ ) {
+        seen += counts_[ delay ];
+        if ( seen > index ) {
+            return delay;
+        }
+    }
+
+    throw runtime_error( "DelayHistogram: inconsistent total" );
+}
+
+SignalDelay::SignalDelay()
+    : pending_(),
+      histogram_(),
+      started_( false ),
+      first_(),
+      last_()
+{}
+
+void SignalDelay::add( const int64_t send_time, const uint64_t delay )
+{
+    const auto inserted = pending_.emplace( send_time, delay );
+    if ( not inserted.second ) {
+        inserted.first->second = min( inserted.first->second, delay );
+    }
+
+    const int64_t newest = pending_.rbegin()->first;
+
+    while ( pending_.begin()->first < newest - REORDER_WINDOW_MS ) {
+        finalize( pending_.begin()->first, pending_.begin()->second );
+        pending_.erase( pending_.begin() );
+    }
+}
+
+void SignalDelay::finalize( const int64_t send_time, const uint64_t delay )
+{
+    if ( not started_ ) {
+        started_ = true;
+        first_ = last_ = make_pair( send_time, delay );
+        return;
+    }
+
+    if ( send_time < last_.first ) {
+        return; /* more out of order than the window allows */
+    }
+
+    if ( send_time == last_.first ) {
+        /* (only when merging: the same millisecond at the end of one stretch and the start of the next) */
+        if ( delay < last_.second ) {
+            if ( last_.first == first_.first ) {
+                first_.second = delay;
+            } else {
+                histogram_.remove( last_.second );
+                histogram_.add( delay );
+            }
+            last_.second = delay;
+        }
+        return;
+    }
+
+    /* in between sends, the signal delay counts down toward this one's */
+    histogram_.add_range( delay + 1, delay + ( send_time - last_.first - 1 ) );
+    histogram_.add( delay );
+    last_ = make_pair( send_time, delay );
+}
+
+void SignalDelay::flush( void )
+{
+    for ( const auto & x : pending_ ) {
+        finalize( x.first, x.second );
+    }
+
+    pending_.clear();
+}
+
+void SignalDelay::merge( const SignalDelay & later )
+{
+    if ( not later.started_ ) {
+        return;
+    }
+
+    if ( not started_ ) {
+        *this = later;
+        return;
+    }
+
+    finalize( later.first_.first, later.first_.second );
+    histogram_.merge( later.histogram_ );
+    last_ = max( last_, later.last_ );
+}
+
+DelayHistogram SignalDelay::histogram( void ) const
+{
+    DelayHistogram ret = histogram_;
+    if ( started_ ) {
+        ret.add( first_.second );
+    }
+    return ret;
+}
+
+LinkLogAnalysis::LinkLogAnalysis( const unsigned int ms_per_bin )
+    : ms_per_bin_( ms_per_bin ),
+      bins_(),
+      last_bin_( bins_.end() ),
+      capacity_sum_( 0 ),
+      arrival_sum_( 0 ),
+      departure_sum_( 0 ),
+      any_events_( false ),
+      first_timestamp_( 0 ),
+      last_timestamp_( 0 ),
+      delays_(),
+      signal_delay_()
+{
+    if ( ms_per_bin_ == 0 ) {
+        throw runtime_error( "LinkLogAnalysis: bin width must be positive" );
+    }
+}
+
+LinkLogAnalysis::Bin & LinkLogAnalysis::bin( const int64_t timestamp )
+{
+    if ( not any_events_ ) {
+        any_events_ = true;
+        first_timestamp_ = last_timestamp_ = timestamp;
+    }
+
+    last_timestamp_ = max( last_timestamp_, timestamp );
+
+    /* consecutive events almost always fall in the same bin */
+    const int64_t bin_number = timestamp / ms_per_bin_;
+
+    if ( last_bin_ == bins_.end() or last_bin_->first != bin_number ) {
+        last_bin_ = bins_.emplace( bin_number, Bin { 0, 0, 0 } ).first;
+    }
+
+    return last_bin_->second;
+}
+
+void LinkLogAnalysis::add_opportunity( const int64_t timestamp, const uint64_t bytes )
+{
+    bin( timestamp ).capacity += bytes * 8;
+    capacity_sum_ += bytes * 8;
+}
+
+void LinkLogAnalysis::add_arrival( const int64_t timestamp, const uint64_t bytes )
+{
+    bin( timestamp ).arrivals += bytes * 8;
+    arrival_sum_ += bytes * 8;
+}
+
+void LinkLogAnalysis::add_departure( const int64_t timestamp, const uint64_t bytes, const uint64_t delay )
+{
+    if ( timestamp - int64_t( delay ) < 0 ) {
+        throw runtime_error( "Invalid timestamp and delay: ts=" + to_string( timestamp )
+                             + ", delay=" + to_string( delay ) );
+    }
+
+    bin( timestamp ).departures += bytes * 8;
+    departure_sum_ += bytes * 8;
+
+    delays_.add( delay );
+    signal_delay_.add( timestamp - delay, delay );
+}
+
+void LinkLogAnalysis::finish( void )
+{
+    signal_delay_.flush();
+}
+
+void LinkLogAnalysis::merge( const LinkLogAnalysis & later )
+{
+    if ( later.ms_per_bin_ != ms_per_bin_ ) {
+        throw runtime_error( "LinkLogAnalysis: cannot merge different bin widths" );
+    }
+
+    if ( not later.any_events_ ) {
+        return;
+    }
+
+    for ( const auto & x : later.bins_ ) {
+        Bin & bin = bins_[ x.first ];
+        bin.capacity += x.second.capacity;
+        bin.arrivals += x.second.arrivals;
+        bin.departures += x.second.departures;
+    }
+
+    capacity_sum_ += later.capacity_sum_;
+    arrival_sum_ += later.arrival_sum_;
+    departure_sum_ += later.departure_sum_;
+
+    if ( not any_events_ ) {
+        any_events_ = true;
+        first_timestamp_ = later.first_timestamp_;
+        last_timestamp_ = later.last_timestamp_;
+    }
+
+    last_timestamp_ = max( last_timestamp_, later.last_timestamp_ );
+
+    delays_.merge( later.delays_ );
+    signal_delay_.merge( later.signal_delay_ );
+}
+
+double LinkLogAnalysis::average_capacity( void ) const
+{
+    return capacity_sum_ / duration() / 1000000.0;
+}
+
+double LinkLogAnalysis::average_ingress( void ) const
+{
+    return arrival_sum_ / duration() / 1000000.0;
+}
+
+double LinkLogAnalysis::average_throughput( void ) const
+{
+    return departure_sum_ / duration() / 1000000.0;
+}
@@ -0,0 +1,128 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_ANALYSIS_HH
+#define LINK_ANALYSIS_HH
+
+#include <vector>
+#include <map>
+#include <cstdint>
+
+/* counts of whole-millisecond delays; memory grows with the
+   largest delay, not with the number of packets */
+class DelayHistogram
+{
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+
+public:
+    DelayHistogram() : counts_(), total_( 0 ) {}
+
+    void add( const uint64_t delay, const uint64_t count = 1 );
+    void remove( const uint64_t delay );
+
+    /* each of the delays from first to last, inclusive, once */
+    void add_range( const uint64_t first, const uint64_t last );
+
+    void merge( const DelayHistogram & other );
+
+    uint64_t total( void ) const { return total_; }
+
+    /* element floor( fraction * total ) of the sorted delays */
+    uint64_t percentile( const double fraction ) const;
+};
+
+/* Signal delay at time t is the least time it takes a packet sent at
+   or after t to get through: at a millisecond when packets were sent it's
+   their smallest delay, and in between it's counted down toward the next
+   send. Send times arrive nearly in order, so only a window of recent
+   ones is kept. */
+class SignalDelay
+{
+private:
+    std::map<int64_t, uint64_t> pending_; /* send time -> least delay */
+
+    /* delays for send times after first_, up to and including last_ */
+    DelayHistogram histogram_;
+
+    bool started_;
+    std::pair<int64_t, uint64_t> first_, last_;
+
+    void finalize( const int64_t send_time, const uint64_t delay );
+
+public:
+    SignalDelay();
+
+    void add( const int64_t send_time, const uint64_t delay );
+
+    /* finalize everything still in the window */
+    void flush( void );
+
+    /* append the analysis of a later stretch of the same log (both flushed) */
+    void merge( const SignalDelay & later );
+
+    /* one delay per millisecond from the first send time to the last */
+    DelayHistogram histogram( void ) const;
+};
+
+/* single-pass statistics over an mm-link log, the same as mm-throughput-graph
+   and mm-delay-graph compute; separate stretches of a log can be analyzed in
+   parallel and merged in order */
+class LinkLogAnalysis
+{
+public:
+    struct Bin
+    {
+        uint64_t capacity, arrivals, departures; /* bits */
+    };
+
+private:
+    unsigned int ms_per_bin_;
+
+    std::map<int64_t, Bin> bins_;
+    std::map<int64_t, Bin>::iterator last_bin_;
+
+    uint64_t capacity_sum_, arrival_sum_, departure_sum_; /* bits */
+
+    bool any_events_;
+    int64_t first_timestamp_, last_timestamp_;
+
+    DelayHistogram delays_;
+    SignalDelay signal_delay_;
+
+    Bin & bin( const int64_t timestamp );
+
+public:
+    LinkLogAnalysis( const unsigned int ms_per_bin );
+
+    /* event times are ms since the log's base timestamp */
+    void add_opportunity( const int64_t timestamp, const uint64_t bytes );
+    void add_arrival( const int64_t timestamp, const uint64_t bytes );
+    void add_departure( const int64_t timestamp, const uint64_t bytes, const uint64_t delay );
+
+    /* call once the stretch of log has been read */
+    void finish( void );
+
+    void merge( const LinkLogAnalysis & later );
+
+    unsigned int ms_per_bin( void ) const { return ms_per_bin_; }
+    const std::map<int64_t, Bin> & bins( void ) const { return bins_; }
+    bool any_events( void ) const { return any_events_; }
+    double duration( void ) const { return ( last_timestamp_ - first_timestamp_ ) / 1000.0; }
+    int64_t first_timestamp( void ) const { return first_timestamp_; }
+    int64_t last_timestamp( void ) const { return last_timestamp_; }
+
+    /* Mbits/s over the whole log */
+    double average_capacity( void ) const;
+    double average_ingress( void ) const;
+    double average_throughput( void ) const;
+
+    const DelayHistogram & delays( void ) const { return delays_; }
+    DelayHistogram signal_delays( void ) const { return signal_delay_.histogram(); }
+
+    /* ban copying (last_bin_ points into bins_) */
+    LinkLogAnalysis( const LinkLogAnalysis & other ) = delete;
+    LinkLogAnalysis & operator=( const LinkLogAnalysis & other ) = delete;
+};
+
+#endif /* LINK_ANALYSIS_HH */
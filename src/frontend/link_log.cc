@@ -0,0 +1,125 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <fcntl.h>
+#include <endian.h>
+
+#include <cstring>
+#include <limits>
+
+#include "link_log.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const string LOG_MAGIC = "MMLINKB1";
+
+/* time, extra, bytes, type, padding */
+static const size_t RECORD_SIZE = 2 * sizeof( uint64_t ) + sizeof( uint32_t ) + 4;
+
+/* room for about 170,000 events between trips to the disk */
+static const size_t RING_SIZE = 1 << 22;
+
+string LinkLogRecord::to_text( void ) const
+{
+    const string ms = to_string( time / NS_PER_MS );
+
+    switch ( type ) {
+    case Type::Arrival:
+        return ms + " + " + to_string( bytes );
+    case Type::Departure:
+        /* the delay is the difference of the whole-millisecond times */
+        return ms + " - " + to_string( bytes ) + " " + to_string( time / NS_PER_MS - extra / NS_PER_MS );
+    case Type::Opportunity:
+        return ms + " # " + to_string( bytes );
+    case Type::Drop:
+        return ms + " d " + to_string( extra ) + " " + to_string( bytes );
+    case Type::Mark:
+        return ms + " m " + to_string( extra ) + " " + to_string( bytes );
+    }
+
+    throw runtime_error( "LinkLogRecord: unknown event type" );
+}
+
+BinaryLinkLogWriter::BinaryLinkLogWriter( const string & filename, const string & header )
+    : writer_( FileDescriptor( SystemCall( "open " + filename,
+                                           open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 00666 ) ) ),
+               RING_SIZE )
+{
+    if ( header.size() > numeric_limits<uint32_t>::max() ) {
+        throw runtime_error( "BinaryLinkLogWriter: header too long" );
+    }
+
+    const uint32_t header_length = htole32( header.size() );
+
+    writer_.write( LOG_MAGIC );
+    writer_.write( reinterpret_cast<const char *>( &header_length ), sizeof( header_length ) );
+    writer_.write( header );
+}
+
+void BinaryLinkLogWriter::record( const LinkLogRecord & record )
+{
+    char encoded[ RECORD_SIZE ] = {};
+
+    const uint64_t time = htole64( record.time );
+    const uint64_t extra = htole64( record.extra );
+    const uint32_t bytes = htole32( record.bytes );
+
+    memcpy( encoded, &time, sizeof( time ) );
+    memcpy( encoded + 8, &extra, sizeof( extra ) );
+    memcpy( encoded + 16, &bytes, sizeof( bytes ) );
+    encoded[ 20 ] = static_cast<char>( record.type );
+
+    writer_.write( encoded, RECORD_SIZE );
+}
+
+BinaryLinkLogReader::BinaryLinkLogReader( const string & filename )
+    : file_( filename ),
+      header_(),
+      records_offset_( 0 )
+{
+    const size_t preamble = LOG_MAGIC.size() + sizeof( uint32_t );
+
+    if ( file_.size() < preamble
+         or LOG_MAGIC.compare( 0, string::npos, file_.data(), LOG_MAGIC.size() ) != 0 ) {
+        throw runtime_error( filename + ": not a binary mm-link log" );
+    }
+
+    uint32_t header_length;
+    memcpy( &header_length, file_.data() + LOG_MAGIC.size(), sizeof( header_length ) );
+    header_length = le32toh( header_length );
+
+    if ( header_length > file_.size() - preamble ) {
+        throw runtime_error( filename + ": truncated header" );
+    }
+
+    header_.assign( file_.data() + preamble, header_length );
+    records_offset_ = preamble + header_length;
+}
+
+size_t BinaryLinkLogReader::size( void ) const
+{
+    return ( file_.size() - records_offset_ ) / RECORD_SIZE;
+}
+
+LinkLogRecord BinaryLinkLogReader::record( const size_t index ) const
+{
+    if ( index >= size() ) {
+        throw out_of_range( "BinaryLinkLogReader: no record " + to_string( index ) );
+    }
+
+    const char * const encoded = file_.data() + records_offset_ + index * RECORD_SIZE;
+
+    uint64_t time, extra;
+    uint32_t bytes;
+    memcpy( &time, encoded, sizeof( time ) );
+    memcpy( &extra, encoded + 8, sizeof( extra ) );
+    memcpy( &bytes, encoded + 16, sizeof( bytes ) );
+
+    const char type = encoded[ 20 ];
+    if ( type != '+' and type != '-' and type != '#' and type != 'd' and type != 'm' ) {
+        throw runtime_error( "BinaryLinkLogReader: invalid event type in record " + to_string( index ) );
+    }
+
+    return { static_cast<LinkLogRecord::Type>( type ), le64toh( time ), le32toh( bytes ), le64toh( extra ) };
+}
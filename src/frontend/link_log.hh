@@ -0,0 +1,59 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef LINK_LOG_HH
+#define LINK_LOG_HH
+
+#include <string>
+#include <cstdint>
+
+#include "async_writer.hh"
+#include "mapped_file.hh"
+
+/* one event in an mm-link log */
+struct LinkLogRecord
+{
+    enum class Type : char { Arrival = '+', Departure = '-', Opportunity = '#', Drop = 'd', Mark = 'm' };
+
+    Type type;
+    uint64_t time;  /* ns */
+    uint32_t bytes; /* packet size, or bytes dropped or marked */
+    uint64_t extra; /* departures: arrival time (ns); drops and marks: packets dropped or marked */
+
+    /* the line in the text log format (without the newline) */
+    std::string to_text( void ) const;
+};
+
+/* A binary log holds "MMLINKB1", the length (LE32) and text of the
+   text log's "#" header lines, then one fixed-size record per event.
+   Records are formatted on the forwarding thread but written to disk
+   by a background thread. */
+class BinaryLinkLogWriter
+{
+private:
+    AsyncWriter writer_;
+
+public:
+    BinaryLinkLogWriter( const std::string & filename, const std::string & header );
+
+    void record( const LinkLogRecord & record );
+};
+
+class BinaryLinkLogReader
+{
+private:
+    MappedFile file_;
+    std::string header_;
+    size_t records_offset_;
+
+public:
+    BinaryLinkLogReader( const std::string & filename );
+
+    const std::string & header( void ) const { return header_; }
+
+    /* number of complete records (a log cut short may end in a partial one) */
+    size_t size( void ) const;
+
+    LinkLogRecord record( const size_t index ) const;
+};
+
+#endif /* LINK_LOG_HH */
@@ -2,82 +2,64 @@
 
 #include <limits>
 #include <cassert>
+#include <sstream>
 
 #include "link_queue.hh"
 #include "timestamp.hh"
 #include "util.hh"
-#include "ezio.hh"
-#include "abstract_packet_queue.hh"
+#include "packet_queue_factory.hh"
 
 using namespace std;
 
-LinkQueue::LinkQueue( const string & link_name, const string & filename, const string & logfile,
-                      const bool repeat, const bool graph_throughput, const bool graph_delay,
-                      unique_ptr<AbstractPacketQueue> && packet_queue,
-                      const string & command_line )
-    : next_delivery_( 0 ),
-      schedule_(),
-      base_timestamp_( timestamp() ),
+/* privileges must be dropped before opening the trace */
+static unique_ptr<DeliverySchedule> load_trace( const string & filename )
+{
+    assert_not_root();
+
+    return DeliverySchedule::load( filename );
+}
+
+template <class PacketQueueType>
+LinkQueue<PacketQueueType>::LinkQueue( const string & link_name, const string & filename, const string & logfile,
+                                       const bool binary_log, const bool repeat, const bool graph_throughput, const bool graph_delay,
+                                       unique_ptr<PacketQueueType> && packet_queue,
+                                       const string & command_line, const Clock & clock )
+    : clock_( clock ),
+      next_delivery_( load_trace( filename ) ),
+      base_timestamp_( clock_.now_ns() ),
       packet_queue_( move( packet_queue ) ),
-      packet_in_transit_( "", 0 ),
+      packet_in_transit_( PacketBuffer(), 0 ),
       packet_in_transit_bytes_left_( 0 ),
       output_queue_(),
       log_(),
+      binary_log_(),
       throughput_graph_( nullptr ),
       delay_graph_( nullptr ),
       repeat_( repeat ),
       finished_( false )
 {
-    assert_not_root();
-
-    /* open filename and load schedule */
-    ifstream trace_file( filename );
-
-    if ( not trace_file.good() ) {
-        throw runtime_error( filename + ": error opening for reading" );
-    }
-
-    string line;
-
-    while ( trace_file.good() and getline( trace_file, line ) ) {
-        if ( line.empty() ) {
-            throw runtime_error( filename + ": invalid empty line" );
-        }
-
-        const uint64_t ms = myatoi( line );
-
-        if ( not schedule_.empty() ) {
-            if ( ms < schedule_.back() ) {
-                throw runtime_error( filename + ": timestamps must be monotonically nondecreasing" );
-            }
-        }
-
-        schedule_.emplace_back( ms );
-    }
-
-    if ( schedule_.empty() ) {
-        throw runtime_error( filename + ": no valid timestamps found" );
-    }
-
-    if ( schedule_.back() == 0 ) {
-        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
-    }
-
     /* open logfile if called for */
     if ( not logfile.empty() ) {
-        log_.reset( new ofstream( logfile ) );
-        if ( not log_->good() ) {
-            throw runtime_error( logfile + ": error opening for writing" );
-        }
-
-        *log_ << "# mahimahi mm-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
-        *log_ << "# command line: " << command_line << endl;
-        *log_ << "# queue: " << packet_queue_->to_string() << endl;
-        *log_ << "# init timestamp: " << initial_timestamp() << endl;
-        *log_ << "# base timestamp: " << base_timestamp_ << endl;
+        ostringstream header;
+        header << "# mahimahi mm-link (" << link_name << ") [" << filename << "] > " << logfile << endl;
+        header << "# command line: " << command_line << endl;
+        header << "# queue: " << packet_queue_->to_string() << endl;
+        header << "# init timestamp: " << initial_timestamp() << endl;
+        header << "# base timestamp: " << base_timestamp_ / NS_PER_MS << endl;
         const char * prefix = getenv( "MAHIMAHI_SHELL_PREFIX" );
         if ( prefix ) {
-            *log_ << "# mahimahi config: " << prefix << endl;
+            header << "# mahimahi config: " << prefix << endl;
+        }
+
+        if ( binary_log ) {
+            binary_log_.reset( new BinaryLinkLogWriter( logfile, header.str() ) );
+        } else {
+            log_.reset( new ofstream( logfile ) );
+            if ( not log_->good() ) {
+                throw runtime_error( logfile + ": error opening for writing" );
+            }
+
+            *log_ << header.str() << flush;
         }
     }
 
@@ -103,12 +85,21 @@ LinkQueue::LinkQueue( const string & link_name, const string & filename, const s
     }
 }
 
-void LinkQueue::record_arrival( const uint64_t arrival_time, const size_t pkt_size )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::log_event( const LinkLogRecord & record )
 {
-    /* log it */
     if ( log_ ) {
-        *log_ << arrival_time << " + " << pkt_size << endl;
+        *log_ << record.to_text() << endl;
+    } else if ( binary_log_ ) {
+        binary_log_->record( record );
     }
+}
+
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::record_arrival( const uint64_t arrival_time, const size_t pkt_size )
+{
+    /* log it */
+    log_event( { LinkLogRecord::Type::Arrival, arrival_time, uint32_t( pkt_size ), 0 } );
 
     /* meter it */
     if ( throughput_graph_ ) {
@@ -116,20 +107,25 @@ void LinkQueue::record_arrival( const uint64_t arrival_time, const size_t pkt_si
     }
 }
 
-void LinkQueue::record_drop( const uint64_t time, const size_t pkts_dropped, const size_t bytes_dropped)
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::record_drop( const uint64_t time, const size_t pkts_dropped, const size_t bytes_dropped)
 {
     /* log it */
-    if ( log_ ) {
-        *log_ << time << " d " << pkts_dropped << " " << bytes_dropped << endl;
-    }
+    log_event( { LinkLogRecord::Type::Drop, time, uint32_t( bytes_dropped ), pkts_dropped } );
+}
+
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::record_mark( const uint64_t time, const size_t pkts_marked, const size_t bytes_marked )
+{
+    /* log it */
+    log_event( { LinkLogRecord::Type::Mark, time, uint32_t( bytes_marked ), pkts_marked } );
 }
 
-void LinkQueue::record_departure_opportunity( void )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::record_departure_opportunity( void )
 {
     /* log the delivery opportunity */
-    if ( log_ ) {
-        *log_ << next_delivery_time() << " # " << PACKET_SIZE << endl;
-    }
+    log_event( { LinkLogRecord::Type::Opportunity, next_delivery_time(), PACKET_SIZE, 0 } );
 
     /* meter the delivery opportunity */
     if ( throughput_graph_ ) {
@@ -137,13 +133,12 @@ void LinkQueue::record_departure_opportunity( void )
     }    
 }
 
-void LinkQueue::record_departure( const uint64_t departure_time, const QueuedPacket & packet )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::record_departure( const uint64_t departure_time, const QueuedPacket & packet )
 {
-    /* log the delivery */
-    if ( log_ ) {
-        *log_ << departure_time << " - " << packet.contents.size()
-              << " " << departure_time - packet.arrival_time << endl;
-    }
+    /* log the delivery (the text log stays in whole milliseconds) */
+    log_event( { LinkLogRecord::Type::Departure, departure_time,
+                 uint32_t( packet.contents.size() ), packet.arrival_time } );
 
     /* meter the delivery */
     if ( throughput_graph_ ) {
@@ -151,68 +146,129 @@ void LinkQueue::record_departure( const uint64_t departure_time, const QueuedPac
     }
 
     if ( delay_graph_ ) {
-        delay_graph_->set_max_value_now( 0, departure_time - packet.arrival_time );
+        delay_graph_->set_max_value_now( 0, (departure_time - packet.arrival_time) / NS_PER_MS );
     }    
 }
 
-void LinkQueue::read_packet( const string & contents )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::read_packets( vector<PacketBuffer> & batch )
 {
-    const uint64_t now = timestamp();
-
-    if ( contents.size() > PACKET_SIZE ) {
-        throw runtime_error( "packet size is greater than maximum" );
+    for ( const auto & contents : batch ) {
+        if ( contents.size() > PACKET_SIZE ) {
+            throw runtime_error( "packet size is greater than maximum" );
+        }
     }
 
+    /* every packet in the batch arrived during the same wakeup */
+    const uint64_t now = clock_.now_ns();
+
     rationalize( now );
 
-    record_arrival( now, contents.size() );
+    for ( auto & contents : batch ) {
+        enqueue_packet( move( contents ), now );
+    }
+
+    batch.clear();
+}
+
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::enqueue_packet( PacketBuffer && contents, const uint64_t now )
+{
+    const size_t contents_size = contents.size();
+
+    record_arrival( now, contents_size );
 
     unsigned int bytes_before = packet_queue_->size_bytes();
     unsigned int packets_before = packet_queue_->size_packets();
+    const uint64_t marks_before = packet_queue_->marked_packets();
 
-    packet_queue_->enqueue( QueuedPacket( contents, now ) );
+    packet_queue_->enqueue( QueuedPacket( move( contents ), now ) );
 
     assert( packet_queue_->size_packets() <= packets_before + 1 );
-    assert( packet_queue_->size_bytes() <= bytes_before + contents.size() );
+    assert( packet_queue_->size_bytes() <= bytes_before + contents_size );
     
     unsigned int missing_packets = packets_before + 1 - packet_queue_->size_packets();
-    unsigned int missing_bytes = bytes_before + contents.size() - packet_queue_->size_bytes();
+    unsigned int missing_bytes = bytes_before + contents_size - packet_queue_->size_bytes();
     if ( missing_packets > 0 || missing_bytes > 0 ) {
         record_drop( now, missing_packets, missing_bytes );
     }
+
+    /* marked on the way in (PIE), so it was this packet */
+    if ( packet_queue_->marked_packets() != marks_before ) {
+        record_mark( now, 1, contents_size );
+    }
 }
 
-uint64_t LinkQueue::next_delivery_time( void ) const
+template <class PacketQueueType>
+uint64_t LinkQueue<PacketQueueType>::next_delivery_time( void ) const
 {
     if ( finished_ ) {
         return -1;
     } else {
-        return schedule_.at( next_delivery_ ) + base_timestamp_;
+        return next_delivery_->time() + base_timestamp_;
     }
 }
 
-void LinkQueue::use_a_delivery_opportunity( void )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::use_a_delivery_opportunity( void )
 {
     record_departure_opportunity();
 
-    next_delivery_ = (next_delivery_ + 1) % schedule_.size();
-
     /* wraparound */
-    if ( next_delivery_ == 0 ) {
+    if ( not next_delivery_->advance() ) {
         if ( repeat_ ) {
-            base_timestamp_ += schedule_.back();
+            base_timestamp_ += next_delivery_->duration();
         } else {
             finished_ = true;
         }
     }
 }
 
+template <class PacketQueueType>
+bool LinkQueue<PacketQueueType>::idle( void ) const
+{
+    return packet_in_transit_bytes_left_ == 0 and packet_queue_->empty()
+        and not log_ and not binary_log_;
+}
+
+/* pass every delivery opportunity up to now at once (nothing is waiting to use them) */
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::skip_delivery_opportunities( const uint64_t now )
+{
+    uint64_t skipped = 0;
+
+    while ( next_delivery_time() <= now ) {
+        bool wrapped;
+        skipped += next_delivery_->skip_through( now - base_timestamp_, wrapped );
+
+        if ( wrapped ) {
+            if ( repeat_ ) {
+                base_timestamp_ += next_delivery_->duration();
+            } else {
+                finished_ = true;
+            }
+        }
+    }
+
+    /* meter the delivery opportunities */
+    if ( throughput_graph_ ) {
+        throughput_graph_->add_value_now( 0, min( skipped * PACKET_SIZE, uint64_t( numeric_limits<int>::max() ) ) );
+    }
+}
+
 /* emulate the link up to the given timestamp */
 /* this function should be called before enqueueing any packets and before
    calculating the wait_time until the next event */
-void LinkQueue::rationalize( const uint64_t now )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::rationalize( const uint64_t now )
 {
     while ( next_delivery_time() <= now ) {
+        if ( idle() ) {
+            /* the rest of the opportunities would go unused */
+            skip_delivery_opportunities( now );
+            break;
+        }
+
         const uint64_t this_delivery_time = next_delivery_time();
 
         /* burn a delivery opportunity */
@@ -224,8 +280,14 @@ void LinkQueue::rationalize( const uint64_t now )
                 if ( packet_queue_->empty() ) {
                     break;
                 }
+                const uint64_t marks_before = packet_queue_->marked_packets();
                 packet_in_transit_ = packet_queue_->dequeue();
                 packet_in_transit_bytes_left_ = packet_in_transit_.contents.size();
+
+                /* marked on the way out (CoDel), so it was this packet */
+                if ( packet_queue_->marked_packets() != marks_before ) {
+                    record_mark( this_delivery_time, 1, packet_in_transit_.contents.size() );
+                }
             }
 
             assert( packet_in_transit_.arrival_time <= this_delivery_time );
@@ -252,20 +314,39 @@ void LinkQueue::rationalize( const uint64_t now )
     }
 }
 
-void LinkQueue::write_packets( FileDescriptor & fd )
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::write_packets( FileDescriptor & fd )
+{
+    while ( not output_queue_.empty() ) {
+        fd.write( output_queue_.front().data(), output_queue_.front().size() );
+        output_queue_.pop();
+    }
+}
+
+template <class PacketQueueType>
+void LinkQueue<PacketQueueType>::take_output( vector<PacketBuffer> & batch )
 {
     while ( not output_queue_.empty() ) {
-        fd.write( output_queue_.front() );
+        batch.push_back( move( output_queue_.front() ) );
         output_queue_.pop();
     }
 }
 
-unsigned int LinkQueue::wait_time( void )
+template <class PacketQueueType>
+uint64_t LinkQueue<PacketQueueType>::wait_time( void )
 {
-    const auto now = timestamp();
+    const auto now = clock_.now_ns();
 
     rationalize( now );
 
+    if ( idle() and not throughput_graph_ and not finished_ ) {
+        /* no need to wake up for each unused opportunity, just for the end of the trace */
+        const uint64_t longest_wait = numeric_limits<uint16_t>::max() * NS_PER_MS;
+        const uint64_t end_of_trace = base_timestamp_ + next_delivery_->duration();
+
+        return repeat_ ? longest_wait : min( longest_wait, end_of_trace - now );
+    }
+
     if ( next_delivery_time() <= now ) {
         return 0;
     } else {
@@ -273,7 +354,35 @@ unsigned int LinkQueue::wait_time( void )
     }
 }
 
-bool LinkQueue::pending_output( void ) const
+template <class PacketQueueType>
+size_t LinkQueue<PacketQueueType>::discard_output( void )
+{
+    const size_t ret = output_queue_.size();
+
+    while ( not output_queue_.empty() ) {
+        output_queue_.pop();
+    }
+
+    return ret;
+}
+
+template <class PacketQueueType>
+bool LinkQueue<PacketQueueType>::pending_output( void ) const
 {
     return not output_queue_.empty();
 }
+
+template <class PacketQueueType>
+bool LinkQueue<PacketQueueType>::empty( void ) const
+{
+    return output_queue_.empty() and packet_in_transit_bytes_left_ == 0 and packet_queue_->empty();
+}
+
+/* LinkQueue<> for any queue, and one for each queue type (see linkshell.cc) */
+template class LinkQueue<AbstractPacketQueue>;
+template class LinkQueue<InfinitePacketQueue>;
+template class LinkQueue<DropTailPacketQueue>;
+template class LinkQueue<DropHeadPacketQueue>;
+template class LinkQueue<CODELPacketQueue>;
+template class LinkQueue<PIEPacketQueue>;
+template class LinkQueue<FQCODELPacketQueue>;
@@ -6,28 +6,39 @@
 #include <queue>
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <fstream>
 #include <memory>
 
 #include "file_descriptor.hh"
 #include "binned_livegraph.hh"
 #include "abstract_packet_queue.hh"
-
+#include "link_log.hh"
+#include "delivery_schedule.hh"
+#include "clock.hh"
+
+/* An emulated link, draining its packet queue as the trace allows. The
+   queue type is a template parameter: as a concrete (final) queue type,
+   the calls made for every packet are direct and can be inlined, while
+   LinkQueue<> takes any queue chosen at run time. */
+template <class PacketQueueType = AbstractPacketQueue>
 class LinkQueue
 {
 private:
     const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
 
-    unsigned int next_delivery_;
-    std::vector<uint64_t> schedule_;
-    uint64_t base_timestamp_;
+    const Clock & clock_;
+
+    std::unique_ptr<DeliverySchedule> next_delivery_;
+    uint64_t base_timestamp_; /* ns */
 
-    std::unique_ptr<AbstractPacketQueue> packet_queue_;
+    std::unique_ptr<PacketQueueType> packet_queue_;
     QueuedPacket packet_in_transit_;
     unsigned int packet_in_transit_bytes_left_;
-    std::queue<std::string> output_queue_;
+    std::queue<PacketBuffer> output_queue_;
 
     std::unique_ptr<std::ofstream> log_;
+    std::unique_ptr<BinaryLinkLogWriter> binary_log_;
     std::unique_ptr<BinnedLiveGraph> throughput_graph_;
     std::unique_ptr<BinnedLiveGraph> delay_graph_;
 
@@ -37,29 +48,49 @@ private:
     uint64_t next_delivery_time( void ) const;
 
     void use_a_delivery_opportunity( void );
+    void skip_delivery_opportunities( const uint64_t now );
+
+    /* can unused opportunities go by without being recorded one at a time? */
+    bool idle( void ) const;
 
+    void log_event( const LinkLogRecord & record );
     void record_arrival( const uint64_t arrival_time, const size_t pkt_size );
     void record_drop( const uint64_t time, const size_t pkts_dropped, const size_t bytes_dropped );
+    void record_mark( const uint64_t time, const size_t pkts_marked, const size_t bytes_marked );
     void record_departure_opportunity( void );
     void record_departure( const uint64_t departure_time, const QueuedPacket & packet );
 
     void rationalize( const uint64_t now );
+    void enqueue_packet( PacketBuffer && contents, const uint64_t now );
     void dequeue_packet( void );
 
 public:
     LinkQueue( const std::string & link_name, const std::string & filename, const std::string & logfile,
-               const bool repeat, const bool graph_throughput, const bool graph_delay,
-               std::unique_ptr<AbstractPacketQueue> && packet_queue,
-               const std::string & command_line );
+               const bool binary_log, const bool repeat, const bool graph_throughput, const bool graph_delay,
+               std::unique_ptr<PacketQueueType> && packet_queue,
+               const std::string & command_line, const Clock & clock );
 
-    void read_packet( const std::string & contents );
+    /* take every packet read in one wakeup (leaves batch empty) */
+    void read_packets( std::vector<PacketBuffer> & batch );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void );
+    /* hand over the packets that are ready to leave, appending them to
+       batch (when this queue is one stage of mm-net's chain) */
+    void take_output( std::vector<PacketBuffer> & batch );
+
+    /* throw away delivered packets (when simulating, the log has all we
+       need); returns how many there were */
+    size_t discard_output( void );
+
+    /* nanoseconds until the next delivery opportunity */
+    uint64_t wait_time( void );
 
     bool pending_output( void ) const;
 
+    /* nothing queued, in transit or awaiting output */
+    bool empty( void ) const;
+
     bool finished( void ) const { return finished_; }
 };
 
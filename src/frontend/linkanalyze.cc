@@ -0,0 +1,356 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <cstring>
+#include <cstdio>
+#include <cinttypes>
+#include <iostream>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <exception>
+#include <functional>
+
+#include "link_analysis.hh"
+#include "link_log.hh"
+#include "mapped_file.hh"
+#include "timestamp.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Computes what mm-throughput-graph and mm-delay-graph report from an
+   mm-link log (text or binary), in one pass and without holding the log
+   in memory. Consecutive stretches of the log are analyzed in parallel. */
+
+void usage_error( const string & program_name )
+{
+    throw runtime_error( "Usage: " + program_name + " [--threads=N] MS_PER_BIN LOGFILE" );
+}
+
+/* one whitespace-separated field of a text log line */
+static bool next_field( const char * & pos, const char * const end,
+                        const char * & field_begin, const char * & field_end )
+{
+    while ( pos < end and ( *pos == ' ' or *pos == '\t' or *pos == '\r' ) ) {
+        pos++;
+    }
+
+    field_begin = pos;
+
+    while ( pos < end and *pos != ' ' and *pos != '\t' and *pos != '\r' ) {
+        pos++;
+    }
+
+    field_end = pos;
+
+    return field_begin != field_end;
+}
+
+static uint64_t parse_number( const char * const begin, const char * const end, const string & what )
+{
+    uint64_t ret = 0;
+
+    for ( const char * x = begin; x < end; x++ ) {
+        if ( *x < '0' or *x > '9' ) {
+            throw runtime_error( "Invalid " + what + ": " + string( begin, end ) );
+        }
+        ret = ret * 10 + ( *x - '0' );
+    }
+
+    return ret;
+}
+
+static void analyze_line( const char * pos, const char * const end,
+                          const int64_t base_timestamp, LinkLogAnalysis & analysis )
+{
+    if ( pos < end and *pos == '#' ) {
+        return;
+    }
+
+    const char * fields[ 4 ][ 2 ];
+    unsigned int field_count = 0;
+
+    while ( field_count < 4 and next_field( pos, end, fields[ field_count ][ 0 ], fields[ field_count ][ 1 ] ) ) {
+        field_count++;
+    }
+
+    if ( field_count < 3 or fields[ 1 ][ 1 ] - fields[ 1 ][ 0 ] != 1 ) {
+        throw runtime_error( "Format: timestamp event_type num_bytes [delay] (not \"" + string( fields[ 0 ][ 0 ], end ) + "\")" );
+    }
+
+    const int64_t timestamp = parse_number( fields[ 0 ][ 0 ], fields[ 0 ][ 1 ], "timestamp" ) - base_timestamp;
+
+    switch ( *fields[ 1 ][ 0 ] ) {
+    case '#':
+        analysis.add_opportunity( timestamp, parse_number( fields[ 2 ][ 0 ], fields[ 2 ][ 1 ], "byte count" ) );
+        break;
+    case '+':
+        analysis.add_arrival( timestamp, parse_number( fields[ 2 ][ 0 ], fields[ 2 ][ 1 ], "byte count" ) );
+        break;
+    case '-':
+        if ( field_count < 4 ) {
+            throw runtime_error( "Departure format: timestamp - num_bytes delay" );
+        }
+        analysis.add_departure( timestamp, parse_number( fields[ 2 ][ 0 ], fields[ 2 ][ 1 ], "byte count" ),
+                                parse_number( fields[ 3 ][ 0 ], fields[ 3 ][ 1 ], "delay" ) );
+        break;
+    case 'd':
+    case 'm':
+        break; /* drops and ECN marks don't enter into these statistics */
+    default:
+        throw runtime_error( "Unknown event type: " + string( fields[ 1 ][ 0 ], fields[ 1 ][ 1 ] ) );
+    }
+}
+
+/* the base timestamp from a log's "#" header lines */
+static int64_t base_timestamp( const char * pos, const char * const end )
+{
+    const string prefix = "# base timestamp: ";
+
+    while ( pos < end and *pos == '#' ) {
+        const char * eol = static_cast<const char *>( memchr( pos, '\n', end - pos ) );
+        if ( not eol ) {
+            eol = end;
+        }
+
+        if ( size_t( eol - pos ) > prefix.size() and prefix.compare( 0, string::npos, pos, prefix.size() ) == 0 ) {
+            return parse_number( pos + prefix.size(), eol, "base timestamp" );
+        }
+
+        pos = eol + 1;
+    }
+
+    throw runtime_error( "logfile is missing base timestamp" );
+}
+
+/* start of the line containing (or starting at) pos */
+static const char * line_start( const char * const begin, const char * pos )
+{
+    while ( pos > begin and *( pos - 1 ) != '\n' ) {
+        pos--;
+    }
+    return pos;
+}
+
+static void run_shards( const size_t shard_count, const function<void(size_t)> & analyze_shard )
+{
+    vector<exception_ptr> errors( shard_count );
+    vector<thread> threads;
+
+    for ( size_t i = 0; i < shard_count; i++ ) {
+        threads.emplace_back( [&, i] () {
+                try {
+                    analyze_shard( i );
+                } catch ( ... ) {
+                    errors.at( i ) = current_exception();
+                } } );
+    }
+
+    for ( auto & x : threads ) {
+        x.join();
+    }
+
+    for ( const auto & x : errors ) {
+        if ( x ) {
+            rethrow_exception( x );
+        }
+    }
+}
+
+static void analyze_text_log( const string & filename, vector< unique_ptr<LinkLogAnalysis> > & shards )
+{
+    const MappedFile file( filename );
+    const char * const begin = file.data();
+    const char * const end = begin + file.size();
+
+    const int64_t base = base_timestamp( begin, end );
+
+    /* split at line boundaries into roughly equal stretches */
+    vector<const char *> boundaries;
+    for ( size_t i = 0; i < shards.size(); i++ ) {
+        boundaries.push_back( line_start( begin, begin + file.size() * i / shards.size() ) );
+    }
+    boundaries.push_back( end );
+
+    run_shards( shards.size(), [&] ( const size_t i ) {
+            const char * pos = boundaries.at( i );
+            while ( pos < boundaries.at( i + 1 ) ) {
+                const char * eol = static_cast<const char *>( memchr( pos, '\n', end - pos ) );
+                if ( not eol ) {
+                    eol = end;
+                }
+
+                analyze_line( pos, eol, base, *shards.at( i ) );
+                pos = eol + 1;
+            }
+
+            shards.at( i )->finish();
+        } );
+}
+
+static void analyze_binary_log( const string & filename, vector< unique_ptr<LinkLogAnalysis> > & shards )
+{
+    const BinaryLinkLogReader log( filename );
+
+    const string & header = log.header();
+    const int64_t base = base_timestamp( header.data(), header.data() + header.size() );
+
+    run_shards( shards.size(), [&] ( const size_t i ) {
+            const size_t first = log.size() * i / shards.size();
+            const size_t last = log.size() * ( i + 1 ) / shards.size();
+
+            LinkLogAnalysis & analysis = *shards.at( i );
+
+            for ( size_t j = first; j < last; j++ ) {
+                const LinkLogRecord record = log.record( j );
+                const int64_t timestamp = record.time / NS_PER_MS - base;
+
+                switch ( record.type ) {
+                case LinkLogRecord::Type::Opportunity:
+                    analysis.add_opportunity( timestamp, record.bytes );
+                    break;
+                case LinkLogRecord::Type::Arrival:
+                    analysis.add_arrival( timestamp, record.bytes );
+                    break;
+                case LinkLogRecord::Type::Departure:
+                    analysis.add_departure( timestamp, record.bytes, record.time / NS_PER_MS - record.extra / NS_PER_MS );
+                    break;
+                case LinkLogRecord::Type::Drop:
+                case LinkLogRecord::Type::Mark:
+                    break;
+                }
+            }
+
+            analysis.finish();
+        } );
+}
+
+static bool is_binary_log( const string & filename )
+{
+    const MappedFile file( filename );
+    const string magic = "MMLINKB1";
+    return file.size() >= magic.size() and magic.compare( 0, string::npos, file.data(), magic.size() ) == 0;
+}
+
+static void print_results( const LinkLogAnalysis & analysis )
+{
+    if ( not analysis.any_events() ) {
+        throw runtime_error( "Must have at least one event" );
+    }
+
+    if ( analysis.delays().total() == 0 ) {
+        throw runtime_error( "Must have at least one departure event" );
+    }
+
+    if ( analysis.duration() <= 0 ) {
+        throw runtime_error( "Events must span a nonzero amount of time" );
+    }
+
+    const DelayHistogram signal_delays = analysis.signal_delays();
+
+    fprintf( stderr, "Average capacity: %.2f Mbits/s\n", analysis.average_capacity() );
+    fprintf( stderr, "Average throughput: %.2f Mbits/s (%.1f%% utilization)\n",
+             analysis.average_throughput(), 100.0 * analysis.average_throughput() / analysis.average_capacity() );
+    fprintf( stderr, "Average ingress: %.2f Mbits/s\n", analysis.average_ingress() );
+    fprintf( stderr, "50th percentile per-packet queueing delay: %" PRIu64 " ms\n", analysis.delays().percentile( 0.5 ) );
+    fprintf( stderr, "95th percentile per-packet queueing delay: %" PRIu64 " ms\n", analysis.delays().percentile( 0.95 ) );
+    fprintf( stderr, "99th percentile per-packet queueing delay: %" PRIu64 " ms\n", analysis.delays().percentile( 0.99 ) );
+    fprintf( stderr, "95th percentile signal delay: %" PRIu64 " ms\n", signal_delays.percentile( 0.95 ) );
+
+    /* per-bin series, as mm-throughput-graph plots it:
+       time (s), capacity, ingress and egress (Mbits/s), bits in queue */
+    const auto & bins = analysis.bins();
+    const int64_t earliest_bin = bins.begin()->first, latest_bin = bins.rbegin()->first;
+
+    if ( earliest_bin == latest_bin ) {
+        throw runtime_error( "MS_PER_BIN is too large for length of trace" );
+    }
+
+    const double seconds_per_bin = analysis.ms_per_bin() / 1000.0;
+    int64_t buffer_occupancy = 0;
+    auto next = bins.begin();
+
+    for ( int64_t bin = earliest_bin; bin <= latest_bin; bin++ ) {
+        LinkLogAnalysis::Bin totals { 0, 0, 0 };
+        if ( next->first == bin ) {
+            totals = next->second;
+            ++next;
+        }
+
+        buffer_occupancy += totals.arrivals;
+        buffer_occupancy -= totals.departures;
+
+        printf( "%.3f %.15g %.15g %.15g %" PRId64 "\n",
+                bin * seconds_per_bin,
+                totals.capacity / seconds_per_bin / 1000000.0,
+                totals.arrivals / seconds_per_bin / 1000000.0,
+                totals.departures / seconds_per_bin / 1000000.0,
+                buffer_occupancy );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        const option command_line_options[] = {
+            { "threads", required_argument, nullptr, 't' },
+            { 0,                          0, nullptr, 0 }
+        };
+
+        unsigned int thread_count = max( 1u, thread::hardware_concurrency() );
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "t:", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 't':
+                thread_count = myatoi( optarg );
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 2 != argc or thread_count == 0 ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const int ms_per_bin = myatoi( argv[ optind ] );
+        const string filename = argv[ optind + 1 ];
+
+        if ( ms_per_bin <= 0 ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        vector< unique_ptr<LinkLogAnalysis> > shards;
+        for ( unsigned int i = 0; i < thread_count; i++ ) {
+            shards.emplace_back( new LinkLogAnalysis( ms_per_bin ) );
+        }
+
+        if ( is_binary_log( filename ) ) {
+            analyze_binary_log( filename, shards );
+        } else {
+            analyze_text_log( filename, shards );
+        }
+
+        for ( size_t i = 1; i < shards.size(); i++ ) {
+            shards.front()->merge( *shards.at( i ) );
+        }
+
+        print_results( *shards.front() );
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
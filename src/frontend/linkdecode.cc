@@ -0,0 +1,34 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <iostream>
+
+#include "link_log.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* print a binary mm-link log (from --binary-log) in the text log format */
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 2 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " BINARY_LOG" );
+        }
+
+        const BinaryLinkLogReader log( argv[ 1 ] );
+
+        cout << log.header();
+
+        for ( size_t i = 0; i < log.size(); i++ ) {
+            cout << log.record( i ).to_text() << "\n";
+        }
+
+        cout << flush;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
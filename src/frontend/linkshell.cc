@@ -1,12 +1,9 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <getopt.h>
+#include <array>
 
-#include "infinite_packet_queue.hh"
-#include "drop_tail_packet_queue.hh"
-#include "drop_head_packet_queue.hh"
-#include "codel_packet_queue.hh"
-#include "pie_packet_queue.hh"
+#include "packet_queue_factory.hh"
 #include "link_queue.hh"
 #include "packetshell.cc"
 
@@ -18,39 +15,33 @@ void usage_error( const string & program_name )
     cerr << endl;
     cerr << "Options = --once" << endl;
     cerr << "          --uplink-log=FILENAME --downlink-log=FILENAME" << endl;
+    cerr << "          --binary-log (write logs in binary; decode with mm-link-decode)" << endl;
     cerr << "          --meter-uplink --meter-uplink-delay" << endl;
     cerr << "          --meter-downlink --meter-downlink-delay" << endl;
     cerr << "          --meter-all" << endl;
     cerr << "          --uplink-queue=QUEUE_TYPE --downlink-queue=QUEUE_TYPE" << endl;
     cerr << "          --uplink-queue-args=QUEUE_ARGS --downlink-queue-args=QUEUE_ARGS" << endl;
     cerr << endl;
-    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie" << endl;
+    cerr << "          QUEUE_TYPE = infinite | droptail | drophead | codel | pie | fq_codel" << endl;
     cerr << "          QUEUE_ARGS = \"NAME=NUMBER[, NAME2=NUMBER2, ...]\"" << endl;
-    cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst)" << endl;
-    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second" << endl << endl;
+    cerr << "              (with NAME = bytes | packets | target | interval | qdelay_ref | max_burst | flows | quantum | ecn)" << endl;
+    cerr << "                  target, interval, qdelay_ref, max_burst are in milli-second; quantum is in bytes" << endl;
+    cerr << "                  ecn=1 makes codel, pie and fq_codel mark ECN-capable packets instead of dropping them" << endl << endl;
 
     throw runtime_error( "invalid arguments" );
 }
 
-unique_ptr<AbstractPacketQueue> get_packet_queue( const string & type, const string & args, const string & program_name )
+/* the queue type's position in PacketQueueTypes */
+unsigned int get_packet_queue_type( const string & type, const string & program_name )
 {
-    if ( type == "infinite" ) {
-        return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( args ) );
-    } else if ( type == "droptail" ) {
-        return unique_ptr<AbstractPacketQueue>( new DropTailPacketQueue( args ) );
-    } else if ( type == "drophead" ) {
-        return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) );
-    } else if ( type == "codel" ) {
-        return unique_ptr<AbstractPacketQueue>( new CODELPacketQueue( args ) );
-    } else if ( type == "pie" ) {
-        return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args ) );
-    } else {
+    const int ret = packet_queue_type_index( type );
+
+    if ( ret < 0 ) {
         cerr << "Unknown queue type: " << type << endl;
+        usage_error( program_name );
     }
 
-    usage_error( program_name );
-
-    return nullptr;
+    return ret;
 }
 
 string shell_quote( const string & arg )
@@ -68,6 +59,62 @@ string shell_quote( const string & arg )
     return ret;
 }
 
+struct LinkShellOptions
+{
+    char ** user_environment;
+    vector<string> command;
+    string command_line;
+    bool binary_log, repeat;
+    string uplink_filename, uplink_logfile, uplink_queue_args;
+    string downlink_filename, downlink_logfile, downlink_queue_args;
+    bool meter_uplink, meter_uplink_delay, meter_downlink, meter_downlink_delay;
+};
+
+/* run the shell with each direction's LinkQueue compiled for its queue type */
+template <class UplinkQueueType, class DownlinkQueueType>
+int run_link_shell( const LinkShellOptions & options )
+{
+    PacketShell< LinkQueue<UplinkQueueType>, LinkQueue<DownlinkQueueType> > link_shell_app( "link", options.user_environment );
+
+    link_shell_app.start_uplink( "[link] ", options.command,
+                                 "Uplink", options.uplink_filename, options.uplink_logfile, options.binary_log, options.repeat,
+                                 options.meter_uplink, options.meter_uplink_delay,
+                                 make_packet_queue_of_type<UplinkQueueType>( options.uplink_queue_args, system_clock() ),
+                                 options.command_line, system_clock() );
+
+    link_shell_app.start_downlink( "Downlink", options.downlink_filename, options.downlink_logfile, options.binary_log, options.repeat,
+                                   options.meter_downlink, options.meter_downlink_delay,
+                                   make_packet_queue_of_type<DownlinkQueueType>( options.downlink_queue_args, system_clock() ),
+                                   options.command_line, system_clock() );
+
+    return link_shell_app.wait_for_exit();
+}
+
+typedef int (*LinkShellRunner)( const LinkShellOptions & options );
+
+/* run_link_shell for every pair of queue types, built at compile time:
+   table()[ uplink ][ downlink ], indexed as in PacketQueueTypes */
+template <class TypeList>
+struct LinkShellRunners;
+
+template <class... QueueTypes>
+struct LinkShellRunners< PacketQueueTypeList<QueueTypes...> >
+{
+    typedef array<LinkShellRunner, sizeof...( QueueTypes )> Row;
+    typedef array<Row, sizeof...( QueueTypes )> Table;
+
+    template <class UplinkQueueType>
+    static constexpr Row row( void )
+    {
+        return Row { { run_link_shell<UplinkQueueType, QueueTypes>... } };
+    }
+
+    static constexpr Table table( void )
+    {
+        return Table { { row<QueueTypes>()... } };
+    }
+};
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -81,7 +128,11 @@ int main( int argc, char *argv[] )
             usage_error( argv[ 0 ] );
         }
 
-        string command_line { shell_quote( argv[ 0 ] ) }; /* for the log file */
+        LinkShellOptions options {};
+        options.user_environment = user_environment;
+
+        string & command_line = options.command_line;
+        command_line = shell_quote( argv[ 0 ] ); /* for the log file */
         for ( int i = 1; i < argc; i++ ) {
             command_line += string( " " ) + shell_quote( argv[ i ] );
         }
@@ -89,6 +140,7 @@ int main( int argc, char *argv[] )
         const option command_line_options[] = {
             { "uplink-log",           required_argument, nullptr, 'u' },
             { "downlink-log",         required_argument, nullptr, 'd' },
+            { "binary-log",                 no_argument, nullptr, 'l' },
             { "once",                       no_argument, nullptr, 'o' },
             { "meter-uplink",               no_argument, nullptr, 'm' },
             { "meter-downlink",             no_argument, nullptr, 'n' },
@@ -102,12 +154,8 @@ int main( int argc, char *argv[] )
             { 0,                                      0, nullptr, 0 }
         };
 
-        string uplink_logfile, downlink_logfile;
-        bool repeat = true;
-        bool meter_uplink = false, meter_downlink = false;
-        bool meter_uplink_delay = false, meter_downlink_delay = false;
-        string uplink_queue_type = "infinite", downlink_queue_type = "infinite",
-               uplink_queue_args, downlink_queue_args;
+        options.repeat = true;
+        string uplink_queue_type = "infinite", downlink_queue_type = "infinite";
 
         while ( true ) {
             const int opt = getopt_long( argc, argv, "u:d:", command_line_options, nullptr );
@@ -117,29 +165,32 @@ int main( int argc, char *argv[] )
 
             switch ( opt ) {
             case 'u':
-                uplink_logfile = optarg;
+                options.uplink_logfile = optarg;
                 break;
             case 'd':
-                downlink_logfile = optarg;
+                options.downlink_logfile = optarg;
+                break;
+            case 'l':
+                options.binary_log = true;
                 break;
             case 'o':
-                repeat = false;
+                options.repeat = false;
                 break;
             case 'm':
-                meter_uplink = true;
+                options.meter_uplink = true;
                 break;
             case 'n':
-                meter_downlink = true;
+                options.meter_downlink = true;
                 break;
             case 'x':
-                meter_uplink_delay = true;
+                options.meter_uplink_delay = true;
                 break;
             case 'y':
-                meter_downlink_delay = true;
+                options.meter_downlink_delay = true;
                 break;
             case 'z':
-                meter_uplink = meter_downlink
-                    = meter_uplink_delay = meter_downlink_delay
+                options.meter_uplink = options.meter_downlink
+                    = options.meter_uplink_delay = options.meter_downlink_delay
                     = true;
                 break;
             case 'q':
@@ -149,10 +200,10 @@ int main( int argc, char *argv[] )
                 downlink_queue_type = optarg;
                 break;
             case 'a':
-                uplink_queue_args = optarg;
+                options.uplink_queue_args = optarg;
                 break;
             case 'b':
-                downlink_queue_args = optarg;
+                options.downlink_queue_args = optarg;
                 break;
             case '?':
                 usage_error( argv[ 0 ] );
@@ -166,31 +217,23 @@ int main( int argc, char *argv[] )
             usage_error( argv[ 0 ] );
         }
 
-        const string uplink_filename = argv[ optind ];
-        const string downlink_filename = argv[ optind + 1 ];
-
-        vector<string> command;
+        options.uplink_filename = argv[ optind ];
+        options.downlink_filename = argv[ optind + 1 ];
 
         if ( optind + 2 == argc ) {
-            command.push_back( shell_path() );
+            options.command.push_back( shell_path() );
         } else {
             for ( int i = optind + 2; i < argc; i++ ) {
-                command.push_back( argv[ i ] );
+                options.command.push_back( argv[ i ] );
             }
         }
 
-        PacketShell<LinkQueue> link_shell_app( "link", user_environment );
-
-        link_shell_app.start_uplink( "[link] ", command,
-                                     "Uplink", uplink_filename, uplink_logfile, repeat, meter_uplink, meter_uplink_delay,
-                                     get_packet_queue( uplink_queue_type, uplink_queue_args, argv[ 0 ] ),
-                                     command_line );
+        const unsigned int uplink_queue = get_packet_queue_type( uplink_queue_type, argv[ 0 ] );
+        const unsigned int downlink_queue = get_packet_queue_type( downlink_queue_type, argv[ 0 ] );
 
-        link_shell_app.start_downlink( "Downlink", downlink_filename, downlink_logfile, repeat, meter_downlink, meter_downlink_delay,
-                                       get_packet_queue( downlink_queue_type, downlink_queue_args, argv[ 0 ] ),
-                                       command_line );
+        static constexpr auto runners = LinkShellRunners<PacketQueueTypes>::table();
 
-        return link_shell_app.wait_for_exit();
+        return runners.at( uplink_queue ).at( downlink_queue )( options );
     } catch ( const exception & e ) {
         print_exception( e );
         return EXIT_FAILURE;
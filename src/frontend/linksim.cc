@@ -0,0 +1,150 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+
+#include <iostream>
+#include <vector>
+
+#include "link_queue.hh"
+#include "arrival_trace.hh"
+#include "packet_queue_factory.hh"
+#include "packet_buffer.hh"
+#include "clock.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Runs recorded packet arrivals through mm-link's link emulation on a
+   virtual clock instead of a TUN device, as fast as the CPU allows,
+   and writes the usual mm-link log. The clock jumps from one event to
+   the next, waking the link exactly when mm-link's event loop would. */
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]... TRACE ARRIVALS LOGFILE" << endl;
+    cerr << endl;
+    cerr << "Options = --once" << endl;
+    cerr << "          --binary-log (write the log in binary; decode with mm-link-decode)" << endl;
+    cerr << "          --queue=QUEUE_TYPE --queue-args=QUEUE_ARGS (as for mm-link)" << endl;
+    cerr << endl;
+    cerr << "          ARRIVALS = pcap file, or text file of \"TIME_MS SIZE\" lines" << endl << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        string command_line { argv[ 0 ] }; /* for the log file */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + argv[ i ];
+        }
+
+        const option command_line_options[] = {
+            { "once",                 no_argument, nullptr, 'o' },
+            { "binary-log",           no_argument, nullptr, 'l' },
+            { "queue",          required_argument, nullptr, 'q' },
+            { "queue-args",     required_argument, nullptr, 'a' },
+            { 0,                                0, nullptr, 0 }
+        };
+
+        bool repeat = true, binary_log = false;
+        string queue_type = "infinite", queue_args;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'o':
+                repeat = false;
+                break;
+            case 'l':
+                binary_log = true;
+                break;
+            case 'q':
+                queue_type = optarg;
+                break;
+            case 'a':
+                queue_args = optarg;
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind + 3 != argc ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        const string trace_filename = argv[ optind ];
+        ArrivalTrace arrivals( argv[ optind + 1 ] );
+        const string logfile = argv[ optind + 2 ];
+
+        VirtualClock clock;
+
+        /* outlives the link, which may still hold packets at the end */
+        PacketBufferPool pool;
+
+        unique_ptr<AbstractPacketQueue> packet_queue = make_packet_queue( queue_type, queue_args, clock );
+        if ( not packet_queue ) {
+            cerr << "Unknown queue type: " << queue_type << endl;
+            usage_error( argv[ 0 ] );
+        }
+
+        LinkQueue<> link( "Simulated", trace_filename, logfile, binary_log, repeat, false, false,
+                          move( packet_queue ), command_line, clock );
+
+        vector<PacketBuffer> batch;
+        uint64_t packet_count = 0;
+
+        ArrivalTrace::Arrival next_arrival;
+        bool more_arrivals = arrivals.next( next_arrival );
+
+        /* until every packet has left (or the trace has run out) */
+        while ( more_arrivals or not link.empty() ) {
+            const uint64_t wait = link.wait_time();
+            link.discard_output();
+
+            if ( link.finished() ) {
+                break;
+            }
+
+            const uint64_t wakeup = clock.now_ns() + wait;
+
+            if ( not more_arrivals or next_arrival.time > wakeup ) {
+                clock.advance_to( wakeup );
+                continue;
+            }
+
+            /* packets that arrive at the same instant are read in one batch */
+            const uint64_t now = next_arrival.time;
+            clock.advance_to( now );
+
+            while ( more_arrivals and next_arrival.time == now ) {
+                batch.push_back( pool.make_unfilled( next_arrival.size ) );
+                packet_count++;
+
+                more_arrivals = arrivals.next( next_arrival );
+                if ( more_arrivals and next_arrival.time < now ) {
+                    throw runtime_error( string( argv[ optind + 1 ] ) + ": arrivals must be in time order" );
+                }
+            }
+
+            link.read_packets( batch );
+        }
+
+        cerr << "Simulated " << packet_count << " packets over "
+             << clock.now_ns() / double( NS_PER_SECOND ) << " s of link time." << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,9 +1,12 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <limits>
+#include <fstream>
+#include <cctype>
 
 #include "loss_queue.hh"
 #include "timestamp.hh"
+#include "util.hh"
 
 using namespace std;
 
@@ -11,52 +14,163 @@ LossQueue::LossQueue()
     : prng_( random_device()() )
 {}
 
-void LossQueue::read_packet( const string & contents )
+void LossQueue::read_packets( vector<PacketBuffer> & batch )
 {
-    if ( not drop_packet( contents ) ) {
-        packet_queue_.emplace( contents );
+    for ( auto & contents : batch ) {
+        if ( not drop_packet( contents ) ) {
+            packet_queue_.emplace( move( contents ) );
+        }
     }
+
+    batch.clear();
 }
 
 void LossQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        fd.write( packet_queue_.front().data(), packet_queue_.front().size() );
         packet_queue_.pop();
     }
 }
 
-unsigned int LossQueue::wait_time( void )
+void LossQueue::take_output( vector<PacketBuffer> & batch )
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    while ( not packet_queue_.empty() ) {
+        batch.push_back( move( packet_queue_.front() ) );
+        packet_queue_.pop();
+    }
 }
 
-bool IIDLoss::drop_packet( const string & packet __attribute((unused)) )
+uint64_t LossQueue::wait_time( void )
 {
-    return drop_dist_( prng_ );
+    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() * NS_PER_MS : 0;
 }
 
-static const double MS_PER_SECOND = 1000.0;
+BernoulliSkipAhead::BernoulliSkipAhead( const double p )
+    : p_( p ),
+      failures_( p > 0 and p < 1 ? p : 0.5 ), /* (not used otherwise) */
+      trials_left_( 0 )
+{}
+
+bool BernoulliSkipAhead::next( default_random_engine & prng )
+{
+    if ( p_ <= 0 ) {
+        return false;
+    } else if ( p_ >= 1 ) {
+        return true;
+    }
+
+    if ( trials_left_ == 0 ) {
+        trials_left_ = failures_( prng ) + 1;
+    }
+
+    trials_left_--;
+
+    return trials_left_ == 0;
+}
+
+bool IIDLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
+{
+    return drops_.next( prng_ );
+}
+
+GilbertElliottLoss::GilbertElliottLoss( const double p, const double r,
+                                        const double good_loss_rate, const double bad_loss_rate )
+    : bad_state_( false ),
+      good_to_bad_( p ),
+      bad_to_good_( r ),
+      good_drops_( good_loss_rate ),
+      bad_drops_( bad_loss_rate )
+{}
+
+bool GilbertElliottLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
+{
+    /* each state's trials only advance while in that state (the trials
+       are memoryless, so they can pick up where they left off) */
+    const bool drop = ( bad_state_ ? bad_drops_ : good_drops_ ).next( prng_ );
+
+    if ( ( bad_state_ ? bad_to_good_ : good_to_bad_ ).next( prng_ ) ) {
+        bad_state_ = not bad_state_;
+    }
+
+    return drop;
+}
+
+/* privileges must be dropped before opening the trace */
+static vector<bool> load_losses( const string & filename )
+{
+    assert_not_root();
+
+    ifstream file( filename );
+    if ( not file.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    vector<bool> ret;
+    string line;
+    while ( getline( file, line ) ) {
+        if ( line.compare( 0, 1, "#" ) == 0 ) {
+            continue;
+        }
+
+        for ( const char ch : line ) {
+            if ( ch == '0' or ch == '1' ) {
+                ret.push_back( ch == '1' );
+            } else if ( not isspace( ch ) ) {
+                throw runtime_error( filename + ": invalid character in loss trace: " + string( 1, ch ) );
+            }
+        }
+    }
+
+    if ( file.bad() ) {
+        throw runtime_error( filename + ": error reading" );
+    }
+
+    if ( ret.empty() ) {
+        throw runtime_error( filename + ": loss trace has no packets" );
+    }
+
+    return ret;
+}
+
+TraceLoss::TraceLoss( const string & filename )
+    : losses_( load_losses( filename ) ),
+      next_packet_( 0 )
+{}
+
+bool TraceLoss::drop_packet( const PacketBuffer & packet __attribute((unused)) )
+{
+    const bool drop = losses_[ next_packet_ ];
+
+    next_packet_++;
+    if ( next_packet_ == losses_.size() ) {
+        next_packet_ = 0;
+    }
+
+    return drop;
+}
 
 SwitchingLink::SwitchingLink( const double mean_on_time, const double mean_off_time )
     : link_is_on_( false ),
-      on_process_( 1.0 / (MS_PER_SECOND * mean_off_time) ),
-      off_process_( 1.0 / (MS_PER_SECOND * mean_on_time) ),
-      next_switch_time_( timestamp() )
+      on_process_( 1.0 / (NS_PER_SECOND * mean_off_time) ),
+      off_process_( 1.0 / (NS_PER_SECOND * mean_on_time) ),
+      next_switch_time_( timestamp_ns() )
 {}
 
 uint64_t bound( const double x )
 {
-    if ( x > (1 << 30) ) {
-        return 1 << 30;
+    const uint64_t limit = uint64_t( 1 << 30 ) * NS_PER_MS;
+
+    if ( x > limit ) {
+        return limit;
     }
 
     return x;
 }
 
-unsigned int SwitchingLink::wait_time( void )
+uint64_t SwitchingLink::wait_time( void )
 {
-    const uint64_t now = timestamp();
+    const uint64_t now = timestamp_ns();
 
     while ( next_switch_time_ <= now ) {
         /* switch */
@@ -69,14 +183,14 @@ unsigned int SwitchingLink::wait_time( void )
         return 0;
     }
 
-    if ( next_switch_time_ - now > numeric_limits<uint16_t>::max() ) {
-        return numeric_limits<uint16_t>::max();
+    if ( next_switch_time_ - now > numeric_limits<uint16_t>::max() * NS_PER_MS ) {
+        return numeric_limits<uint16_t>::max() * NS_PER_MS;
     }
 
     return next_switch_time_ - now;
 }
 
-bool SwitchingLink::drop_packet( const string & packet __attribute((unused)) )
+bool SwitchingLink::drop_packet( const PacketBuffer & packet __attribute((unused)) )
 {
     return !link_is_on_;
 }
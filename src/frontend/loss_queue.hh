@@ -6,16 +6,18 @@
 #include <queue>
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <random>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
 
 class LossQueue
 {
 private:
-    std::queue<std::string> packet_queue_ {};
+    std::queue<PacketBuffer> packet_queue_ {};
 
-    virtual bool drop_packet( const std::string & packet ) = 0;
+    virtual bool drop_packet( const PacketBuffer & packet ) = 0;
 
 protected:
     std::default_random_engine prng_;
@@ -24,26 +26,90 @@ public:
     LossQueue();
     virtual ~LossQueue() {}
 
-    void read_packet( const std::string & contents );
+    /* queued packets can be moved but not copied */
+    LossQueue( LossQueue && other ) = default;
+
+    /* take every packet read in one wakeup (leaves batch empty) */
+    void read_packets( std::vector<PacketBuffer> & batch );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void );
+    /* hand over the packets that are ready to leave, appending them to
+       batch (when this queue is one stage of mm-net's chain) */
+    void take_output( std::vector<PacketBuffer> & batch );
+
+    /* nanoseconds until there is something to do */
+    uint64_t wait_time( void );
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
 
     static bool finished( void ) { return false; }
 };
 
+/* A sequence of Bernoulli trials with success probability p. Instead
+   of one draw per trial, the number of trials up to the next success
+   is drawn from a geometric distribution, so the generator is used
+   once per success. */
+class BernoulliSkipAhead
+{
+private:
+    double p_;
+    std::geometric_distribution<uint64_t> failures_;
+    uint64_t trials_left_; /* up to and including the next success; 0 if not drawn */
+
+public:
+    BernoulliSkipAhead( const double p );
+
+    /* the outcome of the next trial */
+    bool next( std::default_random_engine & prng );
+};
+
+/* each packet is lost with the same probability */
 class IIDLoss : public LossQueue
 {
 private:
-    std::bernoulli_distribution drop_dist_;
+    BernoulliSkipAhead drops_;
+
+    bool drop_packet( const PacketBuffer & packet ) override;
+
+public:
+    IIDLoss( const double loss_rate ) : drops_( loss_rate ) {}
+};
+
+/* Gilbert-Elliott burst loss: a two-state Markov chain, stepped once per
+   packet, moves from the good state to the bad one with probability p
+   and back with probability r; packets are lost with probability
+   good_loss_rate in the good state and bad_loss_rate in the bad one.
+   (With good_loss_rate = 0 and bad_loss_rate = 1, this is the simple
+   Gilbert model: bursts of losses averaging 1/r packets, and a loss
+   rate of p/(p+r).) */
+class GilbertElliottLoss : public LossQueue
+{
+private:
+    bool bad_state_;
+    BernoulliSkipAhead good_to_bad_, bad_to_good_;
+    BernoulliSkipAhead good_drops_, bad_drops_;
+
+    bool drop_packet( const PacketBuffer & packet ) override;
+
+public:
+    GilbertElliottLoss( const double p, const double r,
+                        const double good_loss_rate, const double bad_loss_rate );
+};
+
+/* losses replayed from a file: one character per packet, 1 if it is
+   lost and 0 if not, with whitespace and "#" comment lines ignored;
+   the pattern repeats when it runs out */
+class TraceLoss : public LossQueue
+{
+private:
+    std::vector<bool> losses_;
+    size_t next_packet_;
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
-    IIDLoss( const double loss_rate ) : drop_dist_( loss_rate ) {}
+    TraceLoss( const std::string & filename );
 };
 
 class SwitchingLink : public LossQueue
@@ -57,12 +123,12 @@ private:
 
     void calculate_next_switch_time( void );
 
-    bool drop_packet( const std::string & packet ) override;
+    bool drop_packet( const PacketBuffer & packet ) override;
 
 public:
     SwitchingLink( const double mean_on_time_, const double mean_off_time );
 
-    unsigned int wait_time( void );
+    uint64_t wait_time( void );
 };
 
 #endif /* LOSS_QUEUE_HH */
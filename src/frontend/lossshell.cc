@@ -15,7 +15,41 @@ using namespace std;
 
 void usage( const string & program_name )
 {
-    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]" );
+    throw runtime_error( "Usage: " + program_name + " uplink|downlink RATE [COMMAND...]\n"
+                         + "       " + program_name + " uplink|downlink ge P R GOOD-LOSS-RATE BAD-LOSS-RATE [COMMAND...]\n"
+                         + "       " + program_name + " uplink|downlink trace FILENAME [COMMAND...]" );
+}
+
+double parse_probability( const string & str, const string & program_name )
+{
+    const double ret = myatof( str );
+    if ( (0 <= ret) and (ret <= 1) ) {
+        /* do nothing */
+    } else {
+        cerr << "Error: loss rates and probabilities must be between 0 and 1." << endl;
+        usage( program_name );
+    }
+
+    return ret;
+}
+
+/* the lossy direction uses the given loss model, and the other loses nothing */
+template <class LossModel, typename... Targs>
+int run_loss_shell( char ** const user_environment, const bool uplink,
+                    const string & shell_prefix, const vector<string> & command,
+                    Targs&&... model_args )
+{
+    if ( uplink ) {
+        PacketShell<LossModel, IIDLoss> loss_app( "loss", user_environment );
+        loss_app.start_uplink( shell_prefix, command, forward<Targs>( model_args )... );
+        loss_app.start_downlink( 0.0 );
+        return loss_app.wait_for_exit();
+    } else {
+        PacketShell<IIDLoss, LossModel> loss_app( "loss", user_environment );
+        loss_app.start_uplink( shell_prefix, command, 0.0 );
+        loss_app.start_downlink( forward<Targs>( model_args )... );
+        return loss_app.wait_for_exit();
+    }
 }
 
 int main( int argc, char *argv[] )
@@ -31,51 +65,60 @@ int main( int argc, char *argv[] )
             usage( argv[ 0 ] );
         }
 
-        const double loss_rate = myatof( argv[ 2 ] );
-        if ( (0 <= loss_rate) and (loss_rate <= 1) ) {
-            /* do nothing */
-        } else {
-            cerr << "Error: loss rate must be between 0 and 1." << endl;
+        const string link = argv[ 1 ];
+        if ( link != "uplink" and link != "downlink" ) {
             usage( argv[ 0 ] );
         }
 
-        double uplink_loss = 0, downlink_loss = 0;
+        const string model = argv[ 2 ];
+        int model_args = 0;
+        if ( model == "ge" ) {
+            model_args = 4;
+        } else if ( model == "trace" ) {
+            model_args = 1;
+        }
 
-        const string link = argv[ 1 ];
-        if ( link == "uplink" ) {
-            uplink_loss = loss_rate;
-        } else if ( link == "downlink" ) {
-            downlink_loss = loss_rate;
-        } else {
+        if ( argc < 3 + model_args ) {
             usage( argv[ 0 ] );
         }
 
         vector<string> command;
 
-        if ( argc == 3 ) {
+        if ( argc == 3 + model_args ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 3; i < argc; i++ ) {
+            for ( int i = 3 + model_args; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
 
-        PacketShell<IIDLoss> loss_app( "loss", user_environment );
-
         string shell_prefix = "[loss ";
         if ( link == "uplink" ) {
             shell_prefix += "up=";
         } else {
             shell_prefix += "down=";
         }
-        shell_prefix += argv[ 2 ];
+        shell_prefix += model;
+        for ( int i = 3; i < 3 + model_args; i++ ) {
+            shell_prefix += string( i == 3 ? ":" : "," ) + argv[ i ];
+        }
         shell_prefix += "] ";
 
-        loss_app.start_uplink( shell_prefix,
-                               command,
-                               uplink_loss );
-        loss_app.start_downlink( downlink_loss );
-        return loss_app.wait_for_exit();
+        const bool uplink = link == "uplink";
+
+        if ( model == "ge" ) {
+            return run_loss_shell<GilbertElliottLoss>( user_environment, uplink, shell_prefix, command,
+                                                       parse_probability( argv[ 3 ], argv[ 0 ] ),
+                                                       parse_probability( argv[ 4 ], argv[ 0 ] ),
+                                                       parse_probability( argv[ 5 ], argv[ 0 ] ),
+                                                       parse_probability( argv[ 6 ], argv[ 0 ] ) );
+        } else if ( model == "trace" ) {
+            return run_loss_shell<TraceLoss>( user_environment, uplink, shell_prefix, command,
+                                              string( argv[ 3 ] ) );
+        } else {
+            return run_loss_shell<IIDLoss>( user_environment, uplink, shell_prefix, command,
+                                            parse_probability( model, argv[ 0 ] ) );
+        }
     } catch ( const exception & e ) {
         print_exception( e );
         return EXIT_FAILURE;
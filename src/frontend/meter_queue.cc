@@ -17,25 +17,37 @@ MeterQueue::MeterQueue( const string & name, const bool graph )
     }
 }
 
-void MeterQueue::read_packet( const string & contents )
+void MeterQueue::read_packets( vector<PacketBuffer> & batch )
 {
-    packet_queue_.emplace( contents );
+    for ( auto & contents : batch ) {
+        /* meter it */
+        if ( graph_ ) {
+            graph_->add_value_now( 0, contents.size() );
+        }
 
-    /* meter it */
-    if ( graph_ ) {
-        graph_->add_value_now( 0, contents.size() );
+        packet_queue_.emplace( move( contents ) );
     }
+
+    batch.clear();
 }
 
 void MeterQueue::write_packets( FileDescriptor & fd )
 {
     while ( not packet_queue_.empty() ) {
-        fd.write( packet_queue_.front() );
+        fd.write( packet_queue_.front().data(), packet_queue_.front().size() );
+        packet_queue_.pop();
+    }
+}
+
+void MeterQueue::take_output( vector<PacketBuffer> & batch )
+{
+    while ( not packet_queue_.empty() ) {
+        batch.push_back( move( packet_queue_.front() ) );
         packet_queue_.pop();
     }
 }
 
-unsigned int MeterQueue::wait_time( void ) const
+uint64_t MeterQueue::wait_time( void ) const
 {
-    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() : 0;
+    return packet_queue_.empty() ? numeric_limits<uint16_t>::max() * NS_PER_MS : 0;
 }
@@ -5,25 +5,33 @@
 
 #include <queue>
 #include <string>
+#include <vector>
 #include <memory>
 
 #include "file_descriptor.hh"
+#include "packet_buffer.hh"
 #include "binned_livegraph.hh"
 
 class MeterQueue
 {
 private:
-    std::queue<std::string> packet_queue_;
+    std::queue<PacketBuffer> packet_queue_;
     std::unique_ptr<BinnedLiveGraph> graph_;
 
 public:
     MeterQueue( const std::string & name, const bool graph );
 
-    void read_packet( const std::string & contents );
+    /* take every packet read in one wakeup (leaves batch empty) */
+    void read_packets( std::vector<PacketBuffer> & batch );
 
     void write_packets( FileDescriptor & fd );
 
-    unsigned int wait_time( void ) const;
+    /* hand over the packets that are ready to leave, appending them to
+       batch (when this queue is one stage of mm-net's chain) */
+    void take_output( std::vector<PacketBuffer> & batch );
+
+    /* nanoseconds until there is something to do */
+    uint64_t wait_time( void ) const;
 
     bool pending_output( void ) const { return not packet_queue_.empty(); }
 
@@ -0,0 +1,373 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include "stage_chain.hh"
+#include "delay_queue.hh"
+#include "loss_queue.hh"
+#include "link_queue.hh"
+#include "meter_queue.hh"
+#include "packet_queue_factory.hh"
+#include "util.hh"
+#include "ezio.hh"
+#include "packetshell.cc"
+
+using namespace std;
+
+/* mm-net runs a chain of the other shells' emulations (delay, loss,
+   on/off, link, meter) inside a single PacketShell, so a packet crosses
+   one pair of TUN devices however many stages there are. Stages are
+   listed outermost first, as the equivalent nested shells would be:
+   "mm-net delay 20 link UP DOWN loss uplink 0.01" behaves like
+   "mm-delay 20 mm-link UP DOWN -- mm-loss uplink 0.01". */
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " STAGE... [-- COMMAND...]" << endl;
+    cerr << endl;
+    cerr << "STAGE = delay MILLISECONDS" << endl;
+    cerr << "        loss uplink|downlink RATE" << endl;
+    cerr << "        onoff uplink|downlink MEAN_ON_SECONDS MEAN_OFF_SECONDS" << endl;
+    cerr << "        link UPLINK-TRACE DOWNLINK-TRACE [LINK-OPTION]..." << endl;
+    cerr << "        meter [--meter-uplink] [--meter-downlink]" << endl;
+    cerr << "        --config=FILENAME (stages read from a file, in the same form)" << endl;
+    cerr << endl;
+    cerr << "LINK-OPTION = any of mm-link's options, e.g. --uplink-queue=codel" << endl << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+/* one stage as written: its type, positional arguments, and --options */
+struct StageConfig
+{
+    string type {};
+    vector<string> args {};
+    vector<string> options {};
+};
+
+/* read stage words from a file, with # starting a comment */
+vector<string> read_config( const string & filename )
+{
+    /* the file is the user's, so read it as the user */
+    TemporarilyUnprivileged tu;
+
+    ifstream config { filename };
+    if ( not config.good() ) {
+        throw runtime_error( filename + ": error opening for reading" );
+    }
+
+    vector<string> ret;
+    string line;
+
+    while ( getline( config, line ) ) {
+        istringstream words { line.substr( 0, line.find( '#' ) ) };
+        string word;
+        while ( words >> word ) {
+            ret.push_back( word );
+        }
+    }
+
+    return ret;
+}
+
+vector<StageConfig> parse_stages( const vector<string> & words, const string & program_name )
+{
+    vector<StageConfig> ret;
+
+    for ( size_t i = 0; i < words.size(); ) {
+        StageConfig stage;
+        stage.type = words.at( i++ );
+
+        size_t positional_args = 0;
+        if ( stage.type == "delay" ) {
+            positional_args = 1;
+        } else if ( stage.type == "loss" ) {
+            positional_args = 2;
+        } else if ( stage.type == "onoff" ) {
+            positional_args = 3;
+        } else if ( stage.type == "link" ) {
+            positional_args = 2;
+        } else if ( stage.type == "meter" ) {
+            positional_args = 0;
+        } else {
+            cerr << "Unknown stage: " << stage.type << endl;
+            usage_error( program_name );
+        }
+
+        for ( size_t j = 0; j < positional_args; j++ ) {
+            if ( i == words.size() ) {
+                cerr << "Missing argument to " << stage.type << " stage" << endl;
+                usage_error( program_name );
+            }
+            stage.args.push_back( words.at( i++ ) );
+        }
+
+        while ( i < words.size() and words.at( i ).compare( 0, 2, "--" ) == 0 ) {
+            stage.options.push_back( words.at( i++ ) );
+        }
+
+        ret.push_back( stage );
+    }
+
+    return ret;
+}
+
+/* "--name=value" or "--name" */
+pair<string, string> split_option( const string & option )
+{
+    const size_t equals = option.find( '=' );
+    if ( equals == string::npos ) {
+        return make_pair( option, string() );
+    }
+
+    return make_pair( option.substr( 0, equals ), option.substr( equals + 1 ) );
+}
+
+double parse_rate( const string & str, const string & program_name )
+{
+    const double rate = myatof( str );
+    if ( not ( (0 <= rate) and (rate <= 1) ) ) {
+        cerr << "Error: loss rate must be between 0 and 1." << endl;
+        usage_error( program_name );
+    }
+
+    return rate;
+}
+
+bool parse_direction( const string & str, const string & program_name )
+{
+    if ( str == "uplink" ) {
+        return true;
+    } else if ( str != "downlink" ) {
+        usage_error( program_name );
+    }
+
+    return false;
+}
+
+string shell_quote( const string & arg )
+{
+    string ret = "'";
+    for ( const auto & ch : arg ) {
+        if ( ch != '\'' ) {
+            ret.push_back( ch );
+        } else {
+            ret += "'\\''";
+        }
+    }
+    ret += "'";
+
+    return ret;
+}
+
+/* the link's settings for one direction, kept until the ferry makes it */
+struct LinkConfig
+{
+    string name, trace, logfile;
+    bool binary_log, repeat, meter, meter_delay;
+    string queue_type, queue_args;
+    string command_line;
+};
+
+StageChain::StageMaker make_link_stage( const LinkConfig & link )
+{
+    return [link] () {
+        return unique_ptr<PacketStage>( new QueueStage< LinkQueue<> >(
+            link.name, link.trace, link.logfile, link.binary_log, link.repeat, link.meter, link.meter_delay,
+            make_packet_queue( link.queue_type, link.queue_args, system_clock() ),
+            link.command_line, system_clock() ) );
+    };
+}
+
+/* add a stage's emulation to each direction's chain, and describe it in the shell prefix */
+void add_stage( const StageConfig & stage, const string & command_line, const string & program_name,
+                vector<StageChain::StageMaker> & uplink, vector<StageChain::StageMaker> & downlink,
+                string & shell_prefix )
+{
+    if ( stage.type == "delay" or stage.type == "loss" or stage.type == "onoff" ) {
+        if ( not stage.options.empty() ) {
+            cerr << "Unknown " << stage.type << " option: " << stage.options.front() << endl;
+            usage_error( program_name );
+        }
+    }
+
+    if ( stage.type == "delay" ) {
+        const uint64_t delay_ns = myatoms_ns( stage.args.at( 0 ) );
+        const auto maker = [delay_ns] () { return unique_ptr<PacketStage>( new QueueStage<DelayQueue>( delay_ns ) ); };
+
+        uplink.push_back( maker );
+        downlink.push_back( maker );
+        shell_prefix += "[delay " + stage.args.at( 0 ) + " ms] ";
+    } else if ( stage.type == "loss" ) {
+        /* the other direction loses nothing, so it needs no stage */
+        const bool is_uplink = parse_direction( stage.args.at( 0 ), program_name );
+        const double loss_rate = parse_rate( stage.args.at( 1 ), program_name );
+
+        ( is_uplink ? uplink : downlink ).push_back(
+            [loss_rate] () { return unique_ptr<PacketStage>( new QueueStage<IIDLoss>( loss_rate ) ); } );
+        shell_prefix += string( "[loss " ) + ( is_uplink ? "up=" : "down=" ) + stage.args.at( 1 ) + "] ";
+    } else if ( stage.type == "onoff" ) {
+        const bool is_uplink = parse_direction( stage.args.at( 0 ), program_name );
+        const double on_time = myatof( stage.args.at( 1 ) ), off_time = myatof( stage.args.at( 2 ) );
+
+        if ( on_time < 0 or off_time < 0 or (on_time == 0 and off_time == 0) ) {
+            cerr << "Error: mean on-time and off-time must be at least 0 seconds, and not both 0." << endl;
+            usage_error( program_name );
+        }
+
+        ( is_uplink ? uplink : downlink ).push_back(
+            [on_time, off_time] () { return unique_ptr<PacketStage>( new QueueStage<SwitchingLink>( on_time, off_time ) ); } );
+        shell_prefix += string( "[onoff " ) + ( is_uplink ? "(up)" : "(down)" )
+            + " on=" + stage.args.at( 1 ) + "s off=" + stage.args.at( 2 ) + "s] ";
+    } else if ( stage.type == "link" ) {
+        LinkConfig up { "Uplink", stage.args.at( 0 ), "", false, true, false, false, "infinite", "", command_line };
+        LinkConfig down { "Downlink", stage.args.at( 1 ), "", false, true, false, false, "infinite", "", command_line };
+
+        for ( const auto & option : stage.options ) {
+            const auto name_value = split_option( option );
+            const string & name = name_value.first, & value = name_value.second;
+
+            if ( name == "--uplink-log" ) {
+                up.logfile = value;
+            } else if ( name == "--downlink-log" ) {
+                down.logfile = value;
+            } else if ( name == "--binary-log" ) {
+                up.binary_log = down.binary_log = true;
+            } else if ( name == "--once" ) {
+                up.repeat = down.repeat = false;
+            } else if ( name == "--meter-uplink" ) {
+                up.meter = true;
+            } else if ( name == "--meter-downlink" ) {
+                down.meter = true;
+            } else if ( name == "--meter-uplink-delay" ) {
+                up.meter_delay = true;
+            } else if ( name == "--meter-downlink-delay" ) {
+                down.meter_delay = true;
+            } else if ( name == "--meter-all" ) {
+                up.meter = up.meter_delay = down.meter = down.meter_delay = true;
+            } else if ( name == "--uplink-queue" ) {
+                up.queue_type = value;
+            } else if ( name == "--downlink-queue" ) {
+                down.queue_type = value;
+            } else if ( name == "--uplink-queue-args" ) {
+                up.queue_args = value;
+            } else if ( name == "--downlink-queue-args" ) {
+                down.queue_args = value;
+            } else {
+                cerr << "Unknown link option: " << option << endl;
+                usage_error( program_name );
+            }
+        }
+
+        /* catch a bad queue here rather than in the ferry */
+        for ( const auto & link : { up, down } ) {
+            if ( not make_packet_queue( link.queue_type, link.queue_args, system_clock() ) ) {
+                cerr << "Unknown queue type: " << link.queue_type << endl;
+                usage_error( program_name );
+            }
+        }
+
+        uplink.push_back( make_link_stage( up ) );
+        downlink.push_back( make_link_stage( down ) );
+        shell_prefix += "[link] ";
+    } else if ( stage.type == "meter" ) {
+        bool meter_uplink = false, meter_downlink = false;
+
+        for ( const auto & option : stage.options ) {
+            if ( option == "--meter-uplink" ) {
+                meter_uplink = true;
+            } else if ( option == "--meter-downlink" ) {
+                meter_downlink = true;
+            } else {
+                cerr << "Unknown meter option: " << option << endl;
+                usage_error( program_name );
+            }
+        }
+
+        uplink.push_back( [meter_uplink] () {
+                return unique_ptr<PacketStage>( new QueueStage<MeterQueue>( "Uplink", meter_uplink ) ); } );
+        downlink.push_back( [meter_downlink] () {
+                return unique_ptr<PacketStage>( new QueueStage<MeterQueue>( "Downlink", meter_downlink ) ); } );
+        shell_prefix += "[meter] ";
+    }
+}
+
+/* for a direction with no stages (e.g. the uplink, given only "loss downlink") */
+StageChain::StageMaker pass_through( void )
+{
+    return [] () { return unique_ptr<PacketStage>( new QueueStage<DelayQueue>( 0 ) ); };
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* clear environment while running as root */
+        char ** const user_environment = environ;
+        environ = nullptr;
+
+        check_requirements( argc, argv );
+
+        string command_line { shell_quote( argv[ 0 ] ) }; /* for link log files */
+        for ( int i = 1; i < argc; i++ ) {
+            command_line += string( " " ) + shell_quote( argv[ i ] );
+        }
+
+        /* stage words up to "--", with config files expanded in place */
+        vector<string> stage_words;
+        int i = 1;
+        for ( ; i < argc and string( argv[ i ] ) != "--"; i++ ) {
+            const string word = argv[ i ];
+            if ( word.compare( 0, 9, "--config=" ) == 0 ) {
+                const vector<string> config_words = read_config( word.substr( 9 ) );
+                stage_words.insert( stage_words.end(), config_words.begin(), config_words.end() );
+            } else {
+                stage_words.push_back( word );
+            }
+        }
+
+        vector<string> command;
+
+        if ( i + 1 >= argc ) {
+            command.push_back( shell_path() );
+        } else {
+            for ( i++; i < argc; i++ ) {
+                command.push_back( argv[ i ] );
+            }
+        }
+
+        const vector<StageConfig> stages = parse_stages( stage_words, argv[ 0 ] );
+        if ( stages.empty() ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        vector<StageChain::StageMaker> uplink_stages, downlink_stages;
+        string shell_prefix;
+
+        for ( const auto & stage : stages ) {
+            add_stage( stage, command_line, argv[ 0 ], uplink_stages, downlink_stages, shell_prefix );
+        }
+
+        /* uplink packets come from the innermost stage outward */
+        reverse( uplink_stages.begin(), uplink_stages.end() );
+
+        for ( auto direction : { &uplink_stages, &downlink_stages } ) {
+            if ( direction->empty() ) {
+                direction->push_back( pass_through() );
+            }
+        }
+
+        PacketShell<StageChain> net_shell_app( "net", user_environment );
+
+        net_shell_app.start_uplink( shell_prefix, command, uplink_stages );
+        net_shell_app.start_downlink( downlink_stages );
+        return net_shell_app.wait_for_exit();
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+}
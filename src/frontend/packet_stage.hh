@@ -0,0 +1,54 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_STAGE_HH
+#define PACKET_STAGE_HH
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+#include "file_descriptor.hh"
+#include "packet_buffer.hh"
+
+/* one stage of mm-net's chain: any of the shells' ferry queues
+   (DelayQueue, LossQueue, LinkQueue, MeterQueue) behind one interface */
+class PacketStage
+{
+public:
+    /* take every packet read in one wakeup (leaves batch empty) */
+    virtual void read_packets( std::vector<PacketBuffer> & batch ) = 0;
+
+    /* hand over the packets that are ready to leave, appending them to batch */
+    virtual void take_output( std::vector<PacketBuffer> & batch ) = 0;
+
+    virtual void write_packets( FileDescriptor & fd ) = 0;
+
+    /* nanoseconds until there is something to do */
+    virtual uint64_t wait_time( void ) = 0;
+
+    virtual bool pending_output( void ) const = 0;
+
+    virtual bool finished( void ) const = 0;
+
+    virtual ~PacketStage() {}
+};
+
+template <class QueueType>
+class QueueStage : public PacketStage
+{
+private:
+    QueueType queue_;
+
+public:
+    template <typename... Targs>
+    QueueStage( Targs&&... Fargs ) : queue_( std::forward<Targs>( Fargs )... ) {}
+
+    void read_packets( std::vector<PacketBuffer> & batch ) override { queue_.read_packets( batch ); }
+    void take_output( std::vector<PacketBuffer> & batch ) override { queue_.take_output( batch ); }
+    void write_packets( FileDescriptor & fd ) override { queue_.write_packets( fd ); }
+    uint64_t wait_time( void ) override { return queue_.wait_time(); }
+    bool pending_output( void ) const override { return queue_.pending_output(); }
+    bool finished( void ) const override { return queue_.finished(); }
+};
+
+#endif /* PACKET_STAGE_HH */
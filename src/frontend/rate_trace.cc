@@ -0,0 +1,252 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <limits>
+
+#include "rate_trace.hh"
+#include "ezio.hh"
+#include "exception.hh"
+
+using namespace std;
+
+const uint64_t RateTrace::OPPORTUNITY_BITS;
+
+/* bits * 10^9 per opportunity, in the units of rate (bits/s) times time (ns) */
+static const uint128_t OPPORTUNITY_UNITS = uint128_t( RateTrace::OPPORTUNITY_BITS ) * 1000000000;
+
+static vector<string> split_fields( const string & line )
+{
+    vector<string> ret;
+    size_t pos = 0;
+
+    while ( true ) {
+        const size_t begin = line.find_first_not_of( " \t\r", pos );
+        if ( begin == string::npos ) {
+            return ret;
+        }
+
+        pos = line.find_first_of( " \t\r", begin );
+        ret.push_back( line.substr( begin, pos - begin ) );
+    }
+}
+
+bool RateTrace::is_rate_trace( const char * text, const size_t length )
+{
+    /* a list of opportunities has nothing but a number on each line */
+    const char * eol = static_cast<const char *>( memchr( text, '\n', length ) );
+    const string first_line( text, eol ? eol : text + length );
+
+    return ( not first_line.empty() and first_line.front() == '#' )
+        or first_line.find_first_of( " \t" ) != string::npos;
+}
+
+RateTrace::RateTrace( const char * text, const size_t length, const string & filename )
+    : segments_(),
+      opportunities_( 0 ),
+      duration_( 0 )
+{
+    const char * pos = text;
+    const char * const end = text + length;
+
+    uint128_t bits = 0;
+
+    while ( pos < end ) {
+        const char * eol = static_cast<const char *>( memchr( pos, '\n', end - pos ) );
+        if ( not eol ) {
+            eol = end;
+        }
+
+        const string line( pos, eol );
+        pos = eol + 1;
+
+        const vector<string> fields = split_fields( line );
+        if ( fields.empty() or fields.front().front() == '#' ) {
+            continue;
+        }
+
+        if ( fields.size() != 3 ) {
+            throw runtime_error( filename + ": expected \"START END RATE\", not \"" + line + "\"" );
+        }
+
+        if ( fields.at( 2 ).find_first_not_of( "0123456789" ) != string::npos ) {
+            throw runtime_error( filename + ": invalid rate (bits/s): " + fields.at( 2 ) );
+        }
+
+        Segment segment;
+        segment.start = myatoms_ns( fields.at( 0 ) );
+        segment.end = myatoms_ns( fields.at( 1 ) );
+        segment.rate = myatoi( fields.at( 2 ) );
+
+        if ( segment.end <= segment.start ) {
+            throw runtime_error( filename + ": segment must end after it starts: " + line );
+        }
+
+        if ( not segments_.empty() and segment.start < segments_.back().end ) {
+            throw runtime_error( filename + ": segments must be in order and not overlap" );
+        }
+
+        segment.bits_before = bits;
+        bits += uint128_t( segment.rate ) * ( segment.end - segment.start );
+        segment.bits_after = bits;
+
+        segment.last_opportunity = uint64_t( min( bits / OPPORTUNITY_UNITS,
+                                                  uint128_t( numeric_limits<uint64_t>::max() ) ) );
+        segment.step_whole = segment.rate ? uint64_t( OPPORTUNITY_UNITS / segment.rate ) : 0;
+        segment.step_fraction = segment.rate ? uint64_t( OPPORTUNITY_UNITS % segment.rate ) : 0;
+
+        segments_.push_back( segment );
+    }
+
+    const uint128_t opportunities = bits / OPPORTUNITY_UNITS;
+
+    if ( opportunities == 0 ) {
+        throw runtime_error( filename + ": no delivery opportunities" );
+    }
+
+    if ( opportunities > numeric_limits<uint64_t>::max() ) {
+        throw runtime_error( filename + ": too many delivery opportunities" );
+    }
+
+    opportunities_ = opportunities;
+
+    size_t hint = 0;
+    duration_ = opportunity_time( opportunities_, hint );
+
+    if ( duration_ == 0 ) {
+        throw runtime_error( filename + ": trace must last for a nonzero amount of time" );
+    }
+}
+
+uint64_t RateTrace::opportunity_time( const uint64_t index, size_t & hint ) const
+{
+    const uint128_t needed = index * OPPORTUNITY_UNITS;
+
+    /* (index is at most opportunities_, so some segment gets there) */
+    while ( segments_[ hint ].bits_after < needed ) {
+        hint++;
+    }
+
+    const Segment & segment = segments_[ hint ];
+
+    if ( needed <= segment.bits_before ) {
+        return segment.start;
+    }
+
+    /* first whole nanosecond by which enough bits have accumulated */
+    const uint128_t elapsed = ( needed - segment.bits_before + segment.rate - 1 ) / segment.rate;
+
+    return segment.start + uint64_t( elapsed );
+}
+
+uint128_t RateTrace::bits_through( const uint64_t t, size_t & hint ) const
+{
+    while ( hint + 1 < segments_.size() and segments_[ hint + 1 ].start <= t ) {
+        hint++;
+    }
+
+    const Segment & segment = segments_[ hint ];
+
+    if ( t < segment.start ) {
+        return segment.bits_before;
+    } else if ( t >= segment.end ) {
+        return segment.bits_after;
+    }
+
+    return segment.bits_before + uint128_t( segment.rate ) * ( t - segment.start );
+}
+
+uint64_t RateTrace::opportunities_through( const uint64_t t, size_t & hint ) const
+{
+    const uint128_t opportunities = bits_through( t, hint ) / OPPORTUNITY_UNITS;
+
+    return opportunities < opportunities_ ? uint64_t( opportunities ) : opportunities_;
+}
+
+RateTrace::Cursor::Cursor( const RateTrace & trace )
+    : trace_( &trace ),
+      index_( 1 ),
+      segment_( 0 ),
+      time_( 0 ),
+      whole_( 0 ),
+      fraction_( 0 ),
+      stepping_( false )
+{
+    rewind();
+}
+
+/* find the time of the current opportunity from scratch */
+void RateTrace::Cursor::locate( void )
+{
+    time_ = trace_->opportunity_time( index_, segment_ );
+
+    const Segment & segment = trace_->segments_[ segment_ ];
+    const uint128_t needed = index_ * OPPORTUNITY_UNITS;
+
+    /* (a segment where an opportunity falls after the start has a nonzero rate) */
+    stepping_ = needed > segment.bits_before;
+
+    if ( stepping_ ) {
+        const uint128_t bits = needed - segment.bits_before;
+        whole_ = uint64_t( bits / segment.rate );
+        fraction_ = uint64_t( bits % segment.rate );
+    }
+}
+
+void RateTrace::Cursor::rewind( void )
+{
+    index_ = 1;
+    segment_ = 0;
+    locate();
+}
+
+bool RateTrace::Cursor::advance( void )
+{
+    if ( index_ == trace_->opportunities_ ) {
+        rewind();
+        return false;
+    }
+
+    index_++;
+
+    const Segment & segment = trace_->segments_[ segment_ ];
+
+    if ( stepping_ and index_ <= segment.last_opportunity ) {
+        /* another OPPORTUNITY_UNITS of bits in the same segment */
+        whole_ += segment.step_whole;
+        fraction_ += segment.step_fraction;
+        if ( fraction_ >= segment.rate ) {
+            whole_++;
+            fraction_ -= segment.rate;
+        }
+
+        /* first whole nanosecond by which enough bits have accumulated */
+        time_ = segment.start + whole_ + ( fraction_ != 0 );
+    } else {
+        locate();
+    }
+
+    return true;
+}
+
+uint64_t RateTrace::Cursor::skip_through( const uint64_t t, bool & wrapped )
+{
+    wrapped = false;
+
+    if ( time_ > t ) {
+        return 0;
+    }
+
+    /* (the segment holding t is at or after the one holding the current opportunity) */
+    const uint64_t through = trace_->opportunities_through( t, segment_ );
+    const uint64_t skipped = through - index_ + 1;
+
+    if ( through == trace_->opportunities_ ) {
+        rewind();
+        wrapped = true;
+    } else {
+        index_ = through + 1;
+        locate();
+    }
+
+    return skipped;
+}
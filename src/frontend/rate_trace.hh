@@ -0,0 +1,98 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RATE_TRACE_HH
+#define RATE_TRACE_HH
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* exact products of rates (bits/s) and times (ns) */
+__extension__ typedef unsigned __int128 uint128_t;
+
+/* A link rate that is constant over each of a series of segments, one
+   "START END RATE" line per segment (times in ms, rate in bits/s; lines
+   starting with # are comments). It stands for the packet-delivery trace
+   with an opportunity at the first nanosecond by which another 1504
+   bytes' worth of bits has accumulated since the start. This class finds
+   that trace's opportunities in closed form instead of listing them.
+   Like the listed trace, it repeats from its last opportunity. */
+class RateTrace
+{
+public:
+    /* bits delivered by one opportunity (LinkQueue's PACKET_SIZE) */
+    static const uint64_t OPPORTUNITY_BITS = 1504 * 8;
+
+private:
+    struct Segment
+    {
+        uint64_t start, end; /* ns */
+        uint64_t rate;       /* bits/s */
+        uint128_t bits_before, bits_after; /* accumulated at start and end (bits * 10^9) */
+
+        /* for stepping from one opportunity to the next without dividing:
+           the last opportunity by the end, and the time one takes (ns)
+           as a whole part and a fraction (in units of 1/rate ns) */
+        uint64_t last_opportunity;
+        uint64_t step_whole, step_fraction;
+    };
+
+    std::vector<Segment> segments_;
+
+    uint64_t opportunities_;
+    uint64_t duration_;
+
+    /* accumulated by time t (bits * 10^9); hint is a segment at or before t */
+    uint128_t bits_through( const uint64_t t, size_t & hint ) const;
+
+public:
+    RateTrace( const char * text, const size_t length, const std::string & filename );
+
+    /* is the text a rate trace rather than a list of opportunities? */
+    static bool is_rate_trace( const char * text, const size_t length );
+
+    /* opportunities in one pass through the trace */
+    uint64_t opportunities( void ) const { return opportunities_; }
+
+    /* time of the last opportunity (ns); the trace repeats with this period */
+    uint64_t duration( void ) const { return duration_; }
+
+    /* time of opportunity number index (counting from 1);
+       hint is a segment at or before it, and is moved up to it */
+    uint64_t opportunity_time( const uint64_t index, size_t & hint ) const;
+
+    /* number of opportunities at or before time t in one pass */
+    uint64_t opportunities_through( const uint64_t t, size_t & hint ) const;
+
+    /* same interface as CompiledTrace::Cursor; advancing within a
+       segment adds a fixed step, and only moving to another segment
+       (or skipping) has to divide */
+    class Cursor
+    {
+    private:
+        const RateTrace * trace_;
+        uint64_t index_;
+        size_t segment_;
+        uint64_t time_;
+
+        /* bits accumulated in the segment by the current opportunity,
+           divided by its rate (valid if stepping_) */
+        uint64_t whole_, fraction_;
+        bool stepping_;
+
+        void locate( void );
+
+    public:
+        Cursor( const RateTrace & trace );
+
+        uint64_t time( void ) const { return time_; }
+
+        bool advance( void );
+
+        uint64_t skip_through( const uint64_t t, bool & wrapped );
+
+        void rewind( void );
+    };
+};
+
+#endif /* RATE_TRACE_HH */
@@ -4,6 +4,10 @@
 #include <sys/ioctl.h>
 #include <linux/if.h>
 #include <net/route.h>
+#include <getopt.h>
+
+#include <memory>
+
 #include "nat.hh"
 #include "util.hh"
 #include "interfaces.hh"
@@ -29,27 +33,65 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " directory [command...]" );
+        const string usage = "Usage: " + string( argv[ 0 ] ) + " [--archive] directory [command...]";
+
+        const option command_line_options[] = {
+            { "archive",        no_argument, nullptr, 'a' },
+            { 0,                          0, nullptr, 0 }
+        };
+
+        /* save to a single recording archive instead of one file per request/response */
+        bool use_archive = false;
+
+        while ( true ) {
+            /* stop at the directory so the command's own options are left alone */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'a':
+                use_archive = true;
+                break;
+            case '?':
+                throw runtime_error( usage );
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind >= argc ) {
+            throw runtime_error( usage );
         }
 
-        /* Make sure directory ends with '/' so we can prepend directory to file name for storage */
-        string directory( argv[ 1 ] );
+        /* with --archive, this names the archive file */
+        string directory( argv[ optind ] );
 
         if ( directory.empty() ) {
             throw runtime_error( string( argv[ 0 ] ) + ": directory name must be non-empty" );
         }
 
-        if ( directory.back() != '/' ) {
-            directory.append( "/" );
+        /* timing logs go in the recording directory, or alongside the archive */
+        string log_directory;
+
+        if ( use_archive ) {
+            const auto slash = directory.rfind( '/' );
+            log_directory = slash == string::npos ? "." : directory.substr( 0, slash + 1 );
+        } else {
+            /* Make sure directory ends with '/' so we can prepend directory to file name for storage */
+            if ( directory.back() != '/' ) {
+                directory.append( "/" );
+            }
+            log_directory = directory;
         }
 
         /* what command will we run inside the container? */
         vector < string > command;
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
@@ -149,17 +191,21 @@ int main( int argc, char *argv[] )
         outer_event_loop.add_child_process( "recorder", [&]() {
                 drop_privileges();
 
-                make_directory( directory );
-
-                /* set up backing store to save to disk */
-                HTTPDiskStore disk_backing_store( directory );
+                /* set up backing store to save to disk (an archive's index is written when it is destroyed) */
+                unique_ptr< HTTPBackingStore > backing_store;
+                if ( use_archive ) {
+                    backing_store.reset( new HTTPArchiveStore( directory ) );
+                } else {
+                    make_directory( directory );
+                    backing_store.reset( new HTTPDiskStore( directory ) );
+                }
 
                 EventLoop recordr_event_loop;
                 dns_outside.register_handlers( recordr_event_loop );
-                http_proxy.register_handlers( recordr_event_loop, disk_backing_store );
+                http_proxy.register_handlers( recordr_event_loop, *backing_store );
                 auto x = recordr_event_loop.loop();
-                TimeLogger::print_map(directory);
-                TimeLogger::save_rtt(directory);
+                TimeLogger::print_map(log_directory);
+                TimeLogger::save_rtt(log_directory);
                 return x;
             } );
         return outer_event_loop.loop();  
@@ -20,6 +20,9 @@
 #include "http_request.hh"
 #include "http_response.hh"
 #include "file_descriptor.hh"
+#include "socket.hh"
+#include "ezio.hh"
+#include "replay_index.hh"
 
 using namespace std;
 
@@ -33,77 +36,46 @@ string safe_getenv( const string & key )
     return value;
 }
 
-/* does the actual HTTP header match this stored request? */
-bool header_match( const string & env_var_name,
-                   const string & header_name,
-                   const HTTPRequest & saved_request )
+/* add a header to the reconstructed request if the client sent it */
+void add_header_from_env( MahimahiProtobufs::HTTPMessage & request,
+                          const string & env_var_name,
+                          const string & header_name )
 {
     const char * const env_value = getenv( env_var_name.c_str() );
-
-    /* case 1: neither header exists (OK) */
-    if ( (not env_value) and (not saved_request.has_header( header_name )) ) {
-        return true;
-    }
-
-    /* case 2: headers both exist (OK if values match) */
-    if ( env_value and saved_request.has_header( header_name ) ) {
-        return saved_request.get_header_value( header_name ) == string( env_value );
+    if ( env_value ) {
+        MahimahiProtobufs::HTTPHeader * header = request.add_header();
+        header->set_key( header_name );
+        header->set_value( env_value );
     }
-
-    /* case 3: one exists but the other doesn't (failure) */
-    return false;
 }
 
-string strip_query( const string & request_line )
+/* ask mm-webreplay's preloaded index for the best match */
+string query_index_server( const string & index_address,
+                           const MahimahiProtobufs::RequestResponse & query )
 {
-    const auto index = request_line.find( "?" );
-    if ( index == string::npos ) {
-        return request_line;
-    } else {
-        return request_line.substr( 0, index );
-    }
-}
-
-/* compare request_line and certain headers of incoming request and stored request */
-unsigned int match_score( const MahimahiProtobufs::RequestResponse & saved_record,
-                          const string & request_line,
-                          const bool is_https )
-{
-    const HTTPRequest saved_request( saved_record.request() );
-
-    /* match HTTP/HTTPS */
-    if ( is_https and (saved_record.scheme() != MahimahiProtobufs::RequestResponse_Scheme_HTTPS) ) {
-        return 0;
+    const auto colon = index_address.rfind( ":" );
+    if ( colon == string::npos ) {
+        throw runtime_error( "invalid MAHIMAHI_REPLAY_INDEX: " + index_address );
     }
 
-    if ( (not is_https) and (saved_record.scheme() != MahimahiProtobufs::RequestResponse_Scheme_HTTP) ) {
-        return 0;
-    }
-
-    /* match host header */
-    if ( not header_match( "HTTP_HOST", "Host", saved_request ) ) {
-        return 0;
-    }
+    TCPSocket index_server;
+    index_server.connect( Address( index_address.substr( 0, colon ),
+                                   myatoi( index_address.substr( colon + 1 ) ) ) );
 
-    /* match user agent */
-    if ( not header_match( "HTTP_USER_AGENT", "User-Agent", saved_request ) ) {
-        return 0;
+    string serialized_query;
+    if ( not query.SerializeToString( &serialized_query ) ) {
+        throw runtime_error( "failure to serialize replay query" );
     }
+    index_server.write( serialized_query );
+    index_server.shutdown( SHUT_WR );
 
-    /* must match first line up to "?" at least */
-    if ( strip_query( request_line ) != strip_query( saved_request.first_line() ) ) {
-        return 0;
+    /* server replies with the stored response, or nothing if there is no match */
+    string response;
+    while ( not index_server.eof() ) {
+        response.append( index_server.read() );
     }
 
-    /* success! return size of common prefix */
-    const auto max_match = min( request_line.size(), saved_request.first_line().size() );
-    for ( unsigned int i = 0; i < max_match; i++ ) {
-        if ( request_line.at( i ) != saved_request.first_line().at( i ) ) {
-            return i;
-        }
-    }
-
-    return max_match;
+    return response;
 }
 
 int main( void )
@@ -120,29 +92,31 @@ int main( void )
 
         SystemCall( "chdir", chdir( working_directory.c_str() ) );
 
-        const vector< string > files = list_directory_contents( recording_directory );
-
-        unsigned int best_score = 0;
-        MahimahiProtobufs::RequestResponse best_match;
-
-        for ( const auto & filename : files ) {
-            if (filename.find("save") != string::npos) { // Only load the recorded save files
-                FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
-                MahimahiProtobufs::RequestResponse current_record;
-                if ( not current_record.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                    throw runtime_error( filename + ": invalid HTTP request/response" );
-                }
-
-                unsigned int score = match_score( current_record, request_line, is_https );
-                if ( score > best_score ) {
-                    best_match = current_record;
-                    best_score = score;
-                }
+        /* reconstruct the parts of the request that matching depends on */
+        MahimahiProtobufs::RequestResponse query;
+        query.set_scheme( is_https
+                          ? MahimahiProtobufs::RequestResponse_Scheme_HTTPS
+                          : MahimahiProtobufs::RequestResponse_Scheme_HTTP );
+        query.mutable_request()->set_first_line( request_line );
+        add_header_from_env( *query.mutable_request(), "HTTP_HOST", "Host" );
+        add_header_from_env( *query.mutable_request(), "HTTP_USER_AGENT", "User-Agent" );
+
+        string best_match;
+
+        const char * const index_address = getenv( "MAHIMAHI_REPLAY_INDEX" );
+        if ( index_address ) {
+            best_match = query_index_server( index_address, query );
+        } else {
+            /* no index server running: load the recording ourselves */
+            const ReplayIndex index( recording_directory );
+            const auto match = index.find( HTTPRequest( query.request() ), is_https );
+            if ( match ) {
+                best_match = HTTPResponse( match->response() ).str();
             }
         }
 
-        if ( best_score > 0 ) { /* give client the best match */
-            cout << HTTPResponse( best_match.response() ).str();
+        if ( not best_match.empty() ) { /* give client the best match */
+            cout << best_match;
             return EXIT_SUCCESS;
         } else {                /* no acceptable matches for request */
             cout << "HTTP/1.1 404 Not Found" << CRLF;
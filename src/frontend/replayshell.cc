@@ -2,9 +2,12 @@
 
 #include <net/route.h>
 #include <fcntl.h>
+#include <getopt.h>
 
 #include <vector>
 #include <set>
+#include <memory>
+#include <thread>
 
 #include "util.hh"
 #include "netdevice.hh"
@@ -16,12 +19,16 @@
 #include "http_response.hh"
 #include "dns_server.hh"
 #include "exception.hh"
+#include "replay_index.hh"
+#include "recording_archive.hh"
+#include "http_replay_server.hh"
 
 #include "http_record.pb.h"
 
 #include "config.h"
 
 using namespace std;
+using namespace PollerShortNames;
 
 void add_dummy_interface( const string & name, const Address & addr )
 {
@@ -33,6 +40,35 @@ void add_dummy_interface( const string & name, const Address & addr )
                      [&] ( ifreq &ifr ) { ifr.ifr_addr = addr.to_sockaddr(); } );
 }
 
+/* a replay server CGI that has sent no query in this long is dropped */
+static const uint64_t INDEX_QUERY_TIMEOUT_MS = 10000;
+
+/* read one serialized query from a replay server CGI and send back the best match, if any */
+void serve_index_query( const ReplayIndex & replay_index, TCPSocket && client )
+{
+    try {
+        client.set_receive_timeout( INDEX_QUERY_TIMEOUT_MS );
+
+        string serialized_query;
+        while ( not client.eof() ) {
+            serialized_query.append( client.read() );
+        }
+
+        MahimahiProtobufs::RequestResponse query;
+        if ( not query.ParseFromString( serialized_query ) ) {
+            throw runtime_error( "invalid replay query" );
+        }
+
+        const auto match = replay_index.find( HTTPRequest( query.request() ),
+                                              query.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS );
+        if ( match ) {
+            client.write( HTTPResponse( match->response() ).str() );
+        }
+    } catch ( const exception & e ) { /* one bad query shouldn't stop the replay */
+        print_exception( e );
+    }
+}
+
 int main( int argc, char *argv[] )
 {
     try {
@@ -42,22 +78,45 @@ int main( int argc, char *argv[] )
 
         check_requirements( argc, argv );
 
-        if ( argc < 2 ) {
-            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " directory [command...]" );
+        const string usage = "Usage: " + string( argv[ 0 ] ) + " [--apache] directory [command...]";
+
+        const option command_line_options[] = {
+            { "apache",         no_argument, nullptr, 'a' },
+            { 0,                          0, nullptr, 0 }
+        };
+
+        /* serve with one apache instance per address instead of the built-in server */
+        bool use_apache = false;
+
+        while ( true ) {
+            /* stop at the directory so the command's own options are left alone */
+            const int opt = getopt_long( argc, argv, "+", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 'a':
+                use_apache = true;
+                break;
+            case '?':
+                throw runtime_error( usage );
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind >= argc ) {
+            throw runtime_error( usage );
         }
 
-        /* clean directory name */
-        string directory = argv[ 1 ];
+        /* recording directory, or a single-file recording archive */
+        const string directory = argv[ optind ];
 
         if ( directory.empty() ) {
             throw runtime_error( string( argv[ 0 ] ) + ": directory name must be non-empty" );
         }
 
-        /* make sure directory ends with '/' so we can prepend directory to file name for storage */
-        if ( directory.back() != '/' ) {
-            directory.append( "/" );
-        }
-
         /* get working directory */
         const string working_directory { get_working_directory() };
 
@@ -66,10 +125,10 @@ int main( int argc, char *argv[] )
 
         /* what command will we run inside the container? */
         vector< string > command;
-        if ( argc == 2 ) {
+        if ( optind + 1 == argc ) {
             command.push_back( shell_path() );
         } else {
-            for ( int i = 2; i < argc; i++ ) {
+            for ( int i = optind + 1; i < argc; i++ ) {
                 command.push_back( argv[ i ] );
             }
         }
@@ -89,21 +148,14 @@ int main( int argc, char *argv[] )
         set< Address > unique_ip_and_port;
         vector< pair< string, Address > > hostname_to_ip;
 
+        /* every saved request/response, loaded once for the lifetime of the replay */
+        ReplayIndex replay_index;
+
         {
             TemporarilyUnprivileged tu;
             /* would be privilege escalation if we let the user read directories or open files as root */
 
-            const vector< string > files = list_directory_contents( directory  );
-
-            for ( const auto filename : files ) {
-                if ( filename.find("save") != string::npos ) { // Only load the recorded save files
-                    FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
-
-                    MahimahiProtobufs::RequestResponse protobuf;
-                    if ( not protobuf.ParseFromFileDescriptor( fd.fd_num() ) ) {
-                        throw runtime_error( filename + ": invalid HTTP request/response" );
-                    }
-
+            load_recording( directory, [&] ( const MahimahiProtobufs::RequestResponse & protobuf ) {
                     const Address address( protobuf.ip(), protobuf.port() );
 
                     unique_ip.emplace( address.ip(), 0 );
@@ -111,8 +163,9 @@ int main( int argc, char *argv[] )
 
                     hostname_to_ip.emplace_back( HTTPRequest( protobuf.request() ).get_header_value( "Host" ),
                                                  address );
-                }
-            }
+
+                    replay_index.add( protobuf );
+                } );
         }
 
         /* set up dummy interfaces */
@@ -123,10 +176,24 @@ int main( int argc, char *argv[] )
         }
 
         /* set up web servers */
+        TCPSocket index_listener;
         vector< WebServer > servers;
-        for ( const auto ip_port : unique_ip_and_port ) {
-            cout << "IP: " << ip_port.ip() << " has started!" << endl;
-            servers.emplace_back( ip_port, working_directory, directory );
+        unique_ptr< HTTPReplayServer > native_server;
+
+        if ( use_apache ) {
+            /* the replay server CGI asks this socket for matches instead of rescanning the recording */
+            index_listener.bind( Address( "127.0.0.1", 0 ) );
+            index_listener.listen();
+
+            for ( const auto ip_port : unique_ip_and_port ) {
+                cout << "IP: " << ip_port.ip() << " has started!" << endl;
+                servers.emplace_back( ip_port, working_directory, directory, index_listener.local_address() );
+            }
+        } else {
+            /* bind every address now, while we can still bind privileged ports */
+            native_server.reset( new HTTPReplayServer( vector< Address >( unique_ip_and_port.begin(),
+                                                                          unique_ip_and_port.end() ),
+                                                       replay_index ) );
         }
 
         /* set up DNS server */
@@ -150,6 +217,37 @@ int main( int argc, char *argv[] )
         /* start dnsmasq */
         event_loop.add_child_process( start_dnsmasq( dnsmasq_args ) );
 
+        if ( use_apache ) {
+            /* answer replay server queries from the preloaded index */
+            event_loop.add_child_process( "replay index", [&]() {
+                    drop_privileges();
+
+                    EventLoop index_event_loop;
+                    index_event_loop.add_simple_input_handler( index_listener, [&]() {
+                            /* each query in its own thread, so a client that stalls
+                               holds up no other lookup */
+                            thread query_thread( [&replay_index] ( TCPSocket client ) {
+                                    serve_index_query( replay_index, move( client ) );
+                                }, index_listener.accept() );
+                            query_thread.detach();
+
+                            return ResultType::Continue;
+                        } );
+
+                    return index_event_loop.loop();
+                } );
+        } else {
+            /* serve every recorded address from this one process */
+            event_loop.add_child_process( "replay server", [&]() {
+                    drop_privileges();
+
+                    EventLoop server_event_loop;
+                    native_server->register_handlers( server_event_loop );
+
+                    return server_event_loop.loop();
+                } );
+        }
+
         /* start shell */
         event_loop.add_child_process( join( command ), [&]() {
                 drop_privileges();
@@ -0,0 +1,450 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <getopt.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <ctime>
+#include <cstring>
+#include <climits>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "socket.hh"
+#include "child_process.hh"
+#include "system_runner.hh"
+#include "temp_file.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+#include "util.hh"
+#include "ezio.hh"
+
+using namespace std;
+
+/* Measures what the mahimahi shells cost by themselves. A generator
+   inside a chain of identical shells, each configured to add nothing
+   (no delay, no loss, an effectively infinite link), sends UDP to a sink
+   outside them, so every packet is read from one TUN device and written
+   to the next at each level. For each shell type and nesting depth this
+   reports the most packets per second that get through, the shells' CPU
+   time per packet, and how much latency they add beyond the configured
+   delay (which is zero). */
+
+/* what the generator puts at the start of each datagram */
+struct Probe
+{
+    static const uint32_t MAGIC = 0x6d6d7362; /* "mmsb" */
+
+    uint32_t magic;
+    uint32_t end; /* nonzero: the run is over, and the totals below are filled in */
+    uint64_t sequence_number;
+    uint64_t send_time; /* CLOCK_MONOTONIC ns (the same in every namespace) */
+    uint64_t packets_sent;
+    uint64_t generator_cpu_ns;
+};
+
+static uint64_t monotonic_ns( void )
+{
+    timespec ts;
+    SystemCall( "clock_gettime", clock_gettime( CLOCK_MONOTONIC, &ts ) );
+
+    return uint64_t( ts.tv_sec ) * NS_PER_SECOND + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns( const int who )
+{
+    rusage usage;
+    SystemCall( "getrusage", getrusage( who, &usage ) );
+
+    return ( uint64_t( usage.ru_utime.tv_sec ) + usage.ru_stime.tv_sec ) * NS_PER_SECOND
+        + ( uint64_t( usage.ru_utime.tv_usec ) + usage.ru_stime.tv_usec ) * 1000;
+}
+
+static void sleep_until( const uint64_t deadline )
+{
+    const timespec ts = { time_t( deadline / NS_PER_SECOND ), long( deadline % NS_PER_SECOND ) };
+
+    /* returns early only on a signal, and then the caller just sends late */
+    clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr );
+}
+
+/* the generator, run inside the shells: send for duration_ms, at
+   packets_per_second (or as fast as possible if zero), then announce
+   the end a few times in case the first announcements are lost */
+static int generate( const uint16_t port, const uint64_t packets_per_second,
+                     const uint64_t duration_ms, const size_t size )
+{
+    static const unsigned int END_ANNOUNCEMENTS = 10;
+    static const uint64_t END_SPACING = 20 * NS_PER_MS;
+
+    const char * const mahimahi_base = getenv( "MAHIMAHI_BASE" );
+
+    UDPSocket socket;
+    socket.connect( Address( mahimahi_base ? mahimahi_base : "127.0.0.1", port ) );
+
+    string payload( max( size, sizeof( Probe ) ), 'x' );
+    Probe probe;
+    zero( probe );
+    probe.magic = Probe::MAGIC;
+
+    const uint64_t start = monotonic_ns();
+    const uint64_t end = start + duration_ms * NS_PER_MS;
+
+    while ( true ) {
+        if ( packets_per_second ) {
+            sleep_until( start + probe.sequence_number * NS_PER_SECOND / packets_per_second );
+        }
+
+        probe.send_time = monotonic_ns();
+        if ( probe.send_time >= end ) {
+            break;
+        }
+
+        memcpy( &payload[ 0 ], &probe, sizeof( probe ) );
+        socket.send( payload );
+        probe.sequence_number++;
+    }
+
+    /* let the shells drain before reporting */
+    sleep_until( monotonic_ns() + 10 * END_SPACING );
+
+    probe.end = 1;
+    probe.packets_sent = probe.sequence_number;
+    probe.generator_cpu_ns = cpu_ns( RUSAGE_SELF );
+
+    for ( unsigned int i = 0; i < END_ANNOUNCEMENTS; i++ ) {
+        probe.send_time = monotonic_ns();
+        memcpy( &payload[ 0 ], &probe, sizeof( probe ) );
+        socket.send( payload );
+        sleep_until( probe.send_time + END_SPACING );
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* what the sink saw of one run of the generator */
+struct RunResult
+{
+    uint64_t packets_sent = 0, packets_received = 0;
+    uint64_t first_arrival = 0, last_arrival = 0;
+    uint64_t generator_cpu_ns = 0, shell_cpu_ns = 0;
+    vector<uint64_t> latencies {}; /* ns */
+
+    double packets_per_second( void ) const
+    {
+        if ( packets_received < 2 or last_arrival == first_arrival ) {
+            return 0;
+        }
+        return ( packets_received - 1 ) * double( NS_PER_SECOND ) / ( last_arrival - first_arrival );
+    }
+};
+
+/* run the generator inside the given shell command, collecting its packets */
+static RunResult run_through( UDPSocket & sink, const vector<string> & shells,
+                              const string & generator_path, const uint64_t packets_per_second,
+                              const uint64_t duration_ms, const size_t size )
+{
+    static const int POLL_INTERVAL_MS = 100;
+
+    vector<string> command = shells;
+    command.insert( command.end(), { generator_path, "--generate",
+                                     to_string( sink.local_address().port() ),
+                                     to_string( packets_per_second ),
+                                     to_string( duration_ms ),
+                                     to_string( size ) } );
+
+    RunResult result;
+    bool got_end = false;
+
+    const uint64_t cpu_before = cpu_ns( RUSAGE_CHILDREN );
+
+    ChildProcess generator( command.front(), [&] () { return ezexec( command, true ); } );
+
+    pollfd sink_poll;
+    zero( sink_poll );
+    sink_poll.fd = sink.fd_num();
+    sink_poll.events = POLLIN;
+
+    /* after the chain exits, collect whatever is still waiting */
+    bool exited = false;
+    while ( true ) {
+        const int ready = SystemCall( "poll", poll( &sink_poll, 1, exited ? 0 : POLL_INTERVAL_MS ) );
+
+        if ( ready ) {
+            const string datagram = sink.recvfrom().second;
+            const uint64_t now = monotonic_ns();
+
+            Probe probe;
+            if ( datagram.size() < sizeof( probe ) ) {
+                continue;
+            }
+            memcpy( &probe, datagram.data(), sizeof( probe ) );
+            if ( probe.magic != Probe::MAGIC ) {
+                continue;
+            }
+
+            if ( probe.end ) {
+                if ( not got_end ) {
+                    got_end = true;
+                    result.packets_sent = probe.packets_sent;
+                    result.generator_cpu_ns = probe.generator_cpu_ns;
+                }
+                continue;
+            }
+
+            if ( result.packets_received == 0 ) {
+                result.first_arrival = now;
+            }
+            result.last_arrival = now;
+            result.packets_received++;
+            result.latencies.push_back( now - probe.send_time );
+        } else if ( exited ) {
+            break;
+        } else if ( generator.waitable() ) {
+            generator.wait();
+            if ( not generator.terminated() ) {
+                continue; /* only stopped or continued */
+            }
+            if ( generator.died_on_signal() or generator.exit_status() != EXIT_SUCCESS ) {
+                generator.throw_exception();
+            }
+            exited = true;
+        }
+    }
+
+    if ( not got_end ) {
+        throw runtime_error( join( shells ) + ": the generator's packets did not reach the sink" );
+    }
+
+    /* the shells' CPU time, less the generator's (which ran as their child) */
+    const uint64_t children_cpu_ns = cpu_ns( RUSAGE_CHILDREN ) - cpu_before;
+    result.shell_cpu_ns = children_cpu_ns - min( children_cpu_ns, result.generator_cpu_ns );
+
+    return result;
+}
+
+/* latency histogram with power-of-two microsecond bins */
+static void print_histogram( const vector<uint64_t> & latencies )
+{
+    vector<uint64_t> bins;
+
+    for ( const auto & latency : latencies ) {
+        uint64_t us = latency / 1000;
+        unsigned int bin = 0;
+        while ( us ) {
+            us >>= 1;
+            bin++;
+        }
+
+        if ( bin >= bins.size() ) {
+            bins.resize( bin + 1 );
+        }
+        bins.at( bin )++;
+    }
+
+    for ( unsigned int bin = 0; bin < bins.size(); bin++ ) {
+        if ( bins.at( bin ) == 0 ) {
+            continue;
+        }
+
+        const uint64_t low = bin ? uint64_t( 1 ) << ( bin - 1 ) : 0;
+        const uint64_t high = uint64_t( 1 ) << bin;
+
+        cout << "    [" << setw( 7 ) << low << ", " << setw( 7 ) << high << ") us  "
+             << setw( 9 ) << bins.at( bin ) << "  "
+             << fixed << setprecision( 2 ) << setw( 6 ) << 100.0 * bins.at( bin ) / latencies.size() << " %" << endl;
+    }
+}
+
+static double percentile_us( const vector<uint64_t> & sorted, const double fraction )
+{
+    if ( sorted.empty() ) {
+        return 0;
+    }
+
+    const size_t index = min( sorted.size() - 1, size_t( fraction * sorted.size() ) );
+    return sorted.at( index ) / 1000.0;
+}
+
+/* the shell command that adds nothing, for each type of shell */
+static vector<string> shell_command( const string & type, const string & trace )
+{
+    if ( type == "delay" ) {
+        return { "mm-delay", "0" };
+    } else if ( type == "link" ) {
+        return { "mm-link", trace, trace, "--" };
+    } else if ( type == "loss" ) {
+        return { "mm-loss", "uplink", "0" };
+    } else if ( type == "meter" ) {
+        return { "mm-meter", "--" };
+    } else if ( type == "net" ) {
+        /* all four in one shell */
+        return { "mm-net", "delay", "0", "link", trace, trace, "loss", "uplink", "0", "meter", "--" };
+    } else {
+        throw runtime_error( "unknown shell type: " + type );
+    }
+}
+
+static vector<string> split_list( const string & list )
+{
+    vector<string> ret;
+    istringstream stream( list );
+    string item;
+
+    while ( getline( stream, item, ',' ) ) {
+        ret.push_back( item );
+    }
+
+    return ret;
+}
+
+static string self_path( void )
+{
+    char path[ PATH_MAX ];
+    const ssize_t len = SystemCall( "readlink", readlink( "/proc/self/exe", path, sizeof( path ) ) );
+
+    return string( path, len );
+}
+
+void usage_error( const string & program_name )
+{
+    cerr << "Usage: " << program_name << " [OPTION]..." << endl;
+    cerr << endl;
+    cerr << "Options = --shells=TYPE[,TYPE]... (of delay, link, loss, meter, net; default all)" << endl;
+    cerr << "          --max-depth=N (nest each shell 1 to N deep; default 3)" << endl;
+    cerr << "          --duration=MS (length of each run; default 2000)" << endl;
+    cerr << "          --rate=PPS (packet rate for the latency runs; default 1000)" << endl;
+    cerr << "          --size=BYTES (UDP payload size; default 100)" << endl << endl;
+
+    throw runtime_error( "invalid arguments" );
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        /* re-run inside the shells as the generator */
+        if ( argc == 6 and string( argv[ 1 ] ) == "--generate" ) {
+            return generate( myatoi( argv[ 2 ] ), myatoi( argv[ 3 ] ), myatoi( argv[ 4 ] ), myatoi( argv[ 5 ] ) );
+        }
+
+        const option command_line_options[] = {
+            { "shells",         required_argument, nullptr, 's' },
+            { "max-depth",      required_argument, nullptr, 'd' },
+            { "duration",       required_argument, nullptr, 't' },
+            { "rate",           required_argument, nullptr, 'r' },
+            { "size",           required_argument, nullptr, 'b' },
+            { 0,                                0, nullptr, 0 }
+        };
+
+        vector<string> shell_types = { "delay", "link", "loss", "meter", "net" };
+        unsigned int max_depth = 3;
+        uint64_t duration_ms = 2000, latency_rate = 1000;
+        size_t size = 100;
+
+        while ( true ) {
+            const int opt = getopt_long( argc, argv, "", command_line_options, nullptr );
+            if ( opt == -1 ) { /* end of options */
+                break;
+            }
+
+            switch ( opt ) {
+            case 's':
+                shell_types = split_list( optarg );
+                break;
+            case 'd':
+                max_depth = myatoi( optarg );
+                break;
+            case 't':
+                duration_ms = myatoi( optarg );
+                break;
+            case 'r':
+                latency_rate = myatoi( optarg );
+                break;
+            case 'b':
+                size = myatoi( optarg );
+                break;
+            case '?':
+                usage_error( argv[ 0 ] );
+                break;
+            default:
+                throw runtime_error( "getopt_long: unexpected return value " + to_string( opt ) );
+            }
+        }
+
+        if ( optind != argc or latency_rate == 0 or duration_ms == 0 ) {
+            usage_error( argv[ 0 ] );
+        }
+
+        /* a link far faster than the shells can go (100 Gbit/s, as a rate trace) */
+        TempFile trace( "/tmp/mm-selftest-bench-trace" );
+        trace.write( "# mm-selftest-bench\n0 1000 100000000000\n" );
+
+        /* check the shell types before spending time on any of them */
+        for ( const auto & type : shell_types ) {
+            shell_command( type, trace.name() );
+        }
+
+        const string generator_path = self_path();
+
+        UDPSocket sink;
+        sink.bind( Address( "0.0.0.0", 0 ) );
+
+        cout << "# mm-selftest-bench: " << duration_ms << " ms runs, " << size << "-byte payloads, "
+             << "latency measured at " << latency_rate << " packets/s" << endl;
+        cout << "# added latency is beyond the configured delay (0); depth 0 is the host alone" << endl;
+        cout << left << setw( 8 ) << "# shell" << right
+             << setw( 6 ) << "depth" << setw( 12 ) << "max-pps" << setw( 8 ) << "loss%"
+             << setw( 12 ) << "cpu-ns/pkt" << setw( 10 ) << "p50-us" << setw( 10 ) << "p99-us"
+             << setw( 10 ) << "p99.9-us" << setw( 10 ) << "max-us" << endl;
+
+        vector< pair<string, unsigned int> > configurations = { { "none", 0 } };
+        for ( const auto & type : shell_types ) {
+            for ( unsigned int depth = 1; depth <= max_depth; depth++ ) {
+                configurations.emplace_back( type, depth );
+            }
+        }
+
+        for ( const auto & configuration : configurations ) {
+            vector<string> shells;
+            for ( unsigned int i = 0; i < configuration.second; i++ ) {
+                const vector<string> shell = shell_command( configuration.first, trace.name() );
+                shells.insert( shells.end(), shell.begin(), shell.end() );
+            }
+
+            /* flood for the throughput ceiling and CPU cost, then pace for latency */
+            const RunResult flood = run_through( sink, shells, generator_path, 0, duration_ms, size );
+            RunResult paced = run_through( sink, shells, generator_path, latency_rate, duration_ms, size );
+
+            sort( paced.latencies.begin(), paced.latencies.end() );
+
+            const double loss = flood.packets_sent
+                ? 100.0 * ( flood.packets_sent - min( flood.packets_sent, flood.packets_received ) ) / flood.packets_sent
+                : 0;
+
+            cout << left << setw( 8 ) << configuration.first << right
+                 << setw( 6 ) << configuration.second
+                 << fixed << setprecision( 0 ) << setw( 12 ) << flood.packets_per_second()
+                 << setprecision( 1 ) << setw( 8 ) << loss
+                 << setprecision( 0 ) << setw( 12 )
+                 << ( flood.packets_received ? double( flood.shell_cpu_ns ) / flood.packets_received : 0.0 )
+                 << setprecision( 1 )
+                 << setw( 10 ) << percentile_us( paced.latencies, 0.5 )
+                 << setw( 10 ) << percentile_us( paced.latencies, 0.99 )
+                 << setw( 10 ) << percentile_us( paced.latencies, 0.999 )
+                 << setw( 10 ) << percentile_us( paced.latencies, 1.0 ) << endl;
+
+            print_histogram( paced.latencies );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
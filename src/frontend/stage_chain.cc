@@ -0,0 +1,70 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include "stage_chain.hh"
+#include "timestamp.hh"
+
+using namespace std;
+
+StageChain::StageChain( const vector<StageMaker> & stage_makers )
+    : stages_(),
+      transfer_()
+{
+    for ( const auto & make_stage : stage_makers ) {
+        stages_.push_back( make_stage() );
+    }
+
+    if ( stages_.empty() ) {
+        throw runtime_error( "StageChain: no stages" );
+    }
+}
+
+void StageChain::read_packets( vector<PacketBuffer> & batch )
+{
+    stages_.front()->read_packets( batch );
+}
+
+void StageChain::write_packets( FileDescriptor & fd )
+{
+    stages_.back()->write_packets( fd );
+}
+
+uint64_t StageChain::wait_time( void )
+{
+    uint64_t ret = numeric_limits<uint16_t>::max() * NS_PER_MS;
+
+    /* in order, so a packet can cross every stage that lets it straight through */
+    for ( size_t i = 0; i < stages_.size(); i++ ) {
+        PacketStage & stage = *stages_.at( i );
+
+        /* (also brings the stage up to date, e.g. a link's deliveries) */
+        uint64_t stage_wait = stage.wait_time();
+
+        if ( i + 1 < stages_.size() ) {
+            stage.take_output( transfer_ );
+
+            if ( not transfer_.empty() ) {
+                stages_.at( i + 1 )->read_packets( transfer_ );
+                stage_wait = stage.wait_time();
+            }
+        }
+
+        ret = min( ret, stage_wait );
+    }
+
+    return ret;
+}
+
+bool StageChain::finished( void ) const
+{
+    for ( const auto & stage : stages_ ) {
+        if ( stage->finished() ) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,46 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef STAGE_CHAIN_HH
+#define STAGE_CHAIN_HH
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include "packet_stage.hh"
+
+/* The ferry queue of mm-net: a chain of stages in one process, where
+   each stage's output is handed to the next as packet buffers, without
+   a trip through the kernel. Packets enter the first stage and leave
+   from the last. */
+class StageChain
+{
+public:
+    /* stages are made in the ferry process, after privileges are dropped */
+    typedef std::function<std::unique_ptr<PacketStage>( void )> StageMaker;
+
+private:
+    std::vector< std::unique_ptr<PacketStage> > stages_;
+
+    /* packets on their way from one stage to the next */
+    std::vector<PacketBuffer> transfer_;
+
+public:
+    StageChain( const std::vector<StageMaker> & stage_makers );
+
+    /* take every packet read in one wakeup (leaves batch empty) */
+    void read_packets( std::vector<PacketBuffer> & batch );
+
+    void write_packets( FileDescriptor & fd );
+
+    /* move packets along the chain, then return the nanoseconds
+       until any stage has something to do */
+    uint64_t wait_time( void );
+
+    bool pending_output( void ) const { return stages_.back()->pending_output(); }
+
+    bool finished( void ) const;
+};
+
+#endif /* STAGE_CHAIN_HH */
@@ -0,0 +1,38 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/stat.h>
+#include <cstdio>
+#include <iostream>
+
+#include "compiled_trace.hh"
+#include "temp_file.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* compile a packet-delivery trace for mm-link, which maps it instead of parsing it */
+
+int main( int argc, char *argv[] )
+{
+    try {
+        if ( argc != 3 ) {
+            throw runtime_error( "Usage: " + string( argv[ 0 ] ) + " TRACE COMPILED_TRACE" );
+        }
+
+        const CompiledTrace trace( argv[ 1 ] );
+
+        /* replace the output in one step: other shells may have the old version mapped */
+        UniqueFile output( argv[ 2 ] );
+        output.write( trace.serialized() );
+        SystemCall( "fchmod", fchmod( output.fd().fd_num(), 00644 ) );
+        SystemCall( "rename", rename( output.name().c_str(), argv[ 2 ] ) );
+
+        cerr << argv[ 1 ] << ": " << trace.opportunities() << " delivery opportunities in "
+             << trace.runs() << " runs, " << trace.serialized().size() << " bytes compiled" << endl;
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -16,8 +16,14 @@ private:
 
     bool moved_away_;
 
+    /* write the configuration file and start apache */
+    void start( const std::string & main_config, const Address & addr,
+                const std::string & working_directory, const std::string & record_path,
+                const std::string & extra_config );
+
 public:
     WebServer( const Address & addr, const std::string & working_directory, const std::string & record_path );
+    WebServer( const Address & addr, const std::string & working_directory, const std::string & record_path, const Address & replay_index );
     WebServer( const Address & addr, const std::string & working_directory, const std::string & record_path, const std::string & type );
     ~WebServer();
 
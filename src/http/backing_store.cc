@@ -11,14 +11,9 @@ HTTPDiskStore::HTTPDiskStore( const string & record_folder )
       mutex_()
 {}
 
-void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_address )
+static MahimahiProtobufs::RequestResponse to_record( const HTTPResponse & response,
+                                                     const Address & server_address )
 {
-    unique_lock<mutex> ul( mutex_ );
-
-    /* output file to write current request/response pair protobuf (user has all permissions) */
-    UniqueFile file( record_folder_ + "save" );
-
-    /* construct protocol buffer */
     MahimahiProtobufs::RequestResponse output;
 
     output.set_ip( server_address.ip() );
@@ -29,8 +24,33 @@ void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_
     output.mutable_request()->CopyFrom( response.request().toprotobuf() );
     output.mutable_response()->CopyFrom( response.toprotobuf() );
 
+    return output;
+}
+
+void HTTPDiskStore::save( const HTTPResponse & response, const Address & server_address )
+{
+    /* construct protocol buffer */
+    const MahimahiProtobufs::RequestResponse output = to_record( response, server_address );
+
+    unique_lock<mutex> ul( mutex_ );
+
+    /* output file to write current request/response pair protobuf (user has all permissions) */
+    UniqueFile file( record_folder_ + "save" );
+
     if ( not output.SerializeToFileDescriptor( file.fd().fd_num() ) ) {
         throw runtime_error( "save_to_disk: failure to serialize HTTP request/response pair" );
     }
+}
 
+HTTPArchiveStore::HTTPArchiveStore( const string & archive_filename )
+    : writer_( archive_filename ),
+      mutex_()
+{}
+
+void HTTPArchiveStore::save( const HTTPResponse & response, const Address & server_address )
+{
+    const MahimahiProtobufs::RequestResponse output = to_record( response, server_address );
+
+    unique_lock<mutex> ul( mutex_ );
+    writer_.append( output );
 }
@@ -9,6 +9,7 @@
 #include "http_request.hh"
 #include "http_response.hh"
 #include "address.hh"
+#include "recording_archive.hh"
 
 /* abstract base class to store an HTTP request/response from a particular server address */
 class HTTPBackingStore
@@ -29,4 +30,16 @@ public:
     void save( const HTTPResponse & response, const Address & server_address ) override;
 };
 
+/* appends every request/response to a single recording archive */
+class HTTPArchiveStore : public HTTPBackingStore
+{
+private:
+    ArchiveWriter writer_;
+    std::mutex mutex_;
+
+public:
+    HTTPArchiveStore( const std::string & archive_filename );
+    void save( const HTTPResponse & response, const Address & server_address ) override;
+};
+
 #endif /* BACKING_STORE_HH */
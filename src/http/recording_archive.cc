@@ -0,0 +1,227 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <endian.h>
+
+#include <cstring>
+#include <limits>
+
+#include "recording_archive.hh"
+#include "util.hh"
+#include "exception.hh"
+
+using namespace std;
+
+static const string ARCHIVE_MAGIC = "MMARCHV1";
+static const string INDEX_MAGIC = "MMINDEX1";
+
+/* index offset, record count, index magic */
+static const size_t TRAILER_SIZE = 2 * sizeof( uint64_t ) + 8;
+
+static string le32( const uint32_t value )
+{
+    const uint32_t encoded = htole32( value );
+    return string( reinterpret_cast<const char *>( &encoded ), sizeof( encoded ) );
+}
+
+static string le64( const uint64_t value )
+{
+    const uint64_t encoded = htole64( value );
+    return string( reinterpret_cast<const char *>( &encoded ), sizeof( encoded ) );
+}
+
+static uint32_t read_le32( const char * data )
+{
+    uint32_t encoded;
+    memcpy( &encoded, data, sizeof( encoded ) );
+    return le32toh( encoded );
+}
+
+static uint64_t read_le64( const char * data )
+{
+    uint64_t encoded;
+    memcpy( &encoded, data, sizeof( encoded ) );
+    return le64toh( encoded );
+}
+
+ArchiveWriter::ArchiveWriter( const string & filename )
+    : fd_( SystemCall( "open " + filename,
+                       open( filename.c_str(), O_WRONLY | O_CREAT | O_EXCL, 00600 ) ) ),
+      offsets_(),
+      position_( 0 ),
+      finished_( false )
+{
+    fd_.write( ARCHIVE_MAGIC );
+    position_ = ARCHIVE_MAGIC.size();
+}
+
+void ArchiveWriter::append( const MahimahiProtobufs::RequestResponse & record )
+{
+    if ( finished_ ) {
+        throw runtime_error( "ArchiveWriter: archive already finished" );
+    }
+
+    string serialized;
+    if ( not record.SerializeToString( &serialized ) ) {
+        throw runtime_error( "ArchiveWriter: failure to serialize HTTP request/response pair" );
+    }
+
+    if ( serialized.size() > numeric_limits<uint32_t>::max() ) {
+        throw runtime_error( "ArchiveWriter: HTTP request/response pair too large" );
+    }
+
+    /* one write per record, so a crash leaves at most one partial record at the end */
+    fd_.write( le32( serialized.size() ) + serialized );
+
+    offsets_.push_back( position_ );
+    position_ += sizeof( uint32_t ) + serialized.size();
+}
+
+void ArchiveWriter::finish( void )
+{
+    if ( finished_ ) {
+        return;
+    }
+
+    string index;
+    index.reserve( offsets_.size() * sizeof( uint64_t ) + TRAILER_SIZE );
+
+    for ( const auto & offset : offsets_ ) {
+        index += le64( offset );
+    }
+
+    index += le64( position_ ) + le64( offsets_.size() ) + INDEX_MAGIC;
+
+    fd_.write( index );
+    finished_ = true;
+}
+
+ArchiveWriter::~ArchiveWriter()
+{
+    try {
+        finish();
+    } catch ( const exception & e ) { /* don't throw from destructor */
+        print_exception( e );
+    }
+}
+
+ArchiveReader::ArchiveReader( const string & filename )
+    : file_( filename ),
+      records_()
+{
+    if ( file_.size() < ARCHIVE_MAGIC.size()
+         or ARCHIVE_MAGIC.compare( 0, string::npos, file_.data(), ARCHIVE_MAGIC.size() ) != 0 ) {
+        throw runtime_error( filename + ": not a mahimahi recording archive" );
+    }
+
+    if ( not read_index() ) {
+        /* writer never finished: recover whatever complete records there are */
+        scan_records();
+    }
+}
+
+/* returns false if the archive has no index */
+bool ArchiveReader::read_index( void )
+{
+    const char * const data = file_.data();
+    const size_t size = file_.size();
+
+    if ( size < ARCHIVE_MAGIC.size() + TRAILER_SIZE
+         or INDEX_MAGIC.compare( 0, string::npos, data + size - INDEX_MAGIC.size(), INDEX_MAGIC.size() ) != 0 ) {
+        return false;
+    }
+
+    const char * const trailer = data + size - TRAILER_SIZE;
+    const uint64_t index_offset = read_le64( trailer );
+    const uint64_t count = read_le64( trailer + sizeof( uint64_t ) );
+
+    if ( index_offset < ARCHIVE_MAGIC.size()
+         or index_offset > size - TRAILER_SIZE
+         or count != ( size - TRAILER_SIZE - index_offset ) / sizeof( uint64_t )
+         or ( size - TRAILER_SIZE - index_offset ) % sizeof( uint64_t ) ) {
+        throw runtime_error( "ArchiveReader: corrupt index" );
+    }
+
+    records_.reserve( count );
+
+    for ( uint64_t i = 0; i < count; i++ ) {
+        const uint64_t offset = read_le64( data + index_offset + i * sizeof( uint64_t ) );
+        if ( offset < ARCHIVE_MAGIC.size() or offset + sizeof( uint32_t ) > index_offset ) {
+            throw runtime_error( "ArchiveReader: corrupt index" );
+        }
+
+        const uint32_t length = read_le32( data + offset );
+        if ( offset + sizeof( uint32_t ) + length > index_offset ) {
+            throw runtime_error( "ArchiveReader: corrupt index" );
+        }
+
+        records_.emplace_back( offset + sizeof( uint32_t ), length );
+    }
+
+    return true;
+}
+
+void ArchiveReader::scan_records( void )
+{
+    const char * const data = file_.data();
+    const size_t size = file_.size();
+
+    uint64_t offset = ARCHIVE_MAGIC.size();
+
+    while ( offset + sizeof( uint32_t ) <= size ) {
+        const uint32_t length = read_le32( data + offset );
+        if ( offset + sizeof( uint32_t ) + length > size ) {
+            break; /* partial record at the end */
+        }
+
+        records_.emplace_back( offset + sizeof( uint32_t ), length );
+        offset += sizeof( uint32_t ) + length;
+    }
+}
+
+MahimahiProtobufs::RequestResponse ArchiveReader::record( const size_t index ) const
+{
+    const auto & location = records_.at( index );
+
+    MahimahiProtobufs::RequestResponse ret;
+    if ( not ret.ParseFromArray( file_.data() + location.first, location.second ) ) {
+        throw runtime_error( "ArchiveReader: invalid HTTP request/response at record " + to_string( index ) );
+    }
+
+    return ret;
+}
+
+bool is_recording_archive( const string & path )
+{
+    struct stat info;
+    SystemCall( "stat " + path, stat( path.c_str(), &info ) );
+    return S_ISREG( info.st_mode );
+}
+
+void load_recording( const string & path,
+                     const function<void(const MahimahiProtobufs::RequestResponse &)> & callback )
+{
+    if ( is_recording_archive( path ) ) {
+        const ArchiveReader archive( path );
+        for ( size_t i = 0; i < archive.size(); i++ ) {
+            callback( archive.record( i ) );
+        }
+        return;
+    }
+
+    /* directory with one file per request/response */
+    const vector< string > files = list_directory_contents( path.back() == '/' ? path : path + "/" );
+
+    for ( const auto & filename : files ) {
+        if ( filename.find( "save" ) != string::npos ) { // Only load the recorded save files
+            FileDescriptor fd( SystemCall( "open", open( filename.c_str(), O_RDONLY ) ) );
+            MahimahiProtobufs::RequestResponse record;
+            if ( not record.ParseFromFileDescriptor( fd.fd_num() ) ) {
+                throw runtime_error( filename + ": invalid HTTP request/response" );
+            }
+
+            callback( record );
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef RECORDING_ARCHIVE_HH
+#define RECORDING_ARCHIVE_HH
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "file_descriptor.hh"
+#include "mapped_file.hh"
+#include "http_record.pb.h"
+
+/* A recording archive holds a whole recorded session in one file:
+
+     "MMARCHV1"
+     record*               (little-endian uint32 length, then a serialized RequestResponse)
+     index                 (little-endian uint64 offset of each record)
+     uint64 index offset, uint64 record count, "MMINDEX1"
+
+   The index is written when the archive is finished. An archive whose
+   writer never finished is still readable by scanning the records. */
+
+class ArchiveWriter
+{
+private:
+    FileDescriptor fd_;
+    std::vector<uint64_t> offsets_;
+    uint64_t position_;
+    bool finished_;
+
+public:
+    /* refuses to overwrite an existing file */
+    ArchiveWriter( const std::string & filename );
+    ~ArchiveWriter();
+
+    void append( const MahimahiProtobufs::RequestResponse & record );
+
+    /* write the index (if not already written); no records may be appended afterwards */
+    void finish( void );
+
+    /* ban copying */
+    ArchiveWriter( const ArchiveWriter & other ) = delete;
+    ArchiveWriter & operator=( const ArchiveWriter & other ) = delete;
+};
+
+class ArchiveReader
+{
+private:
+    MappedFile file_;
+
+    /* offset and length of each serialized record */
+    std::vector< std::pair<uint64_t, uint32_t> > records_;
+
+    bool read_index( void );
+    void scan_records( void );
+
+public:
+    ArchiveReader( const std::string & filename );
+
+    size_t size( void ) const { return records_.size(); }
+
+    MahimahiProtobufs::RequestResponse record( const size_t index ) const;
+};
+
+/* does this path name an archive (rather than a recording directory)? */
+bool is_recording_archive( const std::string & path );
+
+/* call back with every saved request/response, from an archive or a recording directory */
+void load_recording( const std::string & path,
+                     const std::function<void(const MahimahiProtobufs::RequestResponse &)> & callback );
+
+#endif /* RECORDING_ARCHIVE_HH */
@@ -0,0 +1,98 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "replay_index.hh"
+#include "recording_archive.hh"
+
+using namespace std;
+
+ReplayIndex::ReplayIndex( const string & recording )
+{
+    load_recording( recording,
+                    [&] ( const MahimahiProtobufs::RequestResponse & record ) { add( record ); } );
+}
+
+string ReplayIndex::strip_query( const string & request_line )
+{
+    const auto index = request_line.find( "?" );
+    if ( index == string::npos ) {
+        return request_line;
+    } else {
+        return request_line.substr( 0, index );
+    }
+}
+
+/* a missing Host header is distinct from an empty one */
+string ReplayIndex::bucket_key( const bool is_https, const HTTPRequest & request )
+{
+    string key = is_https ? "https " : "http ";
+
+    if ( request.has_header( "Host" ) ) {
+        key += "+" + request.get_header_value( "Host" );
+    } else {
+        key += "-";
+    }
+
+    return key + " " + strip_query( request.first_line() );
+}
+
+void ReplayIndex::add( const MahimahiProtobufs::RequestResponse & record )
+{
+    /* (an unset scheme reads as HTTP, its first value, as it always has) */
+    const bool is_https = record.scheme() == MahimahiProtobufs::RequestResponse_Scheme_HTTPS;
+
+    buckets_[ bucket_key( is_https, HTTPRequest( record.request() ) ) ].push_back( record );
+    size_++;
+}
+
+/* does the header exist in both requests with the same value, or in neither? */
+static bool header_match( const string & header_name,
+                          const HTTPRequest & request,
+                          const HTTPRequest & saved_request )
+{
+    if ( request.has_header( header_name ) != saved_request.has_header( header_name ) ) {
+        return false;
+    }
+
+    return ( not request.has_header( header_name ) )
+        or ( request.get_header_value( header_name ) == saved_request.get_header_value( header_name ) );
+}
+
+const MahimahiProtobufs::RequestResponse * ReplayIndex::find( const HTTPRequest & request,
+                                                              const bool is_https ) const
+{
+    const auto bucket = buckets_.find( bucket_key( is_https, request ) );
+    if ( bucket == buckets_.end() ) {
+        return nullptr;
+    }
+
+    const string & request_line = request.first_line();
+
+    unsigned int best_score = 0;
+    const MahimahiProtobufs::RequestResponse * best_match = nullptr;
+
+    /* scheme, host, and request line up to "?" are already known to match */
+    for ( const auto & record : bucket->second ) {
+        const HTTPRequest saved_request( record.request() );
+
+        /* match user agent */
+        if ( not header_match( "User-Agent", request, saved_request ) ) {
+            continue;
+        }
+
+        /* score is the size of the common prefix */
+        const string & saved_line = saved_request.first_line();
+        const auto max_match = min( request_line.size(), saved_line.size() );
+        unsigned int score = 0;
+        while ( score < max_match and request_line.at( score ) == saved_line.at( score ) ) {
+            score++;
+        }
+
+        /* on a tie, the first record loaded wins */
+        if ( score > best_score ) {
+            best_match = &record;
+            best_score = score;
+        }
+    }
+
+    return best_match;
+}
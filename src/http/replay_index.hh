@@ -0,0 +1,43 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef REPLAY_INDEX_HH
+#define REPLAY_INDEX_HH
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "http_request.hh"
+#include "http_record.pb.h"
+
+/* in-memory index of a recorded site, loaded once and queried per request */
+
+/* records are bucketed by scheme, Host header, and request line up to
+   the "?", so only candidates that could possibly match are scored */
+class ReplayIndex
+{
+private:
+    std::unordered_map< std::string, std::vector< MahimahiProtobufs::RequestResponse > > buckets_ {};
+    size_t size_ { 0 };
+
+    static std::string bucket_key( const bool is_https, const HTTPRequest & request );
+
+public:
+    ReplayIndex() {}
+
+    /* load every saved request/response pair in a recording directory or archive */
+    ReplayIndex( const std::string & recording );
+
+    void add( const MahimahiProtobufs::RequestResponse & record );
+
+    /* the stored record that best matches the request, or nullptr if none matches */
+    const MahimahiProtobufs::RequestResponse * find( const HTTPRequest & request,
+                                                     const bool is_https ) const;
+
+    size_t size( void ) const { return size_; }
+
+    /* strip the query string (everything from the "?") from a request line */
+    static std::string strip_query( const std::string & request_line );
+};
+
+#endif /* REPLAY_INDEX_HH */
@@ -0,0 +1,158 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <thread>
+
+#include "http_replay_server.hh"
+#include "http_request_parser.hh"
+#include "http_response.hh"
+#include "poller.hh"
+#include "event_loop.hh"
+#include "tokenize.hh"
+#include "exception.hh"
+
+using namespace std;
+using namespace PollerShortNames;
+
+HTTPReplayServer::HTTPReplayServer( const vector< Address > & addresses, const ReplayIndex & index )
+    : listeners_(),
+      index_( index ),
+      server_context_( SERVER )
+{
+    listeners_.reserve( addresses.size() );
+
+    for ( const auto & addr : addresses ) {
+        TCPSocket listener;
+        listener.set_reuseaddr();
+        listener.bind( addr );
+        listener.listen( 128 );
+        listeners_.emplace_back( move( listener ), addr.port() == 443 );
+    }
+}
+
+static bool connection_header_is( const HTTPMessage & message, const string & value )
+{
+    return message.has_header( "Connection" )
+        and HTTPMessage::equivalent_strings( message.get_header_value( "Connection" ), value );
+}
+
+/* can the client find the end of this response without waiting for us to close? */
+static bool body_is_delimited( const HTTPResponse & response, const HTTPRequest & request )
+{
+    const auto tokens = split( response.first_line(), " " );
+    if ( tokens.size() < 2 or tokens.at( 1 ).empty() ) {
+        return false;
+    }
+
+    const string & status = tokens.at( 1 );
+    if ( status.at( 0 ) == '1' or status == "204" or status == "304" or request.is_head() ) {
+        return true;
+    }
+
+    if ( response.has_header( "Transfer-Encoding" ) ) {
+        return HTTPMessage::equivalent_strings( split( response.get_header_value( "Transfer-Encoding" ), "," ).back(),
+                                                "chunked" );
+    }
+
+    return response.has_header( "Content-Length" );
+}
+
+string HTTPReplayServer::response_for( const HTTPRequest & request, const bool is_https,
+                                       bool & keep_alive ) const
+{
+    /* HTTP/1.1 connections persist unless the client asks otherwise; HTTP/1.0 the reverse */
+    const auto & first_line = request.first_line();
+    const bool is_http_1_1 = first_line.size() >= 8
+        and first_line.compare( first_line.size() - 8, 8, "HTTP/1.1" ) == 0;
+
+    keep_alive = is_http_1_1 ? not connection_header_is( request, "close" )
+                             : connection_header_is( request, "keep-alive" );
+
+    const auto match = index_.find( request, is_https );
+
+    if ( not match ) {
+        const string body = "replayserver: could not find a match for " + first_line + CRLF;
+        return "HTTP/1.1 404 Not Found" + CRLF
+            + "Content-Type: text/plain" + CRLF
+            + "Content-Length: " + to_string( body.size() ) + CRLF
+            + ( keep_alive ? "" : "Connection: close" + CRLF )
+            + CRLF + body;
+    }
+
+    const HTTPResponse response( match->response() );
+
+    keep_alive = keep_alive
+        and body_is_delimited( response, request )
+        and not connection_header_is( response, "close" );
+
+    return response.str();
+}
+
+template <class SocketType>
+void HTTPReplayServer::serve( SocketType & client, const bool is_https )
+{
+    Poller poller;
+
+    HTTPRequestParser request_parser;
+
+    /* set once a response that ends the connection has been sent */
+    bool closing = false;
+
+    /* requests from client go to request parser */
+    poller.add_action( Poller::Action( client, Direction::In,
+                                       [&] () {
+                                           request_parser.parse( client.read() );
+                                           return ResultType::Continue;
+                                       },
+                                       [&] () { return not closing; } ) );
+
+    /* completed requests are answered in order */
+    poller.add_action( Poller::Action( client, Direction::Out,
+                                       [&] () {
+                                           bool keep_alive;
+                                           client.write( response_for( request_parser.front(), is_https, keep_alive ) );
+                                           request_parser.pop();
+                                           closing = not keep_alive;
+                                           return ResultType::Continue;
+                                       },
+                                       [&] () { return (not closing) and (not request_parser.empty()); } ) );
+
+    while ( true ) {
+        if ( poller.poll( -1 ).result == Poller::Result::Type::Exit ) {
+            return;
+        }
+    }
+}
+
+void HTTPReplayServer::handle_tcp( TCPSocket & listener, const bool is_https )
+{
+    thread newthread( [&, is_https] ( TCPSocket client ) {
+            try {
+                if ( not is_https ) {
+                    return serve( client, false );
+                }
+
+                /* handle TLS */
+                SecureSocket tls_client( server_context_.new_secure_socket( move( client ) ) );
+                tls_client.accept();
+
+                serve( tls_client, true );
+            } catch ( const exception & e ) {
+                print_exception( e );
+            }
+        }, listener.accept() );
+
+    /* don't wait around for the connection to finish */
+    newthread.detach();
+}
+
+/* register every listener with the given event_loop */
+void HTTPReplayServer::register_handlers( EventLoop & event_loop )
+{
+    for ( auto & listener : listeners_ ) {
+        event_loop.add_simple_input_handler( listener.first,
+                                             [&] () {
+                                                 handle_tcp( listener.first, listener.second );
+                                                 return ResultType::Continue;
+                                             } );
+    }
+}
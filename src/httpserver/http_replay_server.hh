@@ -0,0 +1,46 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef HTTP_REPLAY_SERVER_HH
+#define HTTP_REPLAY_SERVER_HH
+
+#include <vector>
+#include <utility>
+
+#include "socket.hh"
+#include "secure_socket.hh"
+#include "replay_index.hh"
+
+class EventLoop;
+
+/* serves a recorded site from a ReplayIndex on every recorded
+   address at once, in place of one apache instance per address */
+class HTTPReplayServer
+{
+private:
+    /* listening socket, and whether connections to it speak TLS */
+    std::vector< std::pair< TCPSocket, bool > > listeners_;
+
+    const ReplayIndex & index_;
+
+    SSLContext server_context_;
+
+    /* the best match for a request (or a 404), and whether
+       the connection can stay open after sending it */
+    std::string response_for( const HTTPRequest & request, const bool is_https,
+                              bool & keep_alive ) const;
+
+    template <class SocketType>
+    void serve( SocketType & client, const bool is_https );
+
+    void handle_tcp( TCPSocket & listener, const bool is_https );
+
+public:
+    /* binds every address (connections to port 443 use TLS); index is
+       captured and must continue to persist */
+    HTTPReplayServer( const std::vector< Address > & addresses, const ReplayIndex & index );
+
+    /* register every listener with the given event_loop */
+    void register_handlers( EventLoop & event_loop );
+};
+
+#endif /* HTTP_REPLAY_SERVER_HH */
@@ -22,6 +22,10 @@ public:
 
     virtual unsigned int size_bytes( void ) const = 0;
     virtual unsigned int size_packets( void ) const = 0;
+
+    /* packets marked Congestion Experienced instead of being dropped
+       (with ECN enabled), so far */
+    virtual uint64_t marked_packets( void ) const { return 0; }
 };
 
 #endif /* ABSTRACT_PACKET_QUEUE */ 
@@ -0,0 +1,45 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "batch_counter.hh"
+
+using namespace std;
+
+BatchCounter::BatchCounter( const size_t max_batch_size )
+    : wakeups_( max_batch_size + 1 )
+{}
+
+void BatchCounter::record( const size_t batch_size )
+{
+    wakeups_.at( batch_size )++;
+}
+
+uint64_t BatchCounter::wakeups( void ) const
+{
+    uint64_t total = 0;
+    for ( const auto & count : wakeups_ ) {
+        total += count;
+    }
+    return total;
+}
+
+uint64_t BatchCounter::packets( void ) const
+{
+    uint64_t total = 0;
+    for ( size_t size = 0; size < wakeups_.size(); size++ ) {
+        total += size * wakeups_[ size ];
+    }
+    return total;
+}
+
+string BatchCounter::summary( void ) const
+{
+    string ret = to_string( packets() ) + " packets in " + to_string( wakeups() ) + " wakeups, batch sizes:";
+
+    for ( size_t size = 0; size < wakeups_.size(); size++ ) {
+        if ( wakeups_[ size ] ) {
+            ret += " " + to_string( size ) + "x" + to_string( wakeups_[ size ] );
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,29 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef BATCH_COUNTER_HH
+#define BATCH_COUNTER_HH
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+/* distribution of how many packets were read per wakeup,
+   i.e. how many per-packet wakeups batching saved */
+class BatchCounter
+{
+private:
+    std::vector<uint64_t> wakeups_; /* indexed by batch size */
+
+public:
+    BatchCounter( const size_t max_batch_size );
+
+    void record( const size_t batch_size );
+
+    uint64_t wakeups( void ) const;
+    uint64_t packets( void ) const;
+
+    /* one-line report, e.g. "100 packets in 40 wakeups, batch sizes: 1x20 2x10 4x10" */
+    std::string summary( void ) const;
+};
+
+#endif /* BATCH_COUNTER_HH */
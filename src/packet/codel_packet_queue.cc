@@ -1,14 +1,14 @@
 #include <math.h>
 #include "codel_packet_queue.hh"
-#include "timestamp.hh"
 
 
 using namespace std;
 
-CODELPacketQueue::CODELPacketQueue( const string & args )
+CODELPacketQueue::CODELPacketQueue( const string & args, const Clock & clock )
   : DroppingPacketQueue(args),
-    target_ ( get_arg( args, "target") ),
-    interval_ ( get_arg( args, "interval") ),
+    clock_ ( clock ),
+    target_ ( get_arg( args, "target") * NS_PER_MS ),
+    interval_ ( get_arg( args, "interval") * NS_PER_MS ),
     first_above_time_ ( 0 ),
     drop_next_( 0 ),
     count_ ( 0 ),
@@ -61,7 +61,7 @@ uint64_t CODELPacketQueue::control_law ( uint64_t t, uint32_t count )
 
 QueuedPacket CODELPacketQueue::dequeue( void )
 {   
-  const uint64_t now = timestamp();
+  const uint64_t now = clock_.now_ns();
   dodequeue_result r = std::move( dodequeue ( now ) );
   uint32_t delta;
     
@@ -71,8 +71,14 @@ QueuedPacket CODELPacketQueue::dequeue( void )
     }
 
     while ( now >= drop_next_ && dropping_ ) {
-      dodequeue_result r = std::move( dodequeue ( now ) );
       count_++;
+      //With ECN, mark the packet instead of dropping it, and send it.
+      if ( mark( r.p ) ) {
+	drop_next_ = control_law(drop_next_, count_);
+	break;
+      }
+      //Drop the packet and take the next one.
+      r = std::move( dodequeue ( now ) );
       if ( ! r.ok_to_drop ) {
 	dropping_ = false;
       } else {
@@ -81,7 +87,9 @@ QueuedPacket CODELPacketQueue::dequeue( void )
     }
   }
   else if ( r.ok_to_drop ) {
-    dodequeue_result r = std::move( dodequeue ( now ) );
+    if ( ! mark( r.p ) ) {
+      r = std::move( dodequeue ( now ) );
+    }
     dropping_ = true;
     delta = count_ - lastcount_;
     count_ = ( ( delta > 1 ) && ( now - drop_next_ < 16 * interval_ ))? 
@@ -90,7 +98,7 @@ QueuedPacket CODELPacketQueue::dequeue( void )
     lastcount_ = count_;
   }
 
-  return r.p;
+  return std::move( r.p );
 }
 
 
@@ -5,13 +5,14 @@
 
 #include <random>
 #include "dropping_packet_queue.hh"
+#include "clock.hh"
 
 struct dodequeue_result {
     QueuedPacket p;
     bool ok_to_drop;
 
     dodequeue_result ( )
-        : p ( "", 0 ), ok_to_drop ( false )
+        : p ( PacketBuffer(), 0 ), ok_to_drop ( false )
     {}
 };
 
@@ -22,12 +23,15 @@ struct dodequeue_result {
    Contributed by
       Joseph D. Beshay <joseph.beshay@utdallas.edu>
 */
-class CODELPacketQueue : public DroppingPacketQueue
+class CODELPacketQueue final : public DroppingPacketQueue
 {
 private:
     const static unsigned int PACKET_SIZE = 1504;
-    //Configuration parameters
-    uint32_t target_, interval_;
+    //Source of the current time (real or simulated)
+    const Clock & clock_;
+
+    //Configuration parameters (given in ms, kept in ns)
+    uint64_t target_, interval_;
 
     //State variables
     uint64_t first_above_time_, drop_next_;
@@ -45,7 +49,7 @@ private:
     uint64_t control_law ( uint64_t t, uint32_t count );
 
 public:
-    CODELPacketQueue( const std::string & args );
+    CODELPacketQueue( const std::string & args, const Clock & clock );
 
     void enqueue( QueuedPacket && p ) override;
 
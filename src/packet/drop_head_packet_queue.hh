@@ -5,7 +5,7 @@
 
 #include "dropping_packet_queue.hh"
 
-class DropHeadPacketQueue : public DroppingPacketQueue
+class DropHeadPacketQueue final : public DroppingPacketQueue
 {
 private:
     virtual const std::string & type( void ) const override
@@ -5,7 +5,7 @@
 
 #include "dropping_packet_queue.hh"
 
-class DropTailPacketQueue : public DroppingPacketQueue
+class DropTailPacketQueue final : public DroppingPacketQueue
 {
 private:
     virtual const std::string & type( void ) const override
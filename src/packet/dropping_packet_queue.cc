@@ -3,14 +3,37 @@
 #include <iostream>
 
 #include "dropping_packet_queue.hh"
+#include "ecn.hh"
 #include "exception.hh"
 #include "ezio.hh"
 
 using namespace std;
 
+/* typical full-size packet, for the number of packets a byte limit allows */
+static const unsigned int PACKET_SIZE = 1504;
+
+/* most slots allocated up front; a larger queue grows as it fills */
+static const unsigned int MAX_PREALLOCATED_SLOTS = 1 << 16;
+
+/* The most packets the queue can hold, plus one for the packet that
+   drophead accepts before dropping from the head. With only a byte
+   limit, this assumes full-size packets, and the queue grows if
+   small packets fill it further. */
+static size_t initial_capacity( const string & args )
+{
+    const unsigned int packet_limit = DroppingPacketQueue::get_arg( args, "packets" );
+    const unsigned int byte_limit = DroppingPacketQueue::get_arg( args, "bytes" );
+
+    const size_t packets = packet_limit ? packet_limit : byte_limit / PACKET_SIZE + 1;
+
+    return min( packets + 1, size_t( MAX_PREALLOCATED_SLOTS ) );
+}
+
 DroppingPacketQueue::DroppingPacketQueue( const string & args )
-    : packet_limit_( get_arg( args, "packets" ) ),
-      byte_limit_( get_arg( args, "bytes" ) )
+    : internal_queue_( initial_capacity( args ) ),
+      packet_limit_( get_arg( args, "packets" ) ),
+      byte_limit_( get_arg( args, "bytes" ) ),
+      ecn_( get_arg( args, "ecn" ) )
 {
     if ( packet_limit_ == 0 and byte_limit_ == 0 ) {
         throw runtime_error( "Dropping queue must have a byte or packet limit." );
@@ -21,8 +44,7 @@ QueuedPacket DroppingPacketQueue::dequeue( void )
 {
     assert( not internal_queue_.empty() );
 
-    QueuedPacket ret = std::move( internal_queue_.front() );
-    internal_queue_.pop();
+    QueuedPacket ret = internal_queue_.pop();
 
     queue_size_in_bytes_ -= ret.contents.size();
     queue_size_in_packets_--;
@@ -32,11 +54,6 @@ QueuedPacket DroppingPacketQueue::dequeue( void )
     return ret;
 }
 
-bool DroppingPacketQueue::empty( void ) const
-{
-    return internal_queue_.empty();
-}
-
 bool DroppingPacketQueue::good_with( const unsigned int size_in_bytes,
                                      const unsigned int size_in_packets ) const
 {
@@ -58,16 +75,14 @@ bool DroppingPacketQueue::good( void ) const
     return good_with( size_bytes(), size_packets() );
 }
 
-unsigned int DroppingPacketQueue::size_bytes( void ) const
+bool DroppingPacketQueue::mark( QueuedPacket & p )
 {
-    assert( queue_size_in_bytes_ >= 0 );
-    return unsigned( queue_size_in_bytes_ );
-}
+    if ( ecn_ and mark_congestion_experienced( p.contents ) ) {
+        marked_packets_++;
+        return true;
+    }
 
-unsigned int DroppingPacketQueue::size_packets( void ) const
-{
-    assert( queue_size_in_packets_ >= 0 );
-    return unsigned( queue_size_in_packets_ );
+    return false;
 }
 
 /* put a packet on the back of the queue */
@@ -75,7 +90,7 @@ void DroppingPacketQueue::accept( QueuedPacket && p )
 {
     queue_size_in_bytes_ += p.contents.size();
     queue_size_in_packets_++;
-    internal_queue_.emplace( std::move( p ) );
+    internal_queue_.push( std::move( p ) );
 }
 
 string DroppingPacketQueue::to_string( void ) const
@@ -94,6 +109,10 @@ string DroppingPacketQueue::to_string( void ) const
         ret += string( "packets=" ) + ::to_string( packet_limit_ );
     }
 
+    if ( ecn_ ) {
+        ret += ", ecn=1";
+    }
+
     ret += "]";
 
     return ret;
@@ -3,18 +3,20 @@
 #ifndef DROPPING_PACKET_QUEUE_HH
 #define DROPPING_PACKET_QUEUE_HH
 
-#include <queue>
 #include <cassert>
 
 #include "abstract_packet_queue.hh"
+#include "queued_packet_ring.hh"
 #include "exception.hh"
 
 class DroppingPacketQueue : public AbstractPacketQueue
 {
 private:
     int queue_size_in_bytes_ = 0, queue_size_in_packets_ = 0;
+    uint64_t marked_packets_ = 0;
 
-    std::queue<QueuedPacket> internal_queue_ {};
+    /* sized from the limits, so the queue doesn't allocate as it fills */
+    QueuedPacketRing internal_queue_;
 
     virtual const std::string & type( void ) const = 0;
 
@@ -22,6 +24,13 @@ protected:
     const unsigned int packet_limit_;
     const unsigned int byte_limit_;
 
+    /* mark ECN-capable packets instead of dropping them ("ecn=1") */
+    const bool ecn_;
+
+    /* with ECN enabled, mark a packet CE if it can be; true if it was,
+       and false if it has to be dropped */
+    bool mark( QueuedPacket & p );
+
     /* put a packet on the back of the queue */
     void accept( QueuedPacket && p );
 
@@ -37,14 +46,25 @@ public:
 
     QueuedPacket dequeue( void ) override;
 
-    bool empty( void ) const override;
+    bool empty( void ) const override { return internal_queue_.empty(); }
 
     std::string to_string( void ) const override;
 
     static unsigned int get_arg( const std::string & args, const std::string & name );
 
-    unsigned int size_bytes( void ) const override;
-    unsigned int size_packets( void ) const override;
+    unsigned int size_bytes( void ) const override
+    {
+        assert( queue_size_in_bytes_ >= 0 );
+        return unsigned( queue_size_in_bytes_ );
+    }
+
+    unsigned int size_packets( void ) const override
+    {
+        assert( queue_size_in_packets_ >= 0 );
+        return unsigned( queue_size_in_packets_ );
+    }
+
+    uint64_t marked_packets( void ) const override { return marked_packets_; }
 };
 
 #endif /* DROPPING_PACKET_QUEUE_HH */ 
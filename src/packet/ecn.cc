@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstdint>
+
+#include "ecn.hh"
+
+/* tun devices without IFF_NO_PI put two flag bytes and two protocol
+   bytes before each packet */
+static const size_t TUN_PI_SIZE = 4;
+
+static const uint8_t ECN_MASK = 0x03;
+static const uint8_t ECN_NOT_ECT = 0x00;
+static const uint8_t ECN_CE = 0x03;
+
+bool mark_congestion_experienced( PacketBuffer & packet )
+{
+    if ( packet.size() < TUN_PI_SIZE + 2 ) {
+        return false;
+    }
+
+    uint8_t * h = reinterpret_cast<uint8_t *>( packet.data() ) + TUN_PI_SIZE;
+    const size_t len = packet.size() - TUN_PI_SIZE;
+
+    if ( ( h[ 0 ] >> 4 ) == 4 ) {
+        if ( len < 20 ) {
+            return false;
+        }
+
+        /* the ECN field is the low two bits of the TOS byte */
+        const uint8_t ecn = h[ 1 ] & ECN_MASK;
+        if ( ecn == ECN_NOT_ECT ) {
+            return false;
+        } else if ( ecn == ECN_CE ) {
+            return true;
+        }
+
+        /* HC' = ~(~HC + ~m + m'), for the 16-bit word m holding the TOS
+           byte, in one's complement arithmetic */
+        const uint16_t old_word = h[ 0 ] << 8 | h[ 1 ];
+        h[ 1 ] |= ECN_CE;
+        const uint16_t new_word = h[ 0 ] << 8 | h[ 1 ];
+
+        uint32_t sum = uint16_t( ~( h[ 10 ] << 8 | h[ 11 ] ) );
+        sum += uint16_t( ~old_word );
+        sum += new_word;
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+        sum = ( sum & 0xffff ) + ( sum >> 16 );
+
+        const uint16_t checksum = ~sum;
+        h[ 10 ] = checksum >> 8;
+        h[ 11 ] = checksum & 0xff;
+
+        return true;
+    } else if ( ( h[ 0 ] >> 4 ) == 6 ) {
+        /* the traffic class straddles the first two bytes; its ECN
+           field is bits 4 and 5 of the second */
+        const uint8_t ecn = ( h[ 1 ] >> 4 ) & ECN_MASK;
+        if ( ecn == ECN_NOT_ECT ) {
+            return false;
+        }
+
+        h[ 1 ] |= ECN_CE << 4;
+        return true;
+    }
+
+    return false;
+}
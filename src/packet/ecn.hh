@@ -0,0 +1,17 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef ECN_HH
+#define ECN_HH
+
+#include "packet_buffer.hh"
+
+/* Explicit Congestion Notification (RFC 3168) for the AQM queues: if a
+   packet (as read from the tun device) is IPv4 or IPv6 and its sender
+   supports ECN (ECT(0) or ECT(1)), set its ECN field to CE (Congestion
+   Experienced), updating the IPv4 header checksum incrementally (RFC
+   1624), and return true. A packet already marked CE is left as it is
+   and also counts as marked. Otherwise, return false: the queue should
+   drop the packet instead. */
+bool mark_congestion_experienced( PacketBuffer & packet );
+
+#endif /* ECN_HH */
@@ -0,0 +1,129 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include "flow_key.hh"
+
+using namespace std;
+
+static_assert( sizeof( FlowKey ) == 40, "FlowKey must have no padding" );
+
+/* tun devices without IFF_NO_PI put two flag bytes and two protocol
+   bytes before each packet */
+static const size_t TUN_PI_SIZE = 4;
+
+bool FlowKey::parse( const char * packet, const size_t size, FlowKey & key )
+{
+    memset( &key, 0, sizeof( key ) );
+
+    if ( size < TUN_PI_SIZE + 1 ) {
+        return false;
+    }
+
+    const uint8_t * h = reinterpret_cast<const uint8_t *>( packet ) + TUN_PI_SIZE;
+    const size_t len = size - TUN_PI_SIZE;
+
+    uint8_t proto;
+    size_t l4_offset; /* start of the transport header */
+    bool first_fragment = true;
+
+    if ( ( h[ 0 ] >> 4 ) == 4 ) {
+        const size_t ihl = ( h[ 0 ] & 0x0f ) * 4;
+        if ( len < sizeof( struct iphdr ) or ihl < sizeof( struct iphdr ) or len < ihl ) {
+            return false;
+        }
+        const struct iphdr * iph = reinterpret_cast<const struct iphdr *>( h );
+
+        key.family = 4;
+        proto = iph->protocol;
+        memcpy( key.src, &iph->saddr, 4 );
+        memcpy( key.dst, &iph->daddr, 4 );
+        l4_offset = ihl;
+        first_fragment = ( ntohs( iph->frag_off ) & IP_OFFMASK ) == 0;
+    } else if ( ( h[ 0 ] >> 4 ) == 6 ) {
+        if ( len < 40 ) {
+            return false;
+        }
+
+        key.family = 6;
+        proto = h[ 6 ];
+        memcpy( key.src, h + 8, 16 );
+        memcpy( key.dst, h + 24, 16 );
+        l4_offset = 40;
+
+        /* walk the extension headers to the transport header */
+        while ( true ) {
+            if ( proto == IPPROTO_HOPOPTS or proto == IPPROTO_ROUTING or proto == IPPROTO_DSTOPTS ) {
+                if ( len < l4_offset + 2 ) {
+                    break;
+                }
+                proto = h[ l4_offset ];
+                l4_offset += ( h[ l4_offset + 1 ] + 1 ) * 8;
+            } else if ( proto == IPPROTO_FRAGMENT ) {
+                if ( len < l4_offset + 8 ) {
+                    break;
+                }
+                const uint16_t offset = ( h[ l4_offset + 2 ] << 8 | h[ l4_offset + 3 ] ) & 0xfff8;
+                first_fragment = first_fragment and offset == 0;
+                proto = h[ l4_offset ];
+                l4_offset += 8;
+            } else {
+                break;
+            }
+        }
+    } else {
+        return false;
+    }
+
+    key.proto = proto;
+
+    /* TCP and UDP headers both start with the ports */
+    if ( ( proto == IPPROTO_TCP or proto == IPPROTO_UDP )
+         and first_fragment and len >= l4_offset + 4 ) {
+        const uint8_t * ports = h + l4_offset;
+        key.sport = ports[ 0 ] << 8 | ports[ 1 ];
+        key.dport = ports[ 2 ] << 8 | ports[ 3 ];
+    }
+
+    return true;
+}
+
+uint64_t FlowKey::hash( void ) const
+{
+    uint64_t words[ 5 ];
+    memcpy( words, this, sizeof( words ) );
+
+    /* multiply-xorshift mixing (as in MurmurHash3's finalizer) */
+    uint64_t h = 0;
+    for ( const uint64_t w : words ) {
+        h = ( h ^ w ) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 32;
+    }
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+static string endpoint( const int family, const uint8_t * addr, const uint16_t port )
+{
+    char text[ INET6_ADDRSTRLEN ];
+    if ( inet_ntop( family, addr, text, sizeof( text ) ) == nullptr ) {
+        throw runtime_error( "Invalid IP address encountered!" );
+    }
+
+    if ( family == AF_INET6 ) {
+        return "[" + string( text ) + "]:" + to_string( port );
+    }
+    return string( text ) + ":" + to_string( port );
+}
+
+string FlowKey::str( void ) const
+{
+    const int af = family == 6 ? AF_INET6 : AF_INET;
+    return to_string( proto ) + " " + endpoint( af, src, sport ) + " " + endpoint( af, dst, dport );
+}
@@ -0,0 +1,34 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef FLOW_KEY_HH
+#define FLOW_KEY_HH
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/* A packet's flow: protocol, addresses and ports (zero if the protocol
+   has none, or for a fragment after the first). A plain struct with no
+   padding, so keys can be hashed and compared as bytes. */
+struct FlowKey
+{
+    uint8_t src[ 16 ]; /* network byte order; IPv4 uses the first 4 bytes */
+    uint8_t dst[ 16 ];
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+    uint8_t family; /* 4 or 6; 0 if not parsed */
+    uint16_t pad;   /* always zero */
+
+    /* the flow of a packet as read from the tun device (after its 4-byte
+       packet information header); false, leaving an all-zero key, if it
+       is not an IPv4 or IPv6 packet or is too short to parse */
+    static bool parse( const char * packet, const size_t size, FlowKey & key );
+
+    uint64_t hash( void ) const;
+
+    /* "proto src:sport dst:dport", with IPv6 addresses in brackets */
+    std::string str( void ) const;
+};
+
+#endif /* FLOW_KEY_HH */
@@ -0,0 +1,302 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cmath>
+#include <cassert>
+
+#include "fq_codel_packet_queue.hh"
+#include "dropping_packet_queue.hh"
+#include "flow_key.hh"
+#include "exception.hh"
+#include "ecn.hh"
+
+using namespace std;
+
+static unsigned int arg_or_default( const string & args, const string & name, const unsigned int value )
+{
+    const unsigned int ret = DroppingPacketQueue::get_arg( args, name );
+    return ret ? ret : value;
+}
+
+FQCODELPacketQueue::FQCODELPacketQueue( const string & args, const Clock & clock )
+    : clock_( clock ),
+      packet_limit_( DroppingPacketQueue::get_arg( args, "packets" ) ),
+      byte_limit_( DroppingPacketQueue::get_arg( args, "bytes" ) ),
+      quantum_( arg_or_default( args, "quantum", PACKET_SIZE ) ),
+      target_( arg_or_default( args, "target", 5 ) * NS_PER_MS ),
+      interval_( arg_or_default( args, "interval", 100 ) * NS_PER_MS ),
+      ecn_( DroppingPacketQueue::get_arg( args, "ecn" ) ),
+      flows_( arg_or_default( args, "flows", 1024 ) )
+{
+    /* the Linux default limit */
+    if ( packet_limit_ == 0 and byte_limit_ == 0 ) {
+        packet_limit_ = 10240;
+    }
+
+    if ( flows_.size() >= NIL ) {
+        throw runtime_error( "fq_codel queue: too many flows" );
+    }
+}
+
+void FQCODELPacketQueue::push_packet( Flow & flow, QueuedPacket && p )
+{
+    const unsigned int size = p.contents.size();
+    uint32_t index;
+
+    if ( free_nodes_ != NIL ) {
+        index = free_nodes_;
+        free_nodes_ = nodes_[ index ].next;
+        nodes_[ index ].packet = move( p );
+        nodes_[ index ].next = NIL;
+    } else {
+        assert( nodes_.size() < NIL );
+        index = nodes_.size();
+        nodes_.push_back( { move( p ), NIL } );
+    }
+
+    if ( flow.tail == NIL ) {
+        flow.head = index;
+    } else {
+        nodes_[ flow.tail ].next = index;
+    }
+    flow.tail = index;
+
+    flow.backlog += size;
+    size_bytes_ += size;
+    size_packets_++;
+}
+
+QueuedPacket FQCODELPacketQueue::pop_packet( Flow & flow )
+{
+    assert( flow.head != NIL );
+
+    const uint32_t index = flow.head;
+    flow.head = nodes_[ index ].next;
+    if ( flow.head == NIL ) {
+        flow.tail = NIL;
+    }
+
+    QueuedPacket ret = move( nodes_[ index ].packet );
+    nodes_[ index ].next = free_nodes_;
+    free_nodes_ = index;
+
+    flow.backlog -= ret.contents.size();
+    size_bytes_ -= ret.contents.size();
+    size_packets_--;
+
+    return ret;
+}
+
+void FQCODELPacketQueue::push_flow( FlowList & list, const uint32_t index )
+{
+    flows_[ index ].next = NIL;
+
+    if ( list.tail == NIL ) {
+        list.head = index;
+    } else {
+        flows_[ list.tail ].next = index;
+    }
+    list.tail = index;
+}
+
+void FQCODELPacketQueue::pop_flow( FlowList & list )
+{
+    assert( list.head != NIL );
+
+    list.head = flows_[ list.head ].next;
+    if ( list.head == NIL ) {
+        list.tail = NIL;
+    }
+}
+
+bool FQCODELPacketQueue::good( void ) const
+{
+    return ( packet_limit_ == 0 or size_packets_ <= packet_limit_ )
+        and ( byte_limit_ == 0 or size_bytes_ <= byte_limit_ );
+}
+
+/* drop packets from the head of the flow with the largest backlog, up
+   to half of it at once (so the search is not repeated for every
+   packet while a flow keeps overflowing the queue) */
+void FQCODELPacketQueue::drop_from_fattest_flow( void )
+{
+    Flow * fattest = &flows_.front();
+    for ( Flow & flow : flows_ ) {
+        if ( flow.backlog > fattest->backlog ) {
+            fattest = &flow;
+        }
+    }
+
+    const unsigned int threshold = fattest->backlog / 2;
+    unsigned int dropped = 0;
+
+    do {
+        pop_packet( *fattest );
+        dropped++;
+    } while ( fattest->head != NIL and fattest->backlog > threshold and dropped < MAX_DROP_BATCH );
+}
+
+bool FQCODELPacketQueue::mark( QueuedPacket & p )
+{
+    if ( ecn_ and mark_congestion_experienced( p.contents ) ) {
+        marked_packets_++;
+        return true;
+    }
+
+    return false;
+}
+
+void FQCODELPacketQueue::enqueue( QueuedPacket && p )
+{
+    FlowKey key;
+    FlowKey::parse( p.contents.data(), p.contents.size(), key );
+
+    const uint32_t index = key.hash() % flows_.size();
+    Flow & flow = flows_[ index ];
+
+    push_packet( flow, move( p ) );
+
+    if ( not flow.listed ) {
+        flow.listed = true;
+        flow.deficit = quantum_;
+        push_flow( new_flows_, index );
+    }
+
+    while ( not good() ) {
+        drop_from_fattest_flow();
+    }
+}
+
+/* as in CODELPacketQueue, for one flow's sub-queue */
+dodequeue_result FQCODELPacketQueue::dodequeue( Flow & flow, const uint64_t now )
+{
+    dodequeue_result r;
+    r.p = pop_packet( flow );
+    r.ok_to_drop = false;
+
+    if ( flow.head == NIL ) {
+        flow.first_above_time = 0;
+        return r;
+    }
+
+    const uint64_t sojourn_time = now - r.p.arrival_time;
+    if ( sojourn_time < target_ or flow.backlog <= PACKET_SIZE ) {
+        flow.first_above_time = 0;
+    } else if ( flow.first_above_time == 0 ) {
+        flow.first_above_time = now + interval_;
+    } else if ( now >= flow.first_above_time ) {
+        r.ok_to_drop = true;
+    }
+
+    return r;
+}
+
+uint64_t FQCODELPacketQueue::control_law( const uint64_t t, const uint32_t count ) const
+{
+    return t + uint64_t( interval_ / sqrt( count ) );
+}
+
+/* a packet from a nonempty flow, after dropping any that CoDel calls
+   for (it never drops a flow's last packet) */
+QueuedPacket FQCODELPacketQueue::codel_dequeue( Flow & flow, const uint64_t now )
+{
+    dodequeue_result r = dodequeue( flow, now );
+
+    if ( flow.dropping ) {
+        if ( not r.ok_to_drop ) {
+            flow.dropping = false;
+        }
+
+        while ( flow.dropping and now >= flow.drop_next ) {
+            flow.count++;
+
+            /* with ECN, mark the packet instead, and send it */
+            if ( mark( r.p ) ) {
+                flow.drop_next = control_law( flow.drop_next, flow.count );
+                break;
+            }
+
+            /* drop the packet and take the next */
+            r = dodequeue( flow, now );
+            if ( not r.ok_to_drop ) {
+                flow.dropping = false;
+            } else {
+                flow.drop_next = control_law( flow.drop_next, flow.count );
+            }
+        }
+    } else if ( r.ok_to_drop ) {
+        if ( not mark( r.p ) ) {
+            r = dodequeue( flow, now );
+        }
+        flow.dropping = true;
+        const uint32_t delta = flow.count - flow.lastcount;
+        flow.count = ( delta > 1 and now - flow.drop_next < 16 * interval_ ) ? delta : 1;
+        flow.drop_next = control_law( now, flow.count );
+        flow.lastcount = flow.count;
+    }
+
+    return move( r.p );
+}
+
+QueuedPacket FQCODELPacketQueue::dequeue( void )
+{
+    assert( not empty() );
+
+    const uint64_t now = clock_.now_ns();
+
+    while ( true ) {
+        FlowList & list = new_flows_.head != NIL ? new_flows_ : old_flows_;
+        const uint32_t index = list.head;
+        assert( index != NIL );
+        Flow & flow = flows_[ index ];
+
+        /* out of credit for this round: to the back of the old flows */
+        if ( flow.deficit <= 0 ) {
+            flow.deficit += quantum_;
+            pop_flow( list );
+            push_flow( old_flows_, index );
+            continue;
+        }
+
+        if ( flow.head == NIL ) {
+            pop_flow( list );
+            /* an emptied new flow goes through the old flows once, so a
+               flow cannot stay new by sending a packet at a time */
+            if ( &list == &new_flows_ and old_flows_.head != NIL ) {
+                push_flow( old_flows_, index );
+            } else {
+                flow.listed = false;
+            }
+            continue;
+        }
+
+        QueuedPacket p = codel_dequeue( flow, now );
+        flow.deficit -= p.contents.size();
+        return p;
+    }
+}
+
+string FQCODELPacketQueue::to_string( void ) const
+{
+    string ret = "fq_codel [";
+
+    if ( byte_limit_ ) {
+        ret += "bytes=" + ::to_string( byte_limit_ ) + ", ";
+    }
+
+    if ( packet_limit_ ) {
+        ret += "packets=" + ::to_string( packet_limit_ ) + ", ";
+    }
+
+    ret += "flows=" + ::to_string( flows_.size() )
+        + ", quantum=" + ::to_string( quantum_ )
+        + ", target=" + ::to_string( target_ / NS_PER_MS )
+        + ", interval=" + ::to_string( interval_ / NS_PER_MS );
+
+    if ( ecn_ ) {
+        ret += ", ecn=1";
+    }
+
+    ret += "]";
+
+    return ret;
+}
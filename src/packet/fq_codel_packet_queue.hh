@@ -0,0 +1,111 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef FQ_CODEL_PACKET_QUEUE_HH
+#define FQ_CODEL_PACKET_QUEUE_HH
+
+#include <vector>
+
+#include "abstract_packet_queue.hh"
+#include "codel_packet_queue.hh"
+#include "clock.hh"
+
+/*
+   Flow Queue CoDel (FQ-CoDel), after RFC 8290 and the fq_codel qdisc
+   in Linux 4.9. Packets are hashed by flow (protocol, addresses and
+   ports) into one of a fixed number of sub-queues, each with its own
+   CoDel state. The sub-queues are served by deficit round robin,
+   quantum bytes per round, with flows that have just become active
+   ("new flows") served before the rest ("old flows"). When the queue
+   is over its limit, packets are dropped from the head of the flow
+   with the largest backlog. With ECN enabled, CoDel marks packets
+   instead of dropping them where it can (overflow still drops).
+*/
+class FQCODELPacketQueue final : public AbstractPacketQueue
+{
+private:
+    const static unsigned int PACKET_SIZE = 1504;
+    const static uint32_t NIL = UINT32_MAX;
+
+    /* most packets dropped from the fattest flow at once */
+    const static unsigned int MAX_DROP_BATCH = 64;
+
+    //Source of the current time (real or simulated)
+    const Clock & clock_;
+
+    //Configuration parameters (target and interval given in ms, kept in ns)
+    unsigned int packet_limit_, byte_limit_;
+    unsigned int quantum_;
+    uint64_t target_, interval_;
+    bool ecn_; /* mark ECN-capable packets instead of dropping them */
+
+    /* a queued packet, in a flow's singly linked list */
+    struct Node
+    {
+        QueuedPacket packet;
+        uint32_t next;
+    };
+
+    struct Flow
+    {
+        uint32_t head = NIL, tail = NIL; /* packets, in nodes_ */
+        unsigned int backlog = 0;        /* bytes */
+
+        int deficit = 0;
+        uint32_t next = NIL; /* in new_flows_ or old_flows_ */
+        bool listed = false;
+
+        /* CoDel state */
+        uint64_t first_above_time = 0, drop_next = 0;
+        uint32_t count = 0, lastcount = 0;
+        bool dropping = false;
+    };
+
+    /* singly linked list of flows */
+    struct FlowList
+    {
+        uint32_t head = NIL, tail = NIL;
+    };
+
+    /* nodes are recycled through a free list, so the queue only
+       allocates when it holds more packets than ever before */
+    std::vector<Node> nodes_ {};
+    uint32_t free_nodes_ = NIL;
+
+    std::vector<Flow> flows_;
+    FlowList new_flows_ {}, old_flows_ {};
+
+    unsigned int size_bytes_ = 0, size_packets_ = 0;
+    uint64_t marked_packets_ = 0;
+
+    void push_packet( Flow & flow, QueuedPacket && p );
+    QueuedPacket pop_packet( Flow & flow );
+
+    void push_flow( FlowList & list, const uint32_t index );
+    void pop_flow( FlowList & list );
+
+    bool good( void ) const;
+    void drop_from_fattest_flow( void );
+    bool mark( QueuedPacket & p );
+
+    dodequeue_result dodequeue( Flow & flow, const uint64_t now );
+    uint64_t control_law( const uint64_t t, const uint32_t count ) const;
+    QueuedPacket codel_dequeue( Flow & flow, const uint64_t now );
+
+public:
+    FQCODELPacketQueue( const std::string & args, const Clock & clock );
+
+    void enqueue( QueuedPacket && p ) override;
+
+    QueuedPacket dequeue( void ) override;
+
+    bool empty( void ) const override { return size_packets_ == 0; }
+
+    std::string to_string( void ) const override;
+
+    unsigned int size_bytes( void ) const override { return size_bytes_; }
+    unsigned int size_packets( void ) const override { return size_packets_; }
+
+    uint64_t marked_packets( void ) const override { return marked_packets_; }
+};
+
+#endif /* FQ_CODEL_PACKET_QUEUE_HH */
@@ -10,7 +10,7 @@
 #include "abstract_packet_queue.hh"
 #include "exception.hh"
 
-class InfinitePacketQueue : public AbstractPacketQueue
+class InfinitePacketQueue final : public AbstractPacketQueue
 {
 private:
     std::queue<QueuedPacket> internal_queue_ {};
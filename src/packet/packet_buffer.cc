@@ -0,0 +1,141 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <iostream>
+
+#include "packet_buffer.hh"
+#include "exception.hh"
+
+using namespace std;
+
+const size_t PacketBufferPool::BUFFER_SIZE;
+
+PacketBuffer::PacketBuffer()
+    : pool_( nullptr ),
+      buffer_(),
+      size_( 0 )
+{}
+
+PacketBuffer::PacketBuffer( PacketBufferPool & pool, unique_ptr<char[]> && buffer, const size_t size )
+    : pool_( &pool ),
+      buffer_( move( buffer ) ),
+      size_( size )
+{}
+
+PacketBuffer::PacketBuffer( PacketBuffer && other )
+    : pool_( other.pool_ ),
+      buffer_( move( other.buffer_ ) ),
+      size_( other.size_ )
+{
+    other.pool_ = nullptr;
+    other.size_ = 0;
+}
+
+PacketBuffer & PacketBuffer::operator=( PacketBuffer && other )
+{
+    if ( this != &other ) {
+        release();
+
+        pool_ = other.pool_;
+        buffer_ = move( other.buffer_ );
+        size_ = other.size_;
+
+        other.pool_ = nullptr;
+        other.size_ = 0;
+    }
+
+    return *this;
+}
+
+/* hand the buffer back to its pool */
+void PacketBuffer::release( void )
+{
+    if ( pool_ and buffer_ ) {
+        pool_->recycle( move( buffer_ ) );
+    }
+
+    pool_ = nullptr;
+    buffer_.reset();
+    size_ = 0;
+}
+
+PacketBuffer::~PacketBuffer()
+{
+    release();
+}
+
+PacketBufferPool::PacketBufferPool()
+    : free_buffers_(),
+      oversized_datagrams_( 0 )
+{}
+
+unique_ptr<char[]> PacketBufferPool::acquire( void )
+{
+    if ( free_buffers_.empty() ) {
+        return unique_ptr<char[]>( new char[ BUFFER_SIZE ] );
+    }
+
+    unique_ptr<char[]> ret = move( free_buffers_.back() );
+    free_buffers_.pop_back();
+    return ret;
+}
+
+void PacketBufferPool::recycle( unique_ptr<char[]> && buffer )
+{
+    free_buffers_.push_back( move( buffer ) );
+}
+
+PacketBuffer PacketBufferPool::read( FileDescriptor & fd )
+{
+    unique_ptr<char[]> buffer = acquire();
+
+    while ( true ) {
+        const size_t bytes_read = fd.read( buffer.get(), BUFFER_SIZE );
+
+        if ( bytes_read == 0 ) {
+            recycle( move( buffer ) );
+            return PacketBuffer();
+        }
+
+        /* the kernel truncates datagrams that don't fit, so drop one that
+           fills the buffer (rather than forward it cut short) and read on */
+        if ( bytes_read == BUFFER_SIZE ) {
+            if ( oversized_datagrams_++ == 0 ) {
+                cerr << "Warning: dropping datagrams of " << BUFFER_SIZE
+                     << " bytes or more (is the MTU raised?)" << endl;
+            }
+            continue;
+        }
+
+        return PacketBuffer( *this, move( buffer ), bytes_read );
+    }
+}
+
+PacketBuffer PacketBufferPool::make( const string & contents )
+{
+    if ( contents.size() > BUFFER_SIZE ) {
+        throw runtime_error( "PacketBufferPool: packet exceeds buffer size of "
+                             + to_string( BUFFER_SIZE ) + " bytes" );
+    }
+
+    unique_ptr<char[]> buffer = acquire();
+    memcpy( buffer.get(), contents.data(), contents.size() );
+
+    return PacketBuffer( *this, move( buffer ), contents.size() );
+}
+
+PacketBuffer PacketBufferPool::make_unfilled( const size_t size )
+{
+    if ( size > BUFFER_SIZE ) {
+        throw runtime_error( "PacketBufferPool: packet exceeds buffer size of "
+                             + to_string( BUFFER_SIZE ) + " bytes" );
+    }
+
+    return PacketBuffer( *this, acquire(), size );
+}
+
+PacketBufferPool & PacketBufferPool::default_pool( void )
+{
+    static PacketBufferPool pool;
+    return pool;
+}
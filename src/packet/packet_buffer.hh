@@ -0,0 +1,93 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_BUFFER_HH
+#define PACKET_BUFFER_HH
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "file_descriptor.hh"
+
+class PacketBufferPool;
+
+/* uniquely owned handle to one packet's bytes in a pooled buffer;
+   the buffer goes back to its pool when the handle is destroyed */
+class PacketBuffer
+{
+private:
+    PacketBufferPool * pool_;
+    std::unique_ptr<char[]> buffer_;
+    size_t size_;
+
+    void release( void );
+
+public:
+    /* an empty packet with no buffer */
+    PacketBuffer();
+
+    PacketBuffer( PacketBufferPool & pool, std::unique_ptr<char[]> && buffer, const size_t size );
+
+    ~PacketBuffer();
+
+    const char * data( void ) const { return buffer_.get(); }
+    char * data( void ) { return buffer_.get(); }
+    size_t size( void ) const { return size_; }
+    bool empty( void ) const { return size_ == 0; }
+
+    /* copy of the contents (for callers that still need a string) */
+    std::string str( void ) const { return std::string( data(), size() ); }
+
+    /* allow moving, but ban copying */
+    PacketBuffer( PacketBuffer && other );
+    PacketBuffer & operator=( PacketBuffer && other );
+
+    PacketBuffer( const PacketBuffer & other ) = delete;
+    PacketBuffer & operator=( const PacketBuffer & other ) = delete;
+};
+
+/* fixed-size buffers, each big enough for one TUN datagram, recycled
+   through a free list instead of being allocated and copied per packet.
+   Not thread-safe: each ferry (one per process) uses its own pool. */
+class PacketBufferPool
+{
+private:
+    std::vector< std::unique_ptr<char[]> > free_buffers_;
+    uint64_t oversized_datagrams_;
+
+    friend class PacketBuffer;
+    void recycle( std::unique_ptr<char[]> && buffer );
+
+    std::unique_ptr<char[]> acquire( void );
+
+public:
+    /* TUN MTU (1500) plus packet information header, with room to spare */
+    static const size_t BUFFER_SIZE = 2048;
+
+    PacketBufferPool();
+
+    /* read one datagram from fd into a pooled buffer
+       (empty if fd is non-blocking and has nothing to read);
+       datagrams too big for a buffer are dropped and counted */
+    PacketBuffer read( FileDescriptor & fd );
+
+    uint64_t oversized_datagrams( void ) const { return oversized_datagrams_; }
+
+    /* copy contents into a pooled buffer */
+    PacketBuffer make( const std::string & contents );
+
+    /* a packet of the given size whose contents don't matter (for simulation) */
+    PacketBuffer make_unfilled( const size_t size );
+
+    size_t free_buffers( void ) const { return free_buffers_.size(); }
+
+    /* pool shared by every ferry queue in this process */
+    static PacketBufferPool & default_pool( void );
+
+    /* ban copying */
+    PacketBufferPool( const PacketBufferPool & other ) = delete;
+    PacketBufferPool & operator=( const PacketBufferPool & other ) = delete;
+};
+
+#endif /* PACKET_BUFFER_HH */
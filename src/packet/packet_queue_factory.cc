@@ -0,0 +1,39 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include "packet_queue_factory.hh"
+
+using namespace std;
+
+unique_ptr<AbstractPacketQueue> make_packet_queue( const string & type, const string & args, const Clock & clock )
+{
+    if ( type == "infinite" ) {
+        return unique_ptr<AbstractPacketQueue>( new InfinitePacketQueue( args ) );
+    } else if ( type == "droptail" ) {
+        return unique_ptr<AbstractPacketQueue>( new DropTailPacketQueue( args ) );
+    } else if ( type == "drophead" ) {
+        return unique_ptr<AbstractPacketQueue>( new DropHeadPacketQueue( args ) );
+    } else if ( type == "codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new CODELPacketQueue( args, clock ) );
+    } else if ( type == "pie" ) {
+        return unique_ptr<AbstractPacketQueue>( new PIEPacketQueue( args, clock ) );
+    } else if ( type == "fq_codel" ) {
+        return unique_ptr<AbstractPacketQueue>( new FQCODELPacketQueue( args, clock ) );
+    }
+
+    return nullptr;
+}
+
+int packet_queue_type_index( const string & type )
+{
+    static const string names[] = { "infinite", "droptail", "drophead", "codel", "pie", "fq_codel" };
+    static_assert( sizeof( names ) / sizeof( names[ 0 ] ) == PacketQueueTypes::size,
+                   "a name for every queue type" );
+
+    for ( unsigned int i = 0; i < PacketQueueTypes::size; i++ ) {
+        if ( type == names[ i ] ) {
+            return i;
+        }
+    }
+
+    return -1;
+}
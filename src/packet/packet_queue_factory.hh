@@ -0,0 +1,67 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef PACKET_QUEUE_FACTORY_HH
+#define PACKET_QUEUE_FACTORY_HH
+
+#include <string>
+#include <memory>
+#include <type_traits>
+
+#include "abstract_packet_queue.hh"
+#include "infinite_packet_queue.hh"
+#include "drop_tail_packet_queue.hh"
+#include "drop_head_packet_queue.hh"
+#include "codel_packet_queue.hh"
+#include "pie_packet_queue.hh"
+#include "fq_codel_packet_queue.hh"
+#include "clock.hh"
+
+/* QUEUE_TYPE as given to mm-link (infinite | droptail | drophead | codel | pie | fq_codel),
+   or nullptr if there is no such type; AQMs read the time from clock */
+std::unique_ptr<AbstractPacketQueue> make_packet_queue( const std::string & type,
+                                                        const std::string & args,
+                                                        const Clock & clock );
+
+/* A list of queue types, for code that is compiled once per type so
+   that its calls to the queue are direct (and can be inlined) rather
+   than virtual */
+template <class... QueueTypes>
+struct PacketQueueTypeList
+{
+    static const size_t size = sizeof...( QueueTypes );
+};
+
+/* every QUEUE_TYPE, in the order of packet_queue_type_index() */
+typedef PacketQueueTypeList<InfinitePacketQueue,
+                            DropTailPacketQueue,
+                            DropHeadPacketQueue,
+                            CODELPacketQueue,
+                            PIEPacketQueue,
+                            FQCODELPacketQueue> PacketQueueTypes;
+
+/* position of a QUEUE_TYPE in PacketQueueTypes, or -1 if there is no such type */
+int packet_queue_type_index( const std::string & type );
+
+/* a queue of a type known at compile time (whichever constructor it has) */
+template <class QueueType>
+std::unique_ptr<QueueType> make_packet_queue_of_type( const std::string & args, const Clock & clock,
+                                                      std::true_type /* takes a clock */ )
+{
+    return std::unique_ptr<QueueType>( new QueueType( args, clock ) );
+}
+
+template <class QueueType>
+std::unique_ptr<QueueType> make_packet_queue_of_type( const std::string & args, const Clock &,
+                                                      std::false_type /* takes a clock */ )
+{
+    return std::unique_ptr<QueueType>( new QueueType( args ) );
+}
+
+template <class QueueType>
+std::unique_ptr<QueueType> make_packet_queue_of_type( const std::string & args, const Clock & clock )
+{
+    return make_packet_queue_of_type<QueueType>( args, clock,
+        std::is_constructible<QueueType, const std::string &, const Clock &>() );
+}
+
+#endif /* PACKET_QUEUE_FACTORY_HH */
@@ -2,6 +2,7 @@
 
 #include <thread>
 #include <chrono>
+#include <iostream>
 
 #include <sys/socket.h>
 #include <net/route.h>
@@ -16,13 +17,15 @@
 #include "timestamp.hh"
 #include "exception.hh"
 #include "bindworkaround.hh"
+#include "packet_buffer.hh"
+#include "batch_counter.hh"
 #include "config.h"
 
 using namespace std;
 using namespace PollerShortNames;
 
-template <class FerryQueueType>
-PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment )
+template <class UplinkQueueType, class DownlinkQueueType>
+PacketShell<UplinkQueueType, DownlinkQueueType>::PacketShell( const std::string & device_prefix, char ** const user_environment )
     : user_environment_( user_environment ),
       egress_ingress( two_unassigned_addresses( get_mahimahi_base() ) ),
       nameserver_( first_nameserver() ),
@@ -41,21 +44,21 @@ PacketShell<FerryQueueType>::PacketShell( const std::string & device_prefix, cha
     initial_timestamp();
 }
 
-template <class FerryQueueType>
+template <class UplinkQueueType, class DownlinkQueueType>
 template <typename... Targs>
-void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
-                                                const vector< string > & command,
-                                                Targs&&... Fargs )
+void PacketShell<UplinkQueueType, DownlinkQueueType>::start_uplink( const string & shell_prefix,
+                                                                    const vector< string > & command,
+                                                                    Targs&&... Fargs )
 {
     /* g++ bug 55914 makes this hard before version 4.9 */
-    BindWorkAround::bind<FerryQueueType, Targs&&...> ferry_maker( forward<Targs>( Fargs )... );
+    BindWorkAround::bind<UplinkQueueType, Targs&&...> ferry_maker( forward<Targs>( Fargs )... );
 
     /*
       This is a replacement for expanding the parameter pack
       inside the lambda, e.g.:
 
     auto ferry_maker = [&]() {
-        return FerryQueueType( forward<Targs>( Fargs )... );
+        return UplinkQueueType( forward<Targs>( Fargs )... );
     };
     */
 
@@ -119,24 +122,24 @@ void PacketShell<FerryQueueType>::start_uplink( const string & shell_prefix,
             /* allow downlink to write directly to inner namespace's TUN device */
             pipe_.first.send_fd( ingress_tun );
 
-            FerryQueueType uplink_queue { ferry_maker() };
-            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_ );
+            UplinkQueueType uplink_queue { ferry_maker() };
+            return inner_ferry.loop( uplink_queue, ingress_tun, egress_tun_, "uplink" );
         }, true );  /* new network namespace */
 }
 
-template <class FerryQueueType>
+template <class UplinkQueueType, class DownlinkQueueType>
 template <typename... Targs>
-void PacketShell<FerryQueueType>::start_downlink( Targs&&... Fargs )
+void PacketShell<UplinkQueueType, DownlinkQueueType>::start_downlink( Targs&&... Fargs )
 {
     /* g++ bug 55914 makes this hard before version 4.9 */
-    BindWorkAround::bind<FerryQueueType, Targs&&...> ferry_maker( forward<Targs>( Fargs )... );
+    BindWorkAround::bind<DownlinkQueueType, Targs&&...> ferry_maker( forward<Targs>( Fargs )... );
 
     /*
       This is a replacement for expanding the parameter pack
       inside the lambda, e.g.:
 
     auto ferry_maker = [&]() {
-        return FerryQueueType( forward<Targs>( Fargs )... );
+        return DownlinkQueueType( forward<Targs>( Fargs )... );
     };
     */
 
@@ -153,26 +156,56 @@ void PacketShell<FerryQueueType>::start_downlink( Targs&&... Fargs )
 
             dns_outside_.register_handlers( outer_ferry );
 
-            FerryQueueType downlink_queue { ferry_maker() };
-            return outer_ferry.loop( downlink_queue, egress_tun_, ingress_tun );
+            DownlinkQueueType downlink_queue { ferry_maker() };
+            return outer_ferry.loop( downlink_queue, egress_tun_, ingress_tun, "downlink" );
         } );
 }
 
-template <class FerryQueueType>
-int PacketShell<FerryQueueType>::wait_for_exit( void )
+template <class UplinkQueueType, class DownlinkQueueType>
+int PacketShell<UplinkQueueType, DownlinkQueueType>::wait_for_exit( void )
 {
     return event_loop_.loop();
 }
 
+template <class UplinkQueueType, class DownlinkQueueType>
 template <class FerryQueueType>
-int PacketShell<FerryQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
-                                              FileDescriptor & tun,
-                                              FileDescriptor & sibling )
+int PacketShell<UplinkQueueType, DownlinkQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
+                                                                  FileDescriptor & tun,
+                                                                  FileDescriptor & sibling,
+                                                                  const string & name )
 {
-    /* tun device gets datagram -> read it -> give to ferry */
+    /* datagrams are read straight into pooled buffers and handed along without copying */
+    PacketBufferPool & pool = PacketBufferPool::default_pool();
+
+    /* drain up to this many datagrams per wakeup, so the queue is
+       timestamped and rationalized once per batch instead of once per packet */
+    const size_t MAX_BATCH_SIZE = 64;
+
+    vector<PacketBuffer> batch;
+    batch.reserve( MAX_BATCH_SIZE );
+
+    BatchCounter batch_sizes( MAX_BATCH_SIZE );
+
+    /* (writes to the sibling's TUN device don't block: its send buffer is unlimited) */
+    tun.set_blocking( false );
+
+    /* tun device gets datagrams -> read them -> give to ferry */
     add_simple_input_handler( tun, 
                               [&] () {
-                                  ferry_queue.read_packet( tun.read() );
+                                  while ( batch.size() < MAX_BATCH_SIZE ) {
+                                      PacketBuffer packet = pool.read( tun );
+                                      if ( packet.empty() ) {
+                                          break; /* drained */
+                                      }
+                                      batch.push_back( move( packet ) );
+                                  }
+
+                                  batch_sizes.record( batch.size() );
+
+                                  if ( not batch.empty() ) {
+                                      ferry_queue.read_packets( batch );
+                                  }
+
                                   return ResultType::Continue;
                               } );
 
@@ -191,7 +224,14 @@ int PacketShell<FerryQueueType>::Ferry::loop( FerryQueueType & ferry_queue,
                                 },
                                 [&] () { return ferry_queue.finished(); } ) );
 
-    return internal_loop( [&] () { return ferry_queue.wait_time(); } );
+    const int exit_status = internal_loop( [&] () { return ferry_queue.wait_time(); } );
+
+    if ( getenv( "MAHIMAHI_FERRY_STATS" ) ) {
+        cerr << "[" << name << "] " << batch_sizes.summary()
+             << "; oversized datagrams dropped: " << pool.oversized_datagrams() << endl;
+    }
+
+    return exit_status;
 }
 
 struct TemporaryEnvironment
@@ -210,8 +250,8 @@ struct TemporaryEnvironment
     }
 };
 
-template <class FerryQueueType>
-Address PacketShell<FerryQueueType>::get_mahimahi_base( void ) const
+template <class UplinkQueueType, class DownlinkQueueType>
+Address PacketShell<UplinkQueueType, DownlinkQueueType>::get_mahimahi_base( void ) const
 {
     /* temporarily break our security rule of not looking
        at the user's environment before dropping privileges */
@@ -13,7 +13,8 @@
 #include "event_loop.hh"
 #include "socketpair.hh"
 
-template <class FerryQueueType>
+/* the uplink and downlink ferries may use different queue types */
+template <class UplinkQueueType, class DownlinkQueueType = UplinkQueueType>
 class PacketShell
 {
 private:
@@ -34,7 +35,9 @@ private:
     class Ferry : public EventLoop
     {
     public:
-        int loop( FerryQueueType & ferry_queue, FileDescriptor & tun, FileDescriptor & sibling );
+        template <class FerryQueueType>
+        int loop( FerryQueueType & ferry_queue, FileDescriptor & tun, FileDescriptor & sibling,
+                  const std::string & name );
     };
 
     Address get_mahimahi_base( void ) const;
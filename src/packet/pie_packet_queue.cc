@@ -2,14 +2,14 @@
 #include <chrono>
 
 #include "pie_packet_queue.hh"
-#include "timestamp.hh"
 
 using namespace std;
 
 #define DQ_COUNT_INVALID   (uint32_t)-1
 
-PIEPacketQueue::PIEPacketQueue( const string & args )
+PIEPacketQueue::PIEPacketQueue( const string & args, const Clock & clock )
   : DroppingPacketQueue(args),
+    clock_ ( clock ),
     qdelay_ref_ ( get_arg( args, "qdelay_ref" ) ),
     max_burst_ ( get_arg( args, "max_burst" ) ),
     alpha_ ( 0.125 ),
@@ -25,7 +25,7 @@ PIEPacketQueue::PIEPacketQueue( const string & args )
     avg_dq_rate_ ( 0 ),
     uniform_generator_ ( 0.0, 1.0 ),
     prng_( random_device()() ),
-    last_update_( timestamp() )
+    last_update_( clock_.now_ms() )
 {
   if ( qdelay_ref_ == 0 || max_burst_ == 0 ) {
     throw runtime_error( "PIE AQM queue must have qdelay_ref and max_burst parameters" );
@@ -47,6 +47,10 @@ void PIEPacketQueue::enqueue( QueuedPacket && p )
     //It is used to enqueue rather than drop the packet
     //All other packets are dropped
     accept( std::move( p ) );
+  } else if ( drop_prob_ <= ECN_MAX_PROB && mark( p ) ) {
+    //With ECN, mark rather than drop, unless the drop probability
+    //is so high that the sender is ignoring the marks (RFC 8033 5.1)
+    accept( std::move( p ) );
   }
 
   assert( good() );
@@ -79,7 +83,7 @@ bool PIEPacketQueue::drop_early ()
 QueuedPacket PIEPacketQueue::dequeue( void )
 {
   QueuedPacket ret = std::move( DroppingPacketQueue::dequeue () );
-  uint32_t now = timestamp();
+  uint32_t now = clock_.now_ms();
 
   if ( size_bytes() >= dq_threshold_ && dq_count_ == DQ_COUNT_INVALID ) {
     dq_tstamp_ = now;
@@ -125,7 +129,7 @@ QueuedPacket PIEPacketQueue::dequeue( void )
 
 void PIEPacketQueue::calculate_drop_prob( void )
 {
-  uint64_t now = timestamp();
+  uint64_t now = clock_.now_ms();
 
   //We can't have a fork inside the mahimahi shell so we simulate
   //the periodic drop probability calculation here by repeating it for the
@@ -134,6 +138,19 @@ void PIEPacketQueue::calculate_drop_prob( void )
   //so when this value is used (at enqueue) it will be identical
   //to that of a timer-based drop probability calculation.
   while (now - last_update_ > t_update_) {
+    if ( idle_steady_state() ) {
+      //An update would change nothing but the burst allowance and the
+      //time of the last update, so make all the remaining ones at once.
+      //(Otherwise an hour of idle would be 120,000 updates on the next
+      //enqueue.)
+      const uint64_t updates = (now - last_update_ - 1) / t_update_;
+      const uint64_t elapsed = updates * t_update_;
+
+      burst_allowance_ = burst_allowance_ > elapsed ? burst_allowance_ - elapsed : 0;
+      last_update_ += elapsed;
+      break;
+    }
+
     bool update_prob = true;
     qdelay_old_ = current_qdelay_;
 
@@ -186,3 +203,15 @@ void PIEPacketQueue::calculate_drop_prob( void )
 
   }
 }
+
+//True if the queue is empty and an update would leave the drop probability
+//and delay estimates as they are: the drop probability has decayed to zero,
+//and the dequeue rate has been reset (or never will be).
+bool PIEPacketQueue::idle_steady_state( void ) const
+{
+  return size_bytes() == 0
+    && drop_prob_ == 0
+    && current_qdelay_ == 0
+    && qdelay_old_ == 0
+    && ( avg_dq_rate_ == 0 || qdelay_ref_/2 == 0 );
+}
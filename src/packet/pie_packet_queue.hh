@@ -6,6 +6,7 @@
 #include <random>
 #include <thread>
 #include "dropping_packet_queue.hh"
+#include "clock.hh"
 
 /*    
    Proportional Integral controller Enhanced (PIE)
@@ -14,13 +15,19 @@
    Contributed by
       Joseph D. Beshay <joseph.beshay@utdallas.edu>
 */
-class PIEPacketQueue : public DroppingPacketQueue
+class PIEPacketQueue final : public DroppingPacketQueue
 {
 private:
     //This constant is copied from link_queue.hh.
     //It maybe better to get this in a more reliable way in the future.
     const static unsigned int PACKET_SIZE = 1504; /* default max TUN payload size */
 
+    //Highest drop probability at which packets are marked rather than dropped
+    constexpr static double ECN_MAX_PROB = 0.1;
+
+    //Source of the current time (real or simulated)
+    const Clock & clock_;
+
     //Configurable parameters
     uint32_t qdelay_ref_, max_burst_;
 
@@ -51,8 +58,10 @@ private:
 
     void calculate_drop_prob ( void );
 
+    bool idle_steady_state ( void ) const;
+
 public:
-    PIEPacketQueue( const std::string & args );
+    PIEPacketQueue( const std::string & args, const Clock & clock );
 
     void enqueue( QueuedPacket && p ) override;
 
@@ -0,0 +1,69 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+
+#include "queued_packet_ring.hh"
+
+using namespace std;
+
+static size_t round_up_to_power_of_two( const size_t n )
+{
+    size_t ret = 1;
+    while ( ret < n ) {
+        ret <<= 1;
+    }
+    return ret;
+}
+
+static vector<QueuedPacket> empty_slots( const size_t count )
+{
+    vector<QueuedPacket> ret;
+    ret.reserve( count );
+    for ( size_t i = 0; i < count; i++ ) {
+        ret.emplace_back( PacketBuffer(), 0 );
+    }
+    return ret;
+}
+
+QueuedPacketRing::QueuedPacketRing( const size_t capacity )
+    : slots_( empty_slots( round_up_to_power_of_two( capacity ) ) ),
+      mask_( slots_.size() - 1 ),
+      head_( 0 ),
+      tail_( 0 )
+{}
+
+/* double the slots, keeping the packets in order */
+void QueuedPacketRing::grow( void )
+{
+    vector<QueuedPacket> slots = empty_slots( slots_.size() * 2 );
+
+    const size_t count = size();
+    for ( size_t i = 0; i < count; i++ ) {
+        slots[ i ] = move( slots_[ ( head_ + i ) & mask_ ] );
+    }
+
+    slots_ = move( slots );
+    mask_ = slots_.size() - 1;
+    head_ = 0;
+    tail_ = count;
+}
+
+void QueuedPacketRing::push( QueuedPacket && p )
+{
+    if ( size() == slots_.size() ) {
+        grow();
+    }
+
+    slots_[ tail_ & mask_ ] = move( p );
+    tail_++;
+}
+
+QueuedPacket QueuedPacketRing::pop( void )
+{
+    assert( not empty() );
+
+    QueuedPacket ret = move( slots_[ head_ & mask_ ] );
+    head_++;
+
+    return ret;
+}
@@ -0,0 +1,37 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef QUEUED_PACKET_RING_HH
+#define QUEUED_PACKET_RING_HH
+
+#include <vector>
+
+#include "queued_packet.hh"
+
+/* FIFO of queued packets in one contiguous array of slots, used as a
+   ring. The slots (a packet's arrival time and the handle to its pooled
+   buffer) are allocated up front, so pushing and popping never
+   allocate unless the ring has to grow past its initial capacity. */
+class QueuedPacketRing
+{
+private:
+    std::vector<QueuedPacket> slots_; /* size is a power of two */
+    size_t mask_;
+
+    /* running totals of packets pushed and popped */
+    size_t head_, tail_;
+
+    void grow( void );
+
+public:
+    /* room for at least capacity packets before growing */
+    QueuedPacketRing( const size_t capacity );
+
+    void push( QueuedPacket && p );
+    QueuedPacket pop( void );
+
+    bool empty( void ) const { return head_ == tail_; }
+    size_t size( void ) const { return tail_ - head_; }
+    size_t capacity( void ) const { return slots_.size(); }
+};
+
+#endif /* QUEUED_PACKET_RING_HH */
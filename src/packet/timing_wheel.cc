@@ -0,0 +1,243 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cassert>
+#include <algorithm>
+
+#include "timing_wheel.hh"
+
+using namespace std;
+
+TimingWheel::TimingWheel()
+    : entries_(),
+      free_entries_( NIL ),
+      slots_(),
+      occupied_(),
+      ready_(),
+      current_tick_( 0 ),
+      waiting_( 0 )
+{}
+
+void TimingWheel::append( List & list, const uint32_t index )
+{
+    entries_[ index ].next = NIL;
+    list.earliest = min( list.earliest, entries_[ index ].release_time );
+
+    if ( list.tail == NIL ) {
+        list.head = index;
+    } else {
+        entries_[ list.tail ].next = index;
+    }
+    list.tail = index;
+}
+
+/* put an entry in the slot for its tick (or the current tick, if that
+   has already gone by): on the level of the highest 8 bits in which
+   the tick differs from the current tick */
+void TimingWheel::place( const uint32_t index )
+{
+    const uint64_t tick = max( entries_[ index ].release_time >> TICK_BITS, current_tick_ );
+    const uint64_t differing = tick ^ current_tick_;
+
+    const unsigned int level = differing ? ( 63 - __builtin_clzll( differing ) ) / SLOT_BITS : 0;
+    const unsigned int slot = ( tick >> ( SLOT_BITS * level ) ) & ( SLOTS - 1 );
+
+    append( slots_[ level ][ slot ], index );
+    occupied_[ level ][ slot / 64 ] |= uint64_t( 1 ) << ( slot % 64 );
+}
+
+unsigned int TimingWheel::next_occupied( const unsigned int level, const unsigned int from ) const
+{
+    for ( unsigned int word = from / 64; word < SLOTS / 64; word++ ) {
+        uint64_t bits = occupied_[ level ][ word ];
+        if ( word == from / 64 ) {
+            bits &= UINT64_MAX << ( from % 64 );
+        }
+
+        if ( bits ) {
+            return word * 64 + __builtin_ctzll( bits );
+        }
+    }
+
+    return SLOTS;
+}
+
+void TimingWheel::insert( const uint64_t release_time, PacketBuffer && packet )
+{
+    uint32_t index;
+
+    if ( free_entries_ != NIL ) {
+        index = free_entries_;
+        free_entries_ = entries_[ index ].next;
+        entries_[ index ].release_time = release_time;
+        entries_[ index ].packet = move( packet );
+    } else {
+        assert( entries_.size() < NIL );
+        index = entries_.size();
+        entries_.push_back( { release_time, move( packet ), NIL } );
+    }
+
+    place( index );
+    waiting_++;
+}
+
+/* move the packets in the current tick's slot that are due by now to the ready list */
+void TimingWheel::release_due( const uint64_t now )
+{
+    const unsigned int slot = current_tick_ & ( SLOTS - 1 );
+    List & list = slots_[ 0 ][ slot ];
+
+    uint32_t previous = NIL;
+    uint32_t index = list.head;
+    list.earliest = UINT64_MAX; /* of the packets that stay */
+
+    while ( index != NIL ) {
+        const uint32_t next = entries_[ index ].next;
+
+        if ( entries_[ index ].release_time <= now ) {
+            /* unlink it */
+            if ( previous == NIL ) {
+                list.head = next;
+            } else {
+                entries_[ previous ].next = next;
+            }
+            if ( list.tail == index ) {
+                list.tail = previous;
+            }
+
+            append( ready_, index );
+            waiting_--;
+        } else {
+            list.earliest = min( list.earliest, entries_[ index ].release_time );
+            previous = index;
+        }
+
+        index = next;
+    }
+
+    if ( list.head == NIL ) {
+        occupied_[ 0 ][ slot / 64 ] &= ~( uint64_t( 1 ) << ( slot % 64 ) );
+    }
+}
+
+/* the next tick at which a packet comes due in the lowest level, or a
+   higher level's slot has to cascade; a lower level's next event always
+   comes before a higher level's */
+uint64_t TimingWheel::next_event_tick( void ) const
+{
+    for ( unsigned int level = 0; level < LEVELS; level++ ) {
+        const unsigned int shift = SLOT_BITS * level;
+        const unsigned int current_slot = ( current_tick_ >> shift ) & ( SLOTS - 1 );
+        const unsigned int slot = next_occupied( level, current_slot + 1 );
+
+        if ( slot < SLOTS ) {
+            const uint64_t rotation = current_tick_ >> ( shift + SLOT_BITS ) << ( shift + SLOT_BITS );
+            return rotation | ( uint64_t( slot ) << shift );
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+/* the wheel has turned into new slots on the levels whose lower bits
+   are all zero: move the packets in those slots down */
+void TimingWheel::cascade( void )
+{
+    for ( unsigned int level = LEVELS - 1; level > 0; level-- ) {
+        const unsigned int shift = SLOT_BITS * level;
+        if ( current_tick_ & ( ( uint64_t( 1 ) << shift ) - 1 ) ) {
+            continue;
+        }
+
+        const unsigned int slot = ( current_tick_ >> shift ) & ( SLOTS - 1 );
+        List & list = slots_[ level ][ slot ];
+        uint32_t index = list.head;
+
+        list = List();
+        occupied_[ level ][ slot / 64 ] &= ~( uint64_t( 1 ) << ( slot % 64 ) );
+
+        while ( index != NIL ) {
+            const uint32_t next = entries_[ index ].next;
+            place( index );
+            index = next;
+        }
+    }
+}
+
+void TimingWheel::advance( const uint64_t now )
+{
+    const uint64_t target = now >> TICK_BITS;
+
+    while ( true ) {
+        release_due( now );
+
+        if ( current_tick_ >= target ) {
+            break;
+        }
+
+        /* skip straight to the next tick at which anything happens */
+        current_tick_ = waiting_ ? min( next_event_tick(), target ) : target;
+        cascade();
+    }
+}
+
+const PacketBuffer & TimingWheel::next_ready( void ) const
+{
+    assert( has_ready() );
+
+    return entries_[ ready_.head ].packet;
+}
+
+void TimingWheel::pop_ready( void )
+{
+    assert( has_ready() );
+
+    const uint32_t index = ready_.head;
+    ready_.head = entries_[ index ].next;
+    if ( ready_.head == NIL ) {
+        ready_.tail = NIL;
+    }
+
+    /* the buffer goes back to its pool now, not when the entry is reused */
+    entries_[ index ].packet = PacketBuffer();
+    entries_[ index ].next = free_entries_;
+    free_entries_ = index;
+}
+
+PacketBuffer TimingWheel::take_ready( void )
+{
+    assert( has_ready() );
+
+    PacketBuffer ret = move( entries_[ ready_.head ].packet );
+    pop_ready();
+
+    return ret;
+}
+
+/* the slot holding the earliest packet: the first nonempty one in the
+   current rotation of the lowest level that has any packets (a higher
+   level's current slot is always empty, having cascaded) */
+const TimingWheel::List * TimingWheel::earliest_slot( void ) const
+{
+    for ( unsigned int level = 0; level < LEVELS; level++ ) {
+        const unsigned int shift = SLOT_BITS * level;
+        const unsigned int current_slot = ( current_tick_ >> shift ) & ( SLOTS - 1 );
+        const unsigned int slot = next_occupied( level, current_slot );
+
+        if ( slot < SLOTS ) {
+            return &slots_[ level ][ slot ];
+        }
+    }
+
+    return nullptr;
+}
+
+uint64_t TimingWheel::next_release_time( void ) const
+{
+    if ( has_ready() ) {
+        return 0;
+    }
+
+    const List * const slot = earliest_slot();
+
+    return slot ? slot->earliest : UINT64_MAX;
+}
@@ -0,0 +1,92 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef TIMING_WHEEL_HH
+#define TIMING_WHEEL_HH
+
+#include <cstdint>
+#include <vector>
+
+#include "packet_buffer.hh"
+
+/* Packets held until their release times, in a hierarchical timing
+   wheel: constant time to insert a packet or release it, however many
+   are waiting and whatever their delays. Time is kept in ticks of 1024
+   ns. Each level has 256 slots, and each slot covers 256 times as much
+   time as a slot on the level below; a packet goes on the lowest level
+   whose current rotation includes its tick. When the wheel turns into a
+   higher level's slot, that slot's packets move down to where they now
+   belong ("cascading"). Packets leave in order of release time, except
+   that packets due in the same tick leave in the order they came in. */
+class TimingWheel
+{
+private:
+    static const unsigned int TICK_BITS = 10;
+    static const unsigned int SLOT_BITS = 8;
+    static const unsigned int SLOTS = 1 << SLOT_BITS;
+    static const unsigned int LEVELS = 7; /* 7 * 8 + 10 bits: any 64-bit time */
+    static const uint32_t NIL = UINT32_MAX;
+
+    struct Entry
+    {
+        uint64_t release_time; /* ns */
+        PacketBuffer packet;
+        uint32_t next;
+    };
+
+    /* singly linked list of entries */
+    struct List
+    {
+        uint32_t head = NIL, tail = NIL;
+        uint64_t earliest = UINT64_MAX; /* release time (ns), or UINT64_MAX if empty */
+    };
+
+    /* entries are recycled through a free list, so the wheel only
+       allocates when it holds more packets than ever before */
+    std::vector<Entry> entries_;
+    uint32_t free_entries_;
+
+    List slots_[ LEVELS ][ SLOTS ];
+    uint64_t occupied_[ LEVELS ][ SLOTS / 64 ]; /* which slots are nonempty */
+
+    /* released packets, waiting to be taken */
+    List ready_;
+
+    uint64_t current_tick_;
+    size_t waiting_; /* packets in the slots */
+
+    void append( List & list, const uint32_t index );
+    void place( const uint32_t index );
+    void release_due( const uint64_t now );
+    void cascade( void );
+    uint64_t next_event_tick( void ) const;
+    const List * earliest_slot( void ) const;
+
+    /* first nonempty slot at or after the given index, or SLOTS if none */
+    unsigned int next_occupied( const unsigned int level, const unsigned int from ) const;
+
+public:
+    TimingWheel();
+
+    void insert( const uint64_t release_time, PacketBuffer && packet );
+
+    /* release every packet due by now (ns) */
+    void advance( const uint64_t now );
+
+    bool has_ready( void ) const { return ready_.head != NIL; }
+
+    /* the first released packet */
+    const PacketBuffer & next_ready( void ) const;
+
+    void pop_ready( void );
+
+    PacketBuffer take_ready( void );
+
+    /* the earliest release time of the packets waiting: advancing to it
+       releases at least one. Zero if a packet is released and UINT64_MAX
+       if there are no packets. */
+    uint64_t next_release_time( void ) const;
+
+    bool empty( void ) const { return waiting_ == 0 and not has_ready(); }
+};
+
+#endif /* TIMING_WHEEL_HH */
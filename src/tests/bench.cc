@@ -0,0 +1,154 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <unistd.h>
+
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cinttypes>
+#include <atomic>
+#include <new>
+
+#include "bench.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* count every heap allocation in the program */
+static atomic<uint64_t> allocations( 0 );
+
+void * operator new( size_t size )
+{
+    allocations.fetch_add( 1, memory_order_relaxed );
+
+    void * ret = malloc( size ? size : 1 );
+    if ( not ret ) {
+        throw bad_alloc();
+    }
+    return ret;
+}
+
+void operator delete( void * ptr ) noexcept
+{
+    free( ptr );
+}
+
+void operator delete( void * ptr, size_t ) noexcept
+{
+    free( ptr );
+}
+
+uint64_t allocation_count( void )
+{
+    return allocations.load( memory_order_relaxed );
+}
+
+/* a run must last this long to be reported */
+static const double MIN_TIME = 0.5; /* s */
+static const uint64_t MAX_ITERATIONS = 1000000000;
+
+static double seconds( const clockid_t clock )
+{
+    timespec ts;
+    SystemCall( "clock_gettime", clock_gettime( clock, &ts ) );
+    return ts.tv_sec + ts.tv_nsec / double( NS_PER_SECOND );
+}
+
+static string json_string( const string & str )
+{
+    string ret = "\"";
+    for ( const char ch : str ) {
+        if ( ch == '"' or ch == '\\' ) {
+            ret.push_back( '\\' );
+        }
+        ret.push_back( ch );
+    }
+    return ret + "\"";
+}
+
+struct Result
+{
+    uint64_t iterations;
+    double real_time, cpu_time; /* s, all iterations */
+    uint64_t items, allocations;
+};
+
+static Result run_once( const BenchmarkSuite::Function & function, const uint64_t iterations )
+{
+    BenchmarkState state( iterations );
+
+    const uint64_t allocations_before = allocation_count();
+    const double real_start = seconds( CLOCK_MONOTONIC ), cpu_start = seconds( CLOCK_PROCESS_CPUTIME_ID );
+
+    function( state );
+
+    const double cpu_end = seconds( CLOCK_PROCESS_CPUTIME_ID ), real_end = seconds( CLOCK_MONOTONIC );
+
+    return { iterations, real_end - real_start, cpu_end - cpu_start,
+             state.items_processed(), allocation_count() - allocations_before };
+}
+
+void BenchmarkSuite::add( const string & name, const Function & function )
+{
+    benchmarks_.push_back( { name, function } );
+}
+
+void BenchmarkSuite::run( const string & executable, const string & filter ) const
+{
+    char date[ 64 ];
+    const time_t now = time( nullptr );
+    strftime( date, sizeof( date ), "%Y-%m-%dT%H:%M:%S%z", localtime( &now ) );
+
+    printf( "{\n  \"context\": {\n" );
+    printf( "    \"date\": %s,\n", json_string( date ).c_str() );
+    printf( "    \"executable\": %s,\n", json_string( executable ).c_str() );
+    printf( "    \"num_cpus\": %ld,\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+    printf( "    \"library_build_type\": \"release\"\n  },\n" );
+    printf( "  \"benchmarks\": [" );
+
+    fprintf( stderr, "%-50s %14s %14s %12s %14s %12s\n",
+             "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Items/s", "Allocs/iter" );
+
+    bool first = true;
+
+    for ( const auto & benchmark : benchmarks_ ) {
+        if ( benchmark.name.find( filter ) == string::npos ) {
+            continue;
+        }
+
+        /* grow the run until it is long enough to time */
+        Result result = run_once( benchmark.function, 1 );
+
+        while ( result.real_time < MIN_TIME and result.iterations < MAX_ITERATIONS ) {
+            double multiplier = result.real_time > 0 ? 1.4 * MIN_TIME / result.real_time : 10;
+            multiplier = max( 2.0, min( 10.0, multiplier ) );
+            result = run_once( benchmark.function, min( MAX_ITERATIONS, uint64_t( result.iterations * multiplier ) ) );
+        }
+
+        const double real_ns = result.real_time * NS_PER_SECOND / result.iterations;
+        const double cpu_ns = result.cpu_time * NS_PER_SECOND / result.iterations;
+        const double items_per_second = result.items / result.real_time;
+        const double allocations_per_iteration = double( result.allocations ) / result.iterations;
+
+        fprintf( stderr, "%-50s %14.1f %14.1f %12" PRIu64 " %14.4g %12.3f\n",
+                 benchmark.name.c_str(), real_ns, cpu_ns, result.iterations,
+                 items_per_second, allocations_per_iteration );
+
+        printf( "%s\n    {\n", first ? "" : "," );
+        printf( "      \"name\": %s,\n", json_string( benchmark.name ).c_str() );
+        printf( "      \"run_name\": %s,\n", json_string( benchmark.name ).c_str() );
+        printf( "      \"run_type\": \"iteration\",\n" );
+        printf( "      \"iterations\": %" PRIu64 ",\n", result.iterations );
+        printf( "      \"real_time\": %.6e,\n", real_ns );
+        printf( "      \"cpu_time\": %.6e,\n", cpu_ns );
+        printf( "      \"time_unit\": \"ns\",\n" );
+        printf( "      \"items_per_second\": %.6e,\n", items_per_second );
+        printf( "      \"allocs_per_iter\": %.6e\n", allocations_per_iteration );
+        printf( "    }" );
+
+        first = false;
+    }
+
+    printf( "\n  ]\n}\n" );
+}
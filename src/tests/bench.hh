@@ -0,0 +1,63 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef BENCH_HH
+#define BENCH_HH
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+/* A small benchmark harness after Google Benchmark: a benchmark is a
+   function that repeats its work while state.keep_running() is true.
+   The harness raises the iteration count until a run takes long enough
+   to time, then reports time, throughput and heap allocations per
+   iteration, as a table on stderr and as JSON (in Google Benchmark's
+   schema, so its comparison tools work) on stdout. */
+
+class BenchmarkState
+{
+private:
+    uint64_t iterations_;
+    uint64_t remaining_;
+    uint64_t items_processed_;
+
+public:
+    BenchmarkState( const uint64_t iterations )
+        : iterations_( iterations ), remaining_( iterations ), items_processed_( 0 )
+    {}
+
+    bool keep_running( void ) { return remaining_-- > 0; }
+
+    uint64_t iterations( void ) const { return iterations_; }
+
+    /* units of work done in all (e.g. packets), if not one per iteration */
+    void set_items_processed( const uint64_t items ) { items_processed_ = items; }
+    uint64_t items_processed( void ) const { return items_processed_ ? items_processed_ : iterations_; }
+};
+
+class BenchmarkSuite
+{
+public:
+    typedef std::function<void(BenchmarkState &)> Function;
+
+private:
+    struct Benchmark
+    {
+        std::string name;
+        Function function;
+    };
+
+    std::vector<Benchmark> benchmarks_ {};
+
+public:
+    void add( const std::string & name, const Function & function );
+
+    /* run the benchmarks whose names contain filter (all if empty) */
+    void run( const std::string & executable, const std::string & filter ) const;
+};
+
+/* heap allocations so far (counted by this harness's operator new) */
+uint64_t allocation_count( void );
+
+#endif /* BENCH_HH */
@@ -0,0 +1,321 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <random>
+#include <cstring>
+#include <netinet/in.h>
+
+#include "bench.hh"
+#include "packet_queue_factory.hh"
+#include "packet_buffer.hh"
+#include "link_queue.hh"
+#include "timing_wheel.hh"
+#include "delay_rule_table.hh"
+#include "clock.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Microbenchmarks for the packet queues and for LinkQueue, all on a
+   virtual clock: "make bench" runs them on the bundled traces. */
+
+static const size_t PACKET_SIZE = 1504;
+
+/* enqueue one packet and dequeue one, keeping the queue at a steady
+   occupancy; the virtual clock moves 1 us per packet, so the AQMs see
+   100 us of queueing delay and drop nothing */
+static void queue_steady_state( BenchmarkState & state, const string & type, const string & args )
+{
+    static const unsigned int OCCUPANCY = 100;
+    static const uint64_t NS_PER_PACKET = 1000;
+
+    VirtualClock clock;
+    PacketBufferPool pool; /* outlives the queue */
+    unique_ptr<AbstractPacketQueue> queue = make_packet_queue( type, args, clock );
+
+    for ( unsigned int i = 0; i < OCCUPANCY; i++ ) {
+        clock.advance_to( clock.now_ns() + NS_PER_PACKET );
+        queue->enqueue( QueuedPacket( pool.make_unfilled( PACKET_SIZE ), clock.now_ns() ) );
+    }
+
+    while ( state.keep_running() ) {
+        clock.advance_to( clock.now_ns() + NS_PER_PACKET );
+        queue->enqueue( QueuedPacket( pool.make_unfilled( PACKET_SIZE ), clock.now_ns() ) );
+
+        if ( not queue->empty() ) {
+            queue->dequeue();
+        }
+    }
+}
+
+/* enqueue into a queue that is already full, so every packet is refused
+   (or, for fq_codel, makes room by dropping others) */
+static void queue_overflow( BenchmarkState & state, const string & type, const string & args )
+{
+    VirtualClock clock;
+    PacketBufferPool pool; /* outlives the queue */
+    unique_ptr<AbstractPacketQueue> queue = make_packet_queue( type, args, clock );
+
+    while ( true ) {
+        const unsigned int packets_before = queue->size_packets();
+        queue->enqueue( QueuedPacket( pool.make_unfilled( PACKET_SIZE ), clock.now_ns() ) );
+        if ( queue->size_packets() <= packets_before ) {
+            break;
+        }
+    }
+
+    while ( state.keep_running() ) {
+        queue->enqueue( QueuedPacket( pool.make_unfilled( PACKET_SIZE ), clock.now_ns() ) );
+    }
+}
+
+static string basename( const string & path )
+{
+    const size_t slash = path.rfind( '/' );
+    return slash == string::npos ? path : path.substr( slash + 1 );
+}
+
+/* the queue for a LinkQueue<PacketQueueType>: of that type, or for
+   LinkQueue<>, of whatever type the name says */
+template <class PacketQueueType>
+static unique_ptr<PacketQueueType> make_link_packet_queue( const string &, const string & args, const Clock & clock )
+{
+    return make_packet_queue_of_type<PacketQueueType>( args, clock );
+}
+
+template <>
+unique_ptr<AbstractPacketQueue> make_link_packet_queue<AbstractPacketQueue>( const string & type, const string & args,
+                                                                             const Clock & clock )
+{
+    return make_packet_queue( type, args, clock );
+}
+
+/* run a link as mm-link-sim does, one wakeup per iteration, either
+   kept busy (always at least BACKLOG packets waiting) or idle; with
+   PacketQueueType = AbstractPacketQueue the link's calls to the queue
+   are virtual (as in mm-link-sim and mm-net), and otherwise they are
+   direct (as in mm-link) */
+template <class PacketQueueType>
+static void link_wakeups( BenchmarkState & state, const string & trace, const bool busy,
+                          const string & type, const string & args )
+{
+    static const size_t BACKLOG = 64;
+
+    VirtualClock clock;
+    PacketBufferPool pool; /* outlives the link */
+    LinkQueue<PacketQueueType> link( "bench", trace, "", false, true, false, false,
+                                     make_link_packet_queue<PacketQueueType>( type, args, clock ), "", clock );
+    vector<PacketBuffer> batch;
+
+    size_t outstanding = 0;
+    uint64_t delivered = 0;
+
+    while ( state.keep_running() ) {
+        /* (packets an AQM dropped are gone once the link is empty) */
+        if ( link.empty() ) {
+            outstanding = 0;
+        }
+
+        if ( busy and outstanding < BACKLOG ) {
+            while ( outstanding < 2 * BACKLOG ) {
+                batch.push_back( pool.make_unfilled( PACKET_SIZE ) );
+                outstanding++;
+            }
+            link.read_packets( batch );
+        }
+
+        clock.advance_to( clock.now_ns() + link.wait_time() );
+
+        const size_t departures = link.discard_output();
+        outstanding -= departures;
+        delivered += departures;
+    }
+
+    if ( busy ) {
+        state.set_items_processed( delivered );
+    }
+}
+
+/* the busy link with its queue called virtually and directly, for comparison */
+template <class PacketQueueType>
+static void add_link_queue_benchmarks( BenchmarkSuite & suite, const string & trace,
+                                       const string & type, const string & args )
+{
+    const string name = "link/" + type + "/" + basename( trace );
+
+    suite.add( name + "/virtual",
+               [trace, type, args] ( BenchmarkState & state ) {
+                   link_wakeups<AbstractPacketQueue>( state, trace, true, type, args ); } );
+    suite.add( name + "/static",
+               [trace, type, args] ( BenchmarkState & state ) {
+                   link_wakeups<PacketQueueType>( state, trace, true, type, args ); } );
+}
+
+/* hold packets for random delays of up to a second, one arriving
+   every 5 us (about 100k waiting), in a timing wheel or, for
+   comparison, in a heap ordered by release time */
+static const uint64_t DELAY_ARRIVAL_NS = 5000;
+
+static void wheel_delays( BenchmarkState & state )
+{
+    PacketBufferPool pool; /* outlives the wheel */
+    TimingWheel wheel;
+    default_random_engine prng;
+    uniform_int_distribution<uint64_t> delay( 0, NS_PER_SECOND );
+
+    uint64_t now = 0;
+
+    while ( state.keep_running() ) {
+        now += DELAY_ARRIVAL_NS;
+        wheel.insert( now + delay( prng ), pool.make_unfilled( PACKET_SIZE ) );
+
+        wheel.advance( now );
+        while ( wheel.has_ready() ) {
+            wheel.pop_ready();
+        }
+    }
+}
+
+static void heap_delays( BenchmarkState & state )
+{
+    typedef pair<uint64_t, PacketBuffer> Entry;
+    struct Later
+    {
+        bool operator()( const Entry & lhs, const Entry & rhs ) const { return lhs.first > rhs.first; }
+    };
+
+    PacketBufferPool pool; /* outlives the heap */
+    priority_queue<Entry, vector<Entry>, Later> heap;
+    default_random_engine prng;
+    uniform_int_distribution<uint64_t> delay( 0, NS_PER_SECOND );
+
+    uint64_t now = 0;
+
+    while ( state.keep_running() ) {
+        now += DELAY_ARRIVAL_NS;
+        heap.emplace( now + delay( prng ), pool.make_unfilled( PACKET_SIZE ) );
+
+        while ( not heap.empty() and heap.top().first <= now ) {
+            heap.pop();
+        }
+    }
+}
+
+/* classify packets against 5,000 TCP address:port rules (as
+   gen_packet_delay_rules.py writes them), with some IPv4 and IPv6
+   prefix rules besides; one probe in four matches no rule */
+static void rule_lookups( BenchmarkState & state )
+{
+    static const unsigned int RULES = 5000, PREFIXES = 100, PROBES = 4096;
+
+    default_random_engine prng;
+    uniform_int_distribution<uint32_t> word;
+
+    DelayRules_t rules;
+    vector< pair<uint32_t, uint16_t> > endpoints;
+    for ( unsigned int i = 0; i < RULES; i++ ) {
+        IPPrefix prefix = IPPrefix::parse( "0.0.0.0" );
+        const uint32_t addr = word( prng );
+        memcpy( prefix.addr, &addr, 4 );
+        const uint16_t port = i % 2 ? 443 : 80;
+        rules.emplace_back( IPPROTO_TCP, prefix, port, 10, 10 );
+        endpoints.emplace_back( addr, port );
+    }
+    for ( unsigned int i = 0; i < PREFIXES; i++ ) {
+        rules.emplace_back( IPPROTO_TCP, IPPrefix::parse( "10." + to_string( i ) + ".0.0/16" ), 0, 20, 20 );
+        rules.emplace_back( IPPROTO_TCP, IPPrefix::parse( "2001:db8:" + to_string( i ) + "::/48" ), 443, 20, 20 );
+    }
+
+    const DelayRuleTable table( rules );
+
+    vector< pair<uint32_t, uint16_t> > probes;
+    for ( unsigned int i = 0; i < PROBES; i++ ) {
+        if ( i % 4 == 3 ) {
+            probes.emplace_back( word( prng ), 443 );
+        } else {
+            probes.push_back( endpoints.at( word( prng ) % endpoints.size() ) );
+        }
+    }
+
+    unsigned int i = 0, matched = 0;
+    while ( state.keep_running() ) {
+        const auto & probe = probes[ i++ % PROBES ];
+        matched += table.lookup( AF_INET, IPPROTO_TCP, reinterpret_cast<const uint8_t *>( &probe.first ),
+                                 true, probe.second ) != DelayRuleTable::NO_RULE;
+    }
+
+    if ( state.iterations() > PROBES and matched == 0 ) {
+        throw runtime_error( "rule_lookups: no probe matched" );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    try {
+        string filter;
+        vector<string> traces;
+
+        for ( int i = 1; i < argc; i++ ) {
+            const string arg = argv[ i ];
+            if ( arg.compare( 0, 9, "--filter=" ) == 0 ) {
+                filter = arg.substr( 9 );
+            } else {
+                traces.push_back( arg );
+            }
+        }
+
+        BenchmarkSuite suite;
+
+        const vector< pair<string, string> > queues = {
+            { "infinite", "" },
+            { "droptail", "packets=1000" },
+            { "drophead", "packets=1000" },
+            { "codel", "packets=1000, target=5, interval=100" },
+            { "pie", "packets=1000, qdelay_ref=20, max_burst=100" },
+            { "fq_codel", "packets=1000, target=5, interval=100" } };
+
+        for ( const auto & queue : queues ) {
+            suite.add( "queue/" + queue.first + "/steady_state",
+                       [queue] ( BenchmarkState & state ) { queue_steady_state( state, queue.first, queue.second ); } );
+        }
+
+        for ( const auto & queue : queues ) {
+            if ( queue.first != "infinite" ) {
+                suite.add( "queue/" + queue.first + "/overflow",
+                           [queue] ( BenchmarkState & state ) { queue_overflow( state, queue.first, queue.second ); } );
+            }
+        }
+
+        suite.add( "delay/wheel", wheel_delays );
+        suite.add( "delay/heap", heap_delays );
+        suite.add( "rules/lookup", rule_lookups );
+
+        for ( const auto & trace : traces ) {
+            suite.add( "link/" + basename( trace ) + "/busy",
+                       [trace] ( BenchmarkState & state ) {
+                           link_wakeups<AbstractPacketQueue>( state, trace, true, "infinite", "" ); } );
+            suite.add( "link/" + basename( trace ) + "/idle",
+                       [trace] ( BenchmarkState & state ) {
+                           link_wakeups<AbstractPacketQueue>( state, trace, false, "infinite", "" ); } );
+        }
+
+        if ( not traces.empty() ) {
+            const string & trace = traces.front();
+            add_link_queue_benchmarks<InfinitePacketQueue>( suite, trace, "infinite", "" );
+            add_link_queue_benchmarks<DropTailPacketQueue>( suite, trace, "droptail", "packets=1000" );
+            add_link_queue_benchmarks<DropHeadPacketQueue>( suite, trace, "drophead", "packets=1000" );
+            add_link_queue_benchmarks<CODELPacketQueue>( suite, trace, "codel", "packets=1000, target=5, interval=100" );
+            add_link_queue_benchmarks<PIEPacketQueue>( suite, trace, "pie", "packets=1000, qdelay_ref=20, max_burst=100" );
+            add_link_queue_benchmarks<FQCODELPacketQueue>( suite, trace, "fq_codel", "packets=1000, target=5, interval=100" );
+        }
+
+        suite.run( argv[ 0 ], filter );
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <cstring>
+
+#include "timing_wheel.hh"
+#include "packet_buffer.hh"
+#include "timestamp.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* Drives a TimingWheel the way the delay queues do (waking at
+   next_release_time() and advancing to it), with delays spread across
+   every level of the wheel and clustered on the boundaries where slots
+   cascade, and checks that each wakeup releases a packet, that no
+   packet leaves early or late, and that packets leave in order of
+   release time (in order of arrival for equal release times). */
+
+static const uint64_t TICK_NS = 1024;
+
+/* a slot on each of the lowest levels covers 256 times the one below */
+static const vector<uint64_t> BOUNDARIES_NS = { TICK_NS << 8, TICK_NS << 16, TICK_NS << 24 };
+
+struct Waiting
+{
+    uint64_t release_time;
+    uint64_t sequence;
+};
+
+static void check( const bool condition, const string & what )
+{
+    if ( not condition ) {
+        throw runtime_error( "timing-wheel-test: " + what );
+    }
+}
+
+static uint64_t random_delay( default_random_engine & prng )
+{
+    uniform_int_distribution<unsigned int> kind( 0, 3 );
+    uniform_int_distribution<uint64_t> small( 0, 4 * TICK_NS );
+
+    switch ( kind( prng ) ) {
+    case 0: /* within the lowest level's rotation (262 us) */
+        return uniform_int_distribution<uint64_t>( 0, BOUNDARIES_NS[ 0 ] )( prng );
+    case 1: /* up to 20 s, past two cascades */
+        return uniform_int_distribution<uint64_t>( 0, 20 * NS_PER_SECOND )( prng );
+    case 2: /* just either side of a cascade boundary */
+        {
+            const uint64_t boundary = BOUNDARIES_NS.at( uniform_int_distribution<size_t>( 0, 2 )( prng ) );
+            return boundary - 2 * TICK_NS + small( prng );
+        }
+    default: /* fixed delays, like mm-delay's, with packets sharing ticks */
+        return 80 * NS_PER_MS;
+    }
+}
+
+static void run( const uint64_t seed )
+{
+    default_random_engine prng( seed );
+    uniform_int_distribution<uint64_t> gap( 0, 3 * NS_PER_MS );
+    uniform_int_distribution<unsigned int> burst( 1, 8 );
+
+    PacketBufferPool pool; /* outlives the wheel */
+    TimingWheel wheel;
+
+    vector<Waiting> waiting; /* by sequence number */
+    uint64_t next_sequence = 0, released = 0;
+
+    uint64_t now = 0, next_arrival = 0;
+    Waiting last_released = { 0, 0 };
+    bool any_released = false;
+
+    static const unsigned int ARRIVALS = 20000;
+    unsigned int arrivals = 0;
+
+    while ( arrivals < ARRIVALS or not wheel.empty() ) {
+        const uint64_t release = wheel.next_release_time();
+        const bool arrival = arrivals < ARRIVALS and next_arrival <= release;
+        const uint64_t previous = now;
+
+        now = max( now, arrival ? next_arrival : release );
+        wheel.advance( now );
+
+        /* a wakeup for a release must release something */
+        check( arrival or wheel.has_ready(), "woke at " + to_string( now ) + " ns with nothing released" );
+
+        while ( wheel.has_ready() ) {
+            uint64_t sequence;
+            check( wheel.next_ready().size() == sizeof( sequence ), "packet contents changed" );
+            memcpy( &sequence, wheel.next_ready().data(), sizeof( sequence ) );
+            wheel.pop_ready();
+
+            const Waiting & packet = waiting.at( sequence );
+            check( packet.release_time <= now, "packet " + to_string( sequence ) + " released early" );
+            check( packet.release_time > previous or packet.release_time == now,
+                   "packet " + to_string( sequence ) + " released late" );
+
+            if ( any_released ) {
+                check( packet.release_time > last_released.release_time
+                       or ( packet.release_time == last_released.release_time
+                            and packet.sequence > last_released.sequence ),
+                       "packet " + to_string( sequence ) + " released out of order" );
+            }
+
+            last_released = packet;
+            any_released = true;
+            released++;
+        }
+
+        if ( arrival ) {
+            for ( unsigned int i = burst( prng ); i > 0; i-- ) {
+                const uint64_t sequence = next_sequence++;
+                waiting.push_back( { now + random_delay( prng ), sequence } );
+                wheel.insert( waiting.back().release_time,
+                              pool.make( string( reinterpret_cast<const char *>( &sequence ), sizeof( sequence ) ) ) );
+            }
+
+            arrivals++;
+            next_arrival = now + gap( prng );
+        }
+    }
+
+    check( released == next_sequence, "released " + to_string( released ) + " of "
+           + to_string( next_sequence ) + " packets" );
+    check( wheel.next_release_time() == UINT64_MAX, "empty wheel has a release time" );
+}
+
+int main()
+{
+    try {
+        for ( uint64_t seed = 1; seed <= 5; seed++ ) {
+            run( seed );
+        }
+    } catch ( const exception & e ) {
+        print_exception( e );
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
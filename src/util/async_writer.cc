@@ -0,0 +1,129 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include "async_writer.hh"
+#include "exception.hh"
+
+using namespace std;
+
+/* the writer thread also wakes up this often on its own, so a quiet
+   producer's records don't sit in the ring indefinitely */
+static const auto WRITER_PERIOD = chrono::milliseconds( 20 );
+
+AsyncWriter::AsyncWriter( FileDescriptor && fd, const size_t capacity )
+    : fd_( move( fd ) ),
+      ring_( new char[ capacity ] ),
+      capacity_( capacity ),
+      head_( 0 ),
+      tail_( 0 ),
+      mutex_(),
+      data_available_(),
+      space_available_(),
+      halt_( false ),
+      failed_( false ),
+      writer_thread_exception_(),
+      writer_thread_( [&] () {
+              try {
+                  writer_loop();
+              } catch ( ... ) {
+                  writer_thread_exception_ = current_exception();
+                  failed_ = true;
+                  space_available_.notify_all();
+              } } )
+{}
+
+void AsyncWriter::writer_loop( void )
+{
+    uint64_t tail = tail_.load();
+
+    while ( true ) {
+        /* read halt_ first: everything appended before the halt is then visible below */
+        const bool halting = halt_;
+        const uint64_t head = head_.load( memory_order_acquire );
+
+        if ( head == tail ) {
+            if ( halting ) {
+                return;
+            }
+
+            unique_lock<mutex> lock { mutex_ };
+            data_available_.wait_for( lock, WRITER_PERIOD );
+            continue;
+        }
+
+        /* write the contiguous part of [ tail, head ) */
+        const size_t offset = tail % capacity_;
+        const size_t length = min( head - tail, capacity_ - offset );
+
+        fd_.write( ring_.get() + offset, length );
+
+        tail += length;
+        tail_.store( tail, memory_order_release );
+
+        space_available_.notify_one();
+    }
+}
+
+void AsyncWriter::wait_for_space( const size_t length )
+{
+    unique_lock<mutex> lock { mutex_ };
+    data_available_.notify_one();
+
+    while ( head_.load() + length - tail_.load( memory_order_acquire ) > capacity_ ) {
+        if ( failed_ ) {
+            rethrow_exception( writer_thread_exception_ );
+        }
+
+        space_available_.wait_for( lock, WRITER_PERIOD );
+    }
+}
+
+void AsyncWriter::write( const char * data, const size_t length )
+{
+    if ( failed_ ) {
+        rethrow_exception( writer_thread_exception_ );
+    }
+
+    if ( length > capacity_ ) {
+        throw runtime_error( "AsyncWriter: write of " + to_string( length )
+                             + " bytes exceeds buffer size of " + to_string( capacity_ ) );
+    }
+
+    const uint64_t head = head_.load();
+    const uint64_t used = head - tail_.load( memory_order_acquire );
+
+    if ( used + length > capacity_ ) {
+        wait_for_space( length );
+    }
+
+    /* copy in, wrapping around the end of the ring */
+    const size_t offset = head % capacity_;
+    const size_t first_part = min( length, capacity_ - offset );
+    memcpy( ring_.get() + offset, data, first_part );
+    memcpy( ring_.get(), data + first_part, length - first_part );
+
+    head_.store( head + length, memory_order_release );
+
+    /* wake the writer early once the ring is half full */
+    if ( used < capacity_ / 2 and used + length >= capacity_ / 2 ) {
+        data_available_.notify_one();
+    }
+}
+
+AsyncWriter::~AsyncWriter()
+{
+    halt_ = true;
+    data_available_.notify_one();
+    writer_thread_.join();
+
+    if ( failed_ ) {
+        try {
+            rethrow_exception( writer_thread_exception_ );
+        } catch ( const exception & e ) { /* don't throw from destructor */
+            print_exception( e );
+        }
+    }
+}
@@ -0,0 +1,59 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef ASYNC_WRITER_HH
+#define ASYNC_WRITER_HH
+
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "file_descriptor.hh"
+
+/* Appends bytes to a ring buffer and leaves the write() system calls
+   to a background thread, so the caller never waits on the disk
+   (unless the ring fills up). One producer thread only. */
+class AsyncWriter
+{
+private:
+    FileDescriptor fd_;
+
+    std::unique_ptr<char[]> ring_;
+    const size_t capacity_;
+
+    /* running totals of bytes appended and bytes written out;
+       head_ is only advanced by the producer, tail_ by the writer thread */
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+
+    std::mutex mutex_;
+    std::condition_variable data_available_;
+    std::condition_variable space_available_;
+
+    std::atomic<bool> halt_;
+    std::atomic<bool> failed_;
+
+    std::exception_ptr writer_thread_exception_;
+    std::thread writer_thread_;
+
+    void writer_loop( void );
+
+    void wait_for_space( const size_t length );
+
+public:
+    AsyncWriter( FileDescriptor && fd, const size_t capacity );
+
+    /* writes out everything appended so far */
+    ~AsyncWriter();
+
+    void write( const char * data, const size_t length );
+    void write( const std::string & buffer ) { write( buffer.data(), buffer.size() ); }
+
+    /* ban copying */
+    AsyncWriter( const AsyncWriter & other ) = delete;
+    AsyncWriter & operator=( const AsyncWriter & other ) = delete;
+};
+
+#endif /* ASYNC_WRITER_HH */
@@ -0,0 +1,24 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#include <string>
+
+#include "clock.hh"
+#include "exception.hh"
+
+using namespace std;
+
+const Clock & system_clock( void )
+{
+    static SystemClock clock;
+    return clock;
+}
+
+void VirtualClock::advance_to( const uint64_t time )
+{
+    if ( time < now_ ) {
+        throw runtime_error( "VirtualClock: cannot go back from " + to_string( now_ )
+                             + " ns to " + to_string( time ) + " ns" );
+    }
+
+    now_ = time;
+}
@@ -0,0 +1,47 @@
+/* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+#ifndef CLOCK_HH
+#define CLOCK_HH
+
+#include <cstdint>
+
+#include "timestamp.hh"
+
+/* where emulation code gets the current time: the monotonic system
+   clock when emulating live traffic, or a virtual clock that a
+   simulation moves forward as fast as it likes */
+class Clock
+{
+public:
+    /* nanoseconds since the initial timestamp */
+    virtual uint64_t now_ns( void ) const = 0;
+
+    uint64_t now_ms( void ) const { return now_ns() / NS_PER_MS; }
+
+    virtual ~Clock() {}
+};
+
+class SystemClock : public Clock
+{
+public:
+    uint64_t now_ns( void ) const override { return timestamp_ns(); }
+};
+
+/* the system clock, for everything that runs in real time */
+const Clock & system_clock( void );
+
+class VirtualClock : public Clock
+{
+private:
+    uint64_t now_;
+
+public:
+    VirtualClock( const uint64_t start = 0 ) : now_( start ) {}
+
+    uint64_t now_ns( void ) const override { return now_; }
+
+    /* time never goes backwards */
+    void advance_to( const uint64_t time );
+};
+
+#endif /* CLOCK_HH */
@@ -23,7 +23,8 @@ private:
 protected:
     void add_action( Poller::Action action ) { poller_.add_action( action ); }
 
-    int internal_loop( const std::function<int(void)> & wait_time );
+    /* wait_time is in nanoseconds (negative to wait indefinitely) */
+    int internal_loop( const std::function<int64_t(void)> & wait_time );
 
 public:
     EventLoop();
@@ -47,3 +47,29 @@ double myatof( const string & str )
 
     return ret;
 }
+
+uint64_t myatoms_ns( const string & str )
+{
+    const auto point = str.find( '.' );
+
+    const string whole = str.substr( 0, point );
+
+    /* digits only: strtoul would quietly accept a sign */
+    if ( whole.empty() or whole.find_first_not_of( "0123456789" ) != string::npos ) {
+        throw runtime_error( "Invalid millisecond value: " + str );
+    }
+
+    uint64_t ns = myatoi( whole ) * 1000000;
+
+    if ( point != string::npos ) {
+        const string fraction = str.substr( point + 1 );
+        if ( fraction.empty() or fraction.size() > 6
+             or fraction.find_first_not_of( "0123456789" ) != string::npos ) {
+            throw runtime_error( "Invalid millisecond value (at most six digits after the point): " + str );
+        }
+
+        ns += myatoi( fraction + string( 6 - fraction.size(), '0' ) );
+    }
+
+    return ns;
+}
@@ -4,8 +4,12 @@
 #define EZIO_HH
 
 #include <string>
+#include <cstdint>
 
 long int myatoi( const std::string & str, const int base = 10 );
 double myatof( const std::string & str );
 
+/* milliseconds, with an optional fraction of up to six digits, as nanoseconds */
+uint64_t myatoms_ns( const std::string & str );
+
 #endif /* EZIO_HH */
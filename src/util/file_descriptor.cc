@@ -5,6 +5,7 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 
 using namespace std;
 
@@ -93,3 +94,55 @@ string::const_iterator FileDescriptor::write( const std::string & buffer, const
 
     return it;
 }
+
+/* read into a caller-owned buffer */
+size_t FileDescriptor::read( char * buffer, const size_t capacity )
+{
+    const ssize_t result = ::read( fd_, buffer, capacity );
+    if ( result < 0 and ( errno == EAGAIN or errno == EWOULDBLOCK ) ) {
+        register_read();
+        return 0;
+    }
+
+    ssize_t bytes_read = SystemCall( "read", result );
+    if ( bytes_read == 0 ) {
+        set_eof();
+    }
+
+    register_read();
+
+    return bytes_read;
+}
+
+/* write all of a caller-owned buffer */
+void FileDescriptor::write( const char * buffer, const size_t length )
+{
+    if ( length == 0 ) {
+        throw runtime_error( "nothing to write" );
+    }
+
+    size_t offset = 0;
+
+    do {
+        ssize_t bytes_written = SystemCall( "write", ::write( fd_, buffer + offset, length - offset ) );
+        if ( bytes_written == 0 ) {
+            throw runtime_error( "write returned 0" );
+        }
+
+        register_write();
+
+        offset += bytes_written;
+    } while ( offset < length );
+}
+
+void FileDescriptor::set_blocking( const bool blocking )
+{
+    int flags = SystemCall( "fcntl F_GETFL", fcntl( fd_, F_GETFL ) );
+    if ( blocking ) {
+        flags &= ~O_NONBLOCK;
+    } else {
+        flags |= O_NONBLOCK;
+    }
+
+    SystemCall( "fcntl F_SETFL", fcntl( fd_, F_SETFL, flags ) );
+}
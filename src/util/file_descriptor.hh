@@ -38,12 +38,19 @@ public:
     unsigned int read_count( void ) const { return read_count_; }
     unsigned int write_count( void ) const { return write_count_; }
 
+    void set_blocking( const bool blocking );
+
     /* read and write methods */
     std::string read( const size_t limit = BUFFER_SIZE );
     std::string::const_iterator write( const std::string & buffer, const bool write_all = true );
     std::string::const_iterator write( const std::string::const_iterator & begin,
                                        const std::string::const_iterator & end );
 
+    /* read into, or write all of, a caller-owned buffer without copying
+       (a non-blocking read with nothing available returns 0, leaving eof() false) */
+    size_t read( char * buffer, const size_t capacity );
+    void write( const char * buffer, const size_t length );
+
     /* forbid copying FileDescriptor objects or assigning them */
     FileDescriptor( const FileDescriptor & other ) = delete;
     const FileDescriptor & operator=( const FileDescriptor & other ) = delete;
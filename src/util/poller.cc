@@ -1,8 +1,14 @@
 /* -*-mode:c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
 
 #include <algorithm>
-#include <numeric>
+#include <limits>
+#include <cerrno>
+
+#include <sys/timerfd.h>
+
 #include "poller.hh"
+#include "timestamp.hh"
+#include "util.hh"
 #include "exception.hh"
 
 using namespace std;
@@ -10,8 +16,22 @@ using namespace PollerShortNames;
 
 void Poller::add_action( Poller::Action action )
 {
-    actions_.push_back( action );
-    pollfds_.push_back( { action.fd.fd_num(), 0, 0 } );
+    const int fd_num = action.fd.fd_num();
+    Registration & registration = registrations_[ fd_num ];
+
+    if ( action.when_interested and registration.conditional_entries++ == 0 ) {
+        conditional_fds_.push_back( fd_num );
+    }
+
+    registration.entries.push_back( { action, false } );
+
+    /* the fd may be a new one that reuses the number of one that was
+       closed, so tell the kernel about it again even if the events
+       don't change */
+    registration.in_kernel = false;
+
+    /* takes effect at the next poll */
+    mark_stale( fd_num, registration );
 }
 
 unsigned int Poller::Action::service_count( void ) const
@@ -19,59 +39,247 @@ unsigned int Poller::Action::service_count( void ) const
     return direction == Direction::In ? fd.read_count() : fd.write_count();
 }
 
-Poller::Result Poller::poll( const int & timeout_ms )
+static uint32_t epoll_events( const Direction direction )
 {
-    assert( pollfds_.size() == actions_.size() );
+    return direction == Direction::In ? EPOLLIN : EPOLLOUT;
+}
 
-    /* tell poll whether we care about each fd */
-    for ( unsigned int i = 0; i < actions_.size(); i++ ) {
-        assert( pollfds_.at( i ).fd == actions_.at( i ).fd.fd_num() );
-        pollfds_.at( i ).events = (actions_.at( i ).active and actions_.at( i ).when_interested())
-            ? actions_.at( i ).direction : 0;
+void Poller::mark_stale( const int fd_num, Registration & registration )
+{
+    if ( not registration.stale ) {
+        registration.stale = true;
+        stale_fds_.push_back( fd_num );
+    }
+}
+
+/* ask the actions on a file descriptor whether they are interested */
+void Poller::refresh_registration( const int fd_num, Registration & registration )
+{
+    uint32_t events = 0;
+
+    for ( auto & entry : registration.entries ) {
+        entry.interested = entry.action.active
+            and ( not entry.action.when_interested or entry.action.when_interested() );
 
         /* don't poll in on fds that have had EOF */
-        if ( actions_.at( i ).direction == Direction::In
-             and actions_.at( i ).fd.eof() ) {
-            pollfds_.at( i ).events = 0;
+        if ( entry.action.direction == Direction::In
+             and entry.action.fd.eof() ) {
+            entry.interested = false;
+        }
+
+        if ( entry.interested ) {
+            events |= epoll_events( entry.action.direction );
+        }
+    }
+
+    registration.stale = false;
+
+    update_registration( fd_num, registration, events );
+}
+
+/* only tell the kernel when the interest in a file descriptor changes */
+void Poller::update_registration( const int fd_num, Registration & registration, const uint32_t events )
+{
+    if ( ( registration.events != 0 ) != ( events != 0 ) ) {
+        if ( events ) {
+            interested_registrations_++;
+        } else {
+            interested_registrations_--;
+        }
+    }
+
+    if ( registration.in_kernel and registration.events == events ) {
+        return;
+    }
+
+    epoll_event event;
+    event.events = events;
+    event.data.fd = fd_num;
+
+    /* (a registration not in the kernel may still be there from a
+       closed fd with the same number, which the kernel has forgotten
+       or keeps under the old file, so modify if possible and add if not) */
+    if ( epoll_ctl( epoll_->fd_num(), EPOLL_CTL_MOD, fd_num, &event ) < 0 ) {
+        if ( errno != ENOENT ) {
+            throw unix_error( "epoll_ctl" );
+        }
+        SystemCall( "epoll_ctl", epoll_ctl( epoll_->fd_num(), EPOLL_CTL_ADD, fd_num, &event ) );
+    }
+
+    registration.events = events;
+    registration.in_kernel = true;
+}
+
+/* forget cancelled actions, and the file descriptor once none are left */
+void Poller::remove_cancelled( const int fd_num )
+{
+    const auto registration = registrations_.find( fd_num );
+    if ( registration == registrations_.end() ) {
+        return;
+    }
+
+    for ( const auto & entry : registration->second.entries ) {
+        if ( not entry.action.active and entry.action.when_interested ) {
+            registration->second.conditional_entries--;
+        }
+    }
+
+    registration->second.entries.remove_if( [] ( const Entry & x ) { return not x.action.active; } );
+
+    if ( registration->second.conditional_entries == 0 ) {
+        conditional_fds_.erase( remove( conditional_fds_.begin(), conditional_fds_.end(), fd_num ),
+                                conditional_fds_.end() );
+    }
+
+    if ( registration->second.entries.empty() ) {
+        /* no error check: the kernel has already forgotten the fd if a callback closed it */
+        if ( registration->second.in_kernel ) {
+            epoll_ctl( epoll_->fd_num(), EPOLL_CTL_DEL, fd_num, nullptr );
+        }
+        if ( registration->second.events ) {
+            interested_registrations_--;
+        }
+        if ( registration->second.stale ) {
+            stale_fds_.erase( remove( stale_fds_.begin(), stale_fds_.end(), fd_num ), stale_fds_.end() );
+        }
+        registrations_.erase( registration );
+    }
+}
+
+/* one-shot expiry after timeout_ns, registered with epoll on first use */
+void Poller::arm_timer( const int64_t timeout_ns )
+{
+    if ( not timer_ ) {
+        timer_.reset( new FileDescriptor( SystemCall( "timerfd_create",
+                                                      timerfd_create( CLOCK_MONOTONIC,
+                                                                      TFD_NONBLOCK | TFD_CLOEXEC ) ) ) );
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = timer_->fd_num();
+        SystemCall( "epoll_ctl", epoll_ctl( epoll_->fd_num(), EPOLL_CTL_ADD, timer_->fd_num(), &event ) );
+    }
+
+    itimerspec expiry;
+    zero( expiry );
+    expiry.it_value.tv_sec = timeout_ns / NS_PER_SECOND;
+    expiry.it_value.tv_nsec = timeout_ns % NS_PER_SECOND;
+
+    SystemCall( "timerfd_settime", timerfd_settime( timer_->fd_num(), 0, &expiry, nullptr ) );
+}
+
+Poller::Result Poller::poll( const int & timeout_ms )
+{
+    return poll_ns( timeout_ms < 0 ? -1 : int64_t( timeout_ms ) * NS_PER_MS );
+}
+
+Poller::Result Poller::poll_ns( const int64_t timeout_ns )
+{
+    if ( not epoll_ ) {
+        epoll_.reset( new FileDescriptor( SystemCall( "epoll_create1", epoll_create1( EPOLL_CLOEXEC ) ) ) );
+    }
+
+    /* tell epoll whether we care about the fds whose interest may have changed */
+    for ( const int fd_num : conditional_fds_ ) {
+        refresh_registration( fd_num, registrations_.at( fd_num ) );
+    }
+
+    for ( const int fd_num : stale_fds_ ) {
+        Registration & registration = registrations_.at( fd_num );
+        if ( registration.stale ) {
+            refresh_registration( fd_num, registration );
         }
     }
+    stale_fds_.clear();
 
-    /* Quit if no member in pollfds_ has a non-zero direction */
-    if ( not accumulate( pollfds_.begin(), pollfds_.end(), false,
-                         [] ( bool acc, pollfd x ) { return acc or x.events; } ) ) {
+    /* Quit if no action is interested in its fd */
+    if ( interested_registrations_ == 0 ) {
         return Result::Type::Exit;
     }
 
-    if ( 0 == SystemCall( "poll", ::poll( &pollfds_[ 0 ], pollfds_.size(), timeout_ms ) ) ) {
+    /* whole milliseconds go straight to epoll_wait; anything finer uses the timer */
+    int timeout_ms = -1;
+    if ( timeout_ns >= 0 and timeout_ns % NS_PER_MS == 0 ) {
+        timeout_ms = min( timeout_ns / int64_t( NS_PER_MS ), int64_t( numeric_limits<int>::max() ) );
+    } else if ( timeout_ns >= 0 ) {
+        arm_timer( timeout_ns );
+    }
+
+    ready_.resize( registrations_.size() + 1 );
+
+    const int ready_count = SystemCall( "epoll_wait", epoll_wait( epoll_->fd_num(), &ready_[ 0 ],
+                                                                  ready_.size(), timeout_ms ) );
+    if ( ready_count == 0 ) {
         return Result::Type::Timeout;
     }
 
-    for ( unsigned int i = 0; i < pollfds_.size(); i++ ) {
-        if ( pollfds_[ i ].revents & (POLLERR | POLLHUP | POLLNVAL) ) {
+    bool timer_expired = false;
+
+    for ( int i = 0; i < ready_count; i++ ) {
+        const int fd_num = ready_[ i ].data.fd;
+        const uint32_t revents = ready_[ i ].events;
+
+        /* (a timer left armed by an earlier poll can also wake us early, which is harmless) */
+        if ( timer_ and fd_num == timer_->fd_num() ) {
+            uint64_t expirations;
+            timer_->read( reinterpret_cast<char *>( &expirations ), sizeof( expirations ) );
+            timer_expired = true;
+            continue;
+        }
+
+        if ( revents & (EPOLLERR | EPOLLHUP) ) {
             //            throw Exception( "poll fd error" );
             return Result::Type::Exit;
         }
 
-        if ( pollfds_[ i ].revents & pollfds_[ i ].events ) {
+        /* an earlier callback may have cancelled every action on this fd */
+        const auto found = registrations_.find( fd_num );
+        if ( found == registrations_.end() ) {
+            continue;
+        }
+
+        /* (callbacks may add actions, which can invalidate iterators into the map but not references) */
+        Registration & registration = found->second;
+        bool cancelled = false;
+
+        /* actions added by a callback are not interested until the next poll */
+        for ( auto & entry : registration.entries ) {
+            if ( not ( entry.interested and ( revents & epoll_events( entry.action.direction ) ) ) ) {
+                continue;
+            }
+
             /* we only want to call callback if revents includes
                the event we asked for */
-            const auto count_before = actions_.at( i ).service_count();
-            auto result = actions_.at( i ).callback();
+            const auto count_before = entry.action.service_count();
+            auto result = entry.action.callback();
 
             switch ( result.result ) {
             case ResultType::Exit:
                 return Result( Result::Type::Exit, result.exit_status );
             case ResultType::Cancel:
-                actions_.at( i ).active = false;
+                entry.action.active = false;
+                cancelled = true;
                 break;
             case ResultType::Continue:
                 break;
             }
 
-            if ( count_before == actions_.at( i ).service_count() ) {
+            if ( count_before == entry.action.service_count() ) {
                 throw runtime_error( "Poller: busy wait detected: callback did not read/write fd" );
             }
         }
+
+        /* the callbacks may have changed their own interest (by reading
+           to EOF or cancelling) */
+        mark_stale( fd_num, registration );
+
+        if ( cancelled ) {
+            remove_cancelled( fd_num );
+        }
+    }
+
+    if ( timer_expired and ready_count == 1 ) {
+        return Result::Type::Timeout;
     }
 
     return Result::Type::Success;
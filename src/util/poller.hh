@@ -5,9 +5,13 @@
 
 #include <functional>
 #include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
 #include <cassert>
 
 #include <poll.h>
+#include <sys/epoll.h>
 
 #include "file_descriptor.hh"
 
@@ -29,13 +33,15 @@ public:
         FileDescriptor & fd;
         enum PollDirection : short { In = POLLIN, Out = POLLOUT } direction;
         CallbackType callback;
+
+        /* if empty, the action is always interested (while active) */
         std::function<bool(void)> when_interested;
         bool active;
 
         Action( FileDescriptor & s_fd,
                 const PollDirection & s_direction,
                 const CallbackType & s_callback,
-                const std::function<bool(void)> & s_when_interested = [] () { return true; } )
+                const std::function<bool(void)> & s_when_interested = std::function<bool(void)>() )
             : fd( s_fd ), direction( s_direction ), callback( s_callback ),
               when_interested( s_when_interested ), active( true ) {}
 
@@ -43,8 +49,53 @@ public:
     };
 
 private:
-    std::vector< Action > actions_;
-    std::vector< pollfd > pollfds_;
+    /* an action, and whether it wants its callback run in the current poll */
+    struct Entry
+    {
+        Action action;
+        bool interested;
+    };
+
+    /* all the actions on one file descriptor share a single epoll
+       registration, which is only modified when their interest changes */
+    struct Registration
+    {
+        std::list< Entry > entries;
+        uint32_t events;
+        bool in_kernel;
+        bool stale; /* recheck interest at the next poll */
+        unsigned int conditional_entries; /* with a when_interested predicate */
+
+        Registration() : entries(), events( 0 ), in_kernel( false ), stale( false ), conditional_entries( 0 ) {}
+    };
+
+    std::unordered_map< int, Registration > registrations_;
+
+    /* Interest is only rechecked where it can have changed: on file
+       descriptors whose actions were just added or just ran, and on
+       those with when_interested predicates (which may depend on
+       anything, so are asked at every poll). An action without one
+       costs nothing in a poll where its file descriptor isn't ready. */
+    std::vector< int > stale_fds_;
+    std::vector< int > conditional_fds_;
+
+    /* registrations with some interest (if none, poll returns Exit) */
+    unsigned int interested_registrations_;
+
+    /* created on first poll, so a Poller set up before a fork isn't shared */
+    std::unique_ptr< FileDescriptor > epoll_;
+
+    std::vector< epoll_event > ready_;
+
+    /* timeouts finer than epoll_wait's milliseconds are kept by a timerfd */
+    std::unique_ptr< FileDescriptor > timer_;
+
+    void arm_timer( const int64_t timeout_ns );
+
+    void mark_stale( const int fd_num, Registration & registration );
+    void refresh_registration( const int fd_num, Registration & registration );
+    void update_registration( const int fd_num, Registration & registration, const uint32_t events );
+    void remove_cancelled( const int fd_num );
 
 public:
     struct Result
@@ -55,9 +106,13 @@ public:
             : result( s_result ), exit_status( s_status ) {}
     };
 
-    Poller() : actions_(), pollfds_() {}
+    Poller() : registrations_(), stale_fds_(), conditional_fds_(), interested_registrations_( 0 ),
+               epoll_(), ready_(), timer_() {}
     void add_action( Action action );
     Result poll( const int & timeout_ms );
+
+    /* negative timeout waits indefinitely */
+    Result poll_ns( const int64_t timeout_ns );
 };
 
 namespace PollerShortNames {
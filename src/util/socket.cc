@@ -75,6 +75,12 @@ void Socket::connect( const Address & address )
                                       address.size() ) );
 }
 
+/* shut down one or both directions of a connected socket */
+void Socket::shutdown( const int how )
+{
+    SystemCall( "shutdown", ::shutdown( fd_num(), how ) );
+}
+
 /* send datagram to specified address */
 void UDPSocket::sendto( const Address & destination, const string & payload )
 {
@@ -146,6 +152,15 @@ void Socket::set_reuseaddr( void )
     setsockopt( SOL_SOCKET, SO_REUSEADDR, int( true ) );
 }
 
+/* make a read that waits longer than this fail (with EAGAIN) */
+void Socket::set_receive_timeout( const uint64_t timeout_ms )
+{
+    timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = ( timeout_ms % 1000 ) * 1000;
+    setsockopt( SOL_SOCKET, SO_RCVTIMEO, timeout );
+}
+
 /* turn on timestamps on receipt */
 void UDPSocket::set_timestamps( void )
 {
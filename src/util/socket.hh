@@ -37,12 +37,18 @@ public:
     /* connect socket to a specified peer address */
     void connect( const Address & address );
 
+    /* shut down one or both directions of a connected socket */
+    void shutdown( const int how );
+
     /* accessors */
     Address local_address( void ) const;
     Address peer_address( void ) const;
 
     /* allow local address to be reused sooner, at the cost of some robustness */
     void set_reuseaddr( void );
+
+    /* make a read that waits longer than this fail (with EAGAIN) */
+    void set_receive_timeout( const uint64_t timeout_ms );
 };
 
 /* UDP socket */
@@ -5,24 +5,41 @@
 #include "timestamp.hh"
 #include "exception.hh"
 
-uint64_t raw_timestamp( void )
+static uint64_t raw_timestamp_ns( const clockid_t clock )
 {
     timespec ts;
-    SystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &ts ) );
+    SystemCall( "clock_gettime", clock_gettime( clock, &ts ) );
 
-    uint64_t millis = ts.tv_nsec / 1000000;
-    millis += uint64_t( ts.tv_sec ) * 1000;
+    return uint64_t( ts.tv_sec ) * NS_PER_SECOND + ts.tv_nsec;
+}
+
+/* the same instant on the wall clock (for logs) and the monotonic clock (for timing) */
+struct TimestampBase
+{
+    uint64_t realtime_ms = raw_timestamp_ns( CLOCK_REALTIME ) / NS_PER_MS;
+    uint64_t monotonic_ns = raw_timestamp_ns( CLOCK_MONOTONIC );
+};
 
-    return millis;
+static const TimestampBase & timestamp_base( void )
+{
+    static const TimestampBase base;
+    return base;
 }
 
 uint64_t initial_timestamp( void )
 {
-    static uint64_t initial_value = raw_timestamp();
-    return initial_value;
+    return timestamp_base().realtime_ms;
+}
+
+uint64_t timestamp_ns( void )
+{
+    /* the base first: on the first call, reading the clock before the
+       base is set would put now before it */
+    const uint64_t base_ns = timestamp_base().monotonic_ns;
+    return raw_timestamp_ns( CLOCK_MONOTONIC ) - base_ns;
 }
 
 uint64_t timestamp( void )
 {
-    return raw_timestamp() - initial_timestamp();
+    return timestamp_ns() / NS_PER_MS;
 }
@@ -5,7 +5,14 @@
 
 #include <cstdint>
 
+constexpr uint64_t NS_PER_MS = 1000000;
+constexpr uint64_t NS_PER_SECOND = 1000000000;
+
+/* monotonic time since initial timestamp, in milliseconds and nanoseconds */
 uint64_t timestamp( void );
+uint64_t timestamp_ns( void );
+
+/* wall-clock time (milliseconds since the epoch) of the initial timestamp */
 uint64_t initial_timestamp( void );
 
 #endif /* TIMESTAMP_HH */